@@ -0,0 +1,239 @@
+/*									tab:8
+ *
+ * feeder.c - scripted input for the maze game
+ *
+ * Filename:	    feeder.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feeder.h"
+#include "monotime.h"
+
+
+#define RTC_PF 0x40   /* periodic interrupt flag in an RTC record */
+
+/* one scripted event */
+typedef struct {
+    unsigned long tick;  /* RTC tick at which it happens          */
+    const char* keys;    /* bytes to type, or NULL                */
+    dir_t tux;           /* else Tux button held from then on     */
+} event_t;
+
+/* names of events and what they do */
+static const struct {
+    const char* name;
+    const char* keys;
+    dir_t tux;
+} actions[] = {
+    {"up", "\033[A", DIR_STOP},     {"down", "\033[B", DIR_STOP},
+    {"right", "\033[C", DIR_STOP},  {"left", "\033[D", DIR_STOP},
+    {"toggle", "t", DIR_STOP},      {"quit", "`", DIR_STOP},
+    {"tux-up", NULL, DIR_UP},       {"tux-down", NULL, DIR_DOWN},
+    {"tux-right", NULL, DIR_RIGHT}, {"tux-left", NULL, DIR_LEFT},
+    {"tux-none", NULL, DIR_STOP}
+};
+#define NUM_ACTIONS (sizeof (actions) / sizeof (actions[0]))
+
+
+/* local functions--see function headers for details */
+static int read_script (const char* path);
+static void* feeder_thread (void* arg);
+
+
+static event_t* events = NULL;   /* the script                  */
+static int num_events = 0;
+static long long period_usec;    /* time between RTC ticks      */
+static int pipes[2][2] = {{-1, -1}, {-1, -1}};  /* RTC, keyboard */
+static pthread_t feeder_tid;
+static int feeder_running = 0;
+static int feeder_quit = 0;
+static dir_t tux_held = DIR_STOP;
+
+
+/*
+ * start_input_script
+ *   DESCRIPTION: Read a script and start the thread that feeds it; see
+ *                feeder.h.
+ *   INPUTS: path -- the script file
+ *           rate -- RTC ticks per second
+ *   OUTPUTS: rtc_fd -- descriptor to read as the RTC
+ *            key_fd -- descriptor to read as the keyboard
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates a thread and two pipes; prints an error message
+ *                 on failure
+ */
+int
+start_input_script (const char* path, int rate, int* rtc_fd, int* key_fd)
+{
+    int i;
+
+    if (read_script (path) != 0)
+	return -1;
+    period_usec = 1000000 / rate;
+
+    /* The feeder never blocks; a full pipe loses input, as would a device. */
+    for (i = 0; i < 2; i++) {
+	if (pipe (pipes[i]) != 0 ||
+	    fcntl (pipes[i][1], F_SETFL, O_NONBLOCK) != 0) {
+	    perror ("start_input_script");
+	    stop_input_script ();
+	    return -1;
+	}
+    }
+    if ((errno = pthread_create (&feeder_tid, NULL, feeder_thread,
+				 NULL)) != 0) {
+	perror ("start_input_script");
+	stop_input_script ();
+	return -1;
+    }
+    feeder_running = 1;
+    *rtc_fd = pipes[0][0];
+    *key_fd = pipes[1][0];
+    return 0;
+}
+
+
+/*
+ * read_script
+ *   DESCRIPTION: Read and check a script.
+ *   INPUTS: path -- the script file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: fills events; prints an error message on failure
+ */
+static int
+read_script (const char* path)
+{
+    FILE* f;
+    char line[200], name[40];
+    unsigned long tick;
+    event_t* e;
+    int line_num, i;
+
+    if ((f = fopen (path, "r")) == NULL) {
+	perror (path);
+	return -1;
+    }
+    for (line_num = 1; fgets (line, sizeof (line), f) != NULL; line_num++) {
+	if (sscanf (line, " %39s", name) != 1 || name[0] == '#')
+	    continue;
+	if (sscanf (line, "%lu %39s", &tick, name) != 2)
+	    i = NUM_ACTIONS;
+	else
+	    for (i = 0; i < NUM_ACTIONS && strcmp (name, actions[i].name); i++);
+	if (i == NUM_ACTIONS ||
+	    (num_events > 0 && tick < events[num_events - 1].tick)) {
+	    fprintf (stderr, "%s:%d: bad event\n", path, line_num);
+	    (void)fclose (f);
+	    return -1;
+	}
+	if ((e = realloc (events, (num_events + 1) * sizeof (*e))) == NULL) {
+	    perror ("read_script");
+	    (void)fclose (f);
+	    return -1;
+	}
+	events = e;
+	events[num_events].tick = tick;
+	events[num_events].keys = actions[i].keys;
+	events[num_events].tux = actions[i].tux;
+	num_events++;
+    }
+    (void)fclose (f);
+    return 0;
+}
+
+
+/*
+ * feeder_thread
+ *   DESCRIPTION: Once per RTC tick, type the keys of the events at that
+ *                tick and change the Tux button held, then write an RTC
+ *                interrupt record.
+ *   INPUTS: arg -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: writes to the pipes
+ */
+static void*
+feeder_thread (void* arg)
+{
+    unsigned long tick;       /* number of the next tick   */
+    unsigned long data;       /* one interrupt, as the RTC */
+    int next = 0;             /* next event                */
+    long long t;              /* time of the next tick     */
+
+    t = now_usec ();
+    for (tick = 0; !__atomic_load_n (&feeder_quit, __ATOMIC_ACQUIRE);
+	 tick++) {
+	for (; next < num_events && events[next].tick == tick; next++) {
+	    if (events[next].keys != NULL)
+		(void)write (pipes[1][1], events[next].keys,
+			     strlen (events[next].keys));
+	    else
+		__atomic_store_n (&tux_held, events[next].tux,
+				  __ATOMIC_RELEASE);
+	}
+	data = (1UL << 8) | RTC_PF;
+	(void)write (pipes[0][1], &data, sizeof (data));
+
+	t += period_usec;
+	sleep_until (t);
+    }
+    return NULL;
+}
+
+
+/*
+ * sample_script_tux
+ *   DESCRIPTION: Get the scripted Tux controller button.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the direction held, or DIR_STOP
+ *   SIDE EFFECTS: none
+ */
+dir_t
+sample_script_tux ()
+{
+    return __atomic_load_n (&tux_held, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+ * stop_input_script
+ *   DESCRIPTION: Stop the feeder thread, if started, and close the pipes.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+stop_input_script ()
+{
+    int i, j;
+
+    if (feeder_running) {
+	__atomic_store_n (&feeder_quit, 1, __ATOMIC_RELEASE);
+	(void)pthread_join (feeder_tid, NULL);
+	feeder_running = 0;
+    }
+    for (i = 0; i < 2; i++) {
+	for (j = 0; j < 2; j++) {
+	    if (pipes[i][j] != -1)
+		(void)close (pipes[i][j]);
+	    pipes[i][j] = -1;
+	}
+    }
+    free (events);
+    events = NULL;
+    num_events = 0;
+}
@@ -0,0 +1,50 @@
+/*									tab:8
+ *
+ * feeder.h - scripted input for the maze game
+ *
+ * Filename:	    feeder.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef FEEDER_H
+#define FEEDER_H
+
+
+#include "blocks.h"
+
+
+/*
+ * The feeder stands in for the RTC, the keyboard, and the Tux controller,
+ * so that the game can run unattended (with the software display, without
+ * any devices) and reproduce the same input timing on every run.  It
+ * writes RTC interrupt records to one pipe at a fixed rate, and the bytes
+ * of scripted keystrokes to another; the input reactor reads both as if
+ * they were /dev/rtc and the terminal.
+ *
+ * A script has one event per line: the RTC tick (counting from 0) at
+ * which it happens, then one of
+ *     up, down, left, right     an arrow key
+ *     toggle                    't' (double/triple buffering)
+ *     quit                      '`'
+ *     tux-up, tux-down, tux-left, tux-right, tux-none
+ *                               the Tux controller button held from then
+ * Events must be in order of tick.  Blank lines and lines starting with
+ * '#' are ignored.  Ticks go on after the last event.
+ */
+
+/*
+ * start feeding a script at rate ticks per second; on success, returns 0
+ * and the descriptors to read as the RTC and keyboard; else returns -1
+ */
+extern int start_input_script (const char* path, int rate, int* rtc_fd,
+			       int* key_fd);
+
+/* the Tux controller button held, for start_input_reactor */
+extern dir_t sample_script_tux ();
+
+/* stop feeding and close the descriptors */
+extern void stop_input_script ();
+
+#endif /* FEEDER_H */
@@ -0,0 +1,914 @@
+/*									tab:8
+ *
+ * kernels.c - pixel kernels with run-time instruction set dispatch
+ *
+ * Filename:	    kernels.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Generalized copy kernel selection into a dispatch table
+ *		for all pixel kernels.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernels.h"
+
+
+/*
+ * The vector kernels need per-function target attributes and the
+ * matching intrinsics headers, which first appeared together in GCC 4.9.
+ * Older compilers (and other ISAs) get only the scalar kernels.
+ */
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define KERNELS_SIMD 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define KERNELS_SIMD 0
+#endif
+
+/* number of timed copies per kernel; the fastest copy is kept */
+#define BENCH_ROUNDS 8
+
+/* environment variable used to cap the instruction set level */
+#define ISA_ENV_VAR "MAZEGAME_ISA"
+
+#define NUM_ELTS(a) ((int)(sizeof (a) / sizeof ((a)[0])))
+
+
+/* local functions--see function headers for details */
+static isa_t detect_isa ();
+static isa_t requested_isa (isa_t cpu);
+static long long bench_kernel (copy_fn_t fn, unsigned char* dst,
+			       const unsigned char* src, int len);
+static void copy_movsb (unsigned char* dst, const unsigned char* src, int len);
+static void copy_movsl (unsigned char* dst, const unsigned char* src, int len);
+static void split_scalar (unsigned char* plane0, int stride,
+			  const unsigned char* src, int len, int phase);
+static void merge_scalar (unsigned char* dst, const unsigned char* plane0,
+			  int stride, int len, int phase);
+static void glyph_scalar (unsigned char* dst, const unsigned char* bits,
+			  int n, const unsigned char* src, int add);
+static void blend_scalar (unsigned char* dst, const unsigned char* mask,
+			  const unsigned char* fg, const unsigned char* bg,
+			  int len);
+#if KERNELS_SIMD
+static void copy_sse2 (unsigned char* dst, const unsigned char* src, int len);
+static void copy_avx2 (unsigned char* dst, const unsigned char* src, int len);
+static void split_sse2 (unsigned char* plane0, int stride,
+			const unsigned char* src, int len, int phase);
+static void split_ssse3 (unsigned char* plane0, int stride,
+			 const unsigned char* src, int len, int phase);
+static void split_avx2 (unsigned char* plane0, int stride,
+			const unsigned char* src, int len, int phase);
+static void merge_sse2 (unsigned char* dst, const unsigned char* plane0,
+			int stride, int len, int phase);
+static void glyph_sse2 (unsigned char* dst, const unsigned char* bits,
+			int n, const unsigned char* src, int add);
+static void glyph_avx2 (unsigned char* dst, const unsigned char* bits,
+			int n, const unsigned char* src, int add);
+static void blend_sse2 (unsigned char* dst, const unsigned char* mask,
+			const unsigned char* fg, const unsigned char* bg,
+			int len);
+static void blend_avx2 (unsigned char* dst, const unsigned char* mask,
+			const unsigned char* fg, const unsigned char* bg,
+			int len);
+#endif
+
+
+/* names of instruction set levels, as accepted in ISA_ENV_VAR */
+static const char* const isa_names[NUM_ISA_LEVELS] = {
+    "scalar", "sse2", "ssse3", "avx2"
+};
+
+/*
+ * Variants of each kernel, in increasing order of instruction set level.
+ * The last variant whose level does not exceed the selected level is
+ * installed, except for copies, which are timed against one another
+ * because video memory makes the outcome hard to predict.
+ */
+static const struct {
+    const char* name; isa_t isa; copy_fn_t fn;
+} copy_variants[] = {
+    {"movsb", ISA_SCALAR, copy_movsb},
+    {"movsl", ISA_SCALAR, copy_movsl},
+#if KERNELS_SIMD
+    {"sse2-nt", ISA_SSE2, copy_sse2},
+    {"avx2-nt", ISA_AVX2, copy_avx2},
+#endif
+};
+static const struct {
+    const char* name; isa_t isa; split_fn_t fn;
+} split_variants[] = {
+    {"scalar", ISA_SCALAR, split_scalar},
+#if KERNELS_SIMD
+    {"sse2", ISA_SSE2, split_sse2},
+    {"ssse3", ISA_SSSE3, split_ssse3},
+    {"avx2", ISA_AVX2, split_avx2},
+#endif
+};
+static const struct {
+    const char* name; isa_t isa; merge_fn_t fn;
+} merge_variants[] = {
+    {"scalar", ISA_SCALAR, merge_scalar},
+#if KERNELS_SIMD
+    {"sse2", ISA_SSE2, merge_sse2},
+#endif
+};
+static const struct {
+    const char* name; isa_t isa; glyph_fn_t fn;
+} glyph_variants[] = {
+    {"scalar", ISA_SCALAR, glyph_scalar},
+#if KERNELS_SIMD
+    {"sse2", ISA_SSE2, glyph_sse2},
+    {"avx2", ISA_AVX2, glyph_avx2},
+#endif
+};
+static const struct {
+    const char* name; isa_t isa; blend_fn_t fn;
+} blend_variants[] = {
+    {"scalar", ISA_SCALAR, blend_scalar},
+#if KERNELS_SIMD
+    {"sse2", ISA_SSE2, blend_sse2},
+    {"avx2", ISA_AVX2, blend_avx2},
+#endif
+};
+
+/* kernels in use; REP MOVSB and the scalar kernels are always safe */
+pixel_kernels_t kernels = {
+    copy_movsb, split_scalar, merge_scalar, glyph_scalar, blend_scalar
+};
+static isa_t selected_isa = ISA_SCALAR;
+
+
+/*
+ * init_pixel_kernels
+ *   DESCRIPTION: Fill the kernel dispatch table for this machine.  The
+ *                instruction set level is detected with CPUID and may be
+ *                lowered with ISA_ENV_VAR.  For each kernel, the variant
+ *                for the highest level not above the selected one is
+ *                installed.  Copy kernels are instead timed by copying
+ *                len bytes from src to dst several times, and the one
+ *                with the lowest best time is installed.  Write-combined
+ *                video memory behaves very differently from cached
+ *                memory, so dst should be part of the real upload target.
+ *                Should be called once, before any other thread uses the
+ *                table.
+ *   INPUTS: dst -- scratch destination (contents are destroyed)
+ *           src -- source data
+ *           len -- number of bytes per timed copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: overwrites len bytes at dst; changes kernels; prints
+ *                 one line describing the selection to stderr
+ */
+void
+init_pixel_kernels (unsigned char* dst, const unsigned char* src, int len)
+{
+    isa_t cpu;                  /* highest level supported by the CPU */
+    long long best = LLONG_MAX; /* best time seen over all kernels    */
+    long long t;                /* best time for the current kernel   */
+    int c, s, m, g, b;          /* indices of selected variants       */
+    int i;                      /* loop index over variants           */
+
+    cpu = detect_isa ();
+    selected_isa = requested_isa (cpu);
+
+    for (c = 0, i = 0; i < NUM_ELTS (copy_variants); i++) {
+	if (copy_variants[i].isa > selected_isa)
+	    continue;
+	t = bench_kernel (copy_variants[i].fn, dst, src, len);
+	if (t < best) {
+	    best = t;
+	    c = i;
+	}
+    }
+    for (s = 0; s + 1 < NUM_ELTS (split_variants) &&
+		split_variants[s + 1].isa <= selected_isa; s++);
+    for (m = 0; m + 1 < NUM_ELTS (merge_variants) &&
+		merge_variants[m + 1].isa <= selected_isa; m++);
+    for (g = 0; g + 1 < NUM_ELTS (glyph_variants) &&
+		glyph_variants[g + 1].isa <= selected_isa; g++);
+    for (b = 0; b + 1 < NUM_ELTS (blend_variants) &&
+		blend_variants[b + 1].isa <= selected_isa; b++);
+
+    kernels.copy = copy_variants[c].fn;
+    kernels.split = split_variants[s].fn;
+    kernels.merge = merge_variants[m].fn;
+    kernels.glyph = glyph_variants[g].fn;
+    kernels.blend = blend_variants[b].fn;
+
+    fprintf (stderr, "kernels: isa %s (cpu %s); copy %s, split %s, "
+	     "merge %s, glyph %s, blend %s\n", isa_names[selected_isa],
+	     isa_names[cpu], copy_variants[c].name, split_variants[s].name,
+	     merge_variants[m].name, glyph_variants[g].name,
+	     blend_variants[b].name);
+}
+
+
+/*
+ * kernel_isa
+ *   DESCRIPTION: Get the instruction set level selected for the kernels.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the level; ISA_SCALAR before init_pixel_kernels
+ *   SIDE EFFECTS: none
+ */
+isa_t
+kernel_isa ()
+{
+    return selected_isa;
+}
+
+
+/*
+ * isa_name
+ *   DESCRIPTION: Get the printable name of an instruction set level.
+ *   INPUTS: isa -- the level
+ *   OUTPUTS: none
+ *   RETURN VALUE: a constant string naming the level
+ *   SIDE EFFECTS: none
+ */
+const char*
+isa_name (isa_t isa)
+{
+    if (isa < ISA_SCALAR || isa >= NUM_ISA_LEVELS)
+	return "unknown";
+    return isa_names[isa];
+}
+
+
+/*
+ * requested_isa
+ *   DESCRIPTION: Apply the ISA_ENV_VAR override, if any, to the level
+ *                supported by the CPU.  Unknown names are ignored, and
+ *                levels above the CPU's are lowered to the CPU's.
+ *   INPUTS: cpu -- highest level supported by the CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: the level to use
+ *   SIDE EFFECTS: prints a warning to stderr on a bad request
+ */
+static isa_t
+requested_isa (isa_t cpu)
+{
+    const char* req; /* value of the environment variable */
+    int i;           /* loop index over levels            */
+
+    if ((req = getenv (ISA_ENV_VAR)) == NULL || req[0] == '\0')
+	return cpu;
+    for (i = 0; i < NUM_ISA_LEVELS; i++)
+	if (strcmp (req, isa_names[i]) == 0)
+	    break;
+    if (i == NUM_ISA_LEVELS) {
+	fprintf (stderr, "kernels: ignoring unknown %s=%s\n", ISA_ENV_VAR,
+		 req);
+	return cpu;
+    }
+    if ((isa_t)i > cpu) {
+	fprintf (stderr, "kernels: CPU lacks %s; using %s\n", isa_names[i],
+		 isa_names[cpu]);
+	return cpu;
+    }
+    return (isa_t)i;
+}
+
+
+/*
+ * bench_kernel
+ *   DESCRIPTION: Time one copy kernel.  A first untimed copy warms up
+ *                the caches and TLB; the best of BENCH_ROUNDS timed
+ *                copies is then reported, which filters out preemption.
+ *   INPUTS: fn -- kernel to time
+ *           dst, src, len -- arguments for each copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: best observed time for one copy, in nanoseconds
+ *   SIDE EFFECTS: overwrites len bytes at dst
+ */
+static long long
+bench_kernel (copy_fn_t fn, unsigned char* dst, const unsigned char* src,
+	      int len)
+{
+    struct timespec t0, t1; /* start and end of one copy */
+    long long t, best;      /* elapsed and best times    */
+    int i;                  /* loop index over rounds    */
+
+    fn (dst, src, len);
+    best = LLONG_MAX;
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+	(void)clock_gettime (CLOCK_MONOTONIC, &t0);
+	fn (dst, src, len);
+	(void)clock_gettime (CLOCK_MONOTONIC, &t1);
+	t = (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+	if (t < best)
+	    best = t;
+    }
+    return best;
+}
+
+
+/*
+ * copy_movsb
+ *   DESCRIPTION: Copy with a single REP MOVSB.  Under emulation this is
+ *                a single instruction that translates to a native loop,
+ *                and CPUs with fast string support (ERMSB) turn it into
+ *                wide stores internally.
+ *   INPUTS: dst, src, len -- destination, source, and byte count
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void
+copy_movsb (unsigned char* dst, const unsigned char* src, int len)
+{
+    unsigned long count = len; /* full-width count register */
+
+    asm volatile (
+        "cld                                                 ;"
+       	"rep movsb    # copy ECX bytes from M[ESI] to M[EDI]  "
+      : "+S" (src), "+D" (dst), "+c" (count)
+      : /* no other inputs */
+      : "memory", "cc"
+    );
+}
+
+
+/*
+ * copy_movsl
+ *   DESCRIPTION: Copy with REP MOVSL over the 4-byte aligned body of the
+ *                destination, using REP MOVSB for the unaligned head and
+ *                for the tail.  Video memory on older buses takes one
+ *                bus cycle per store, so quarter as many stores wins
+ *                there even without fast string support.
+ *   INPUTS: dst, src, len -- destination, source, and byte count
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void
+copy_movsl (unsigned char* dst, const unsigned char* src, int len)
+{
+    unsigned long head; /* bytes before the first aligned destination */
+    unsigned int rest;  /* bytes from the aligned destination onwards */
+
+    if ((head = (-(unsigned long)dst) & 3) > (unsigned long)len)
+	head = len;
+    rest = len - head;
+
+    asm volatile (
+        "cld                                                 ;"
+       	"rep movsb          /* unaligned head bytes     */ ;"
+	"movl %3,%%ecx                                       ;"
+	"shrl $2,%%ecx                                       ;"
+       	"rep movsl          /* aligned body, by dwords  */ ;"
+	"movl %3,%%ecx                                       ;"
+	"andl $3,%%ecx                                       ;"
+       	"rep movsb          /* tail bytes               */  "
+      : "+S" (src), "+D" (dst), "+c" (head)
+      : "r" (rest)
+      : "memory", "cc"
+    );
+}
+
+
+/*
+ * split_scalar
+ *   DESCRIPTION: Scatter a line of pixels into mode X planes one pixel
+ *                at a time.  See kernels.h for the layout.
+ *   INPUTS: plane0 -- address of the first column in plane 0
+ *           stride -- offset from each plane to the next
+ *           src -- pixels to scatter
+ *           len -- number of pixels
+ *           phase -- logical column of the first pixel, modulo 4
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes spread over the four planes
+ */
+static void
+split_scalar (unsigned char* plane0, int stride, const unsigned char* src,
+	      int len, int phase)
+{
+    int i; /* loop index over pixels */
+
+    for (i = 0; i < len; i++, phase++)
+	plane0[(phase & 3) * stride + (phase >> 2)] = src[i];
+}
+
+
+/*
+ * merge_scalar
+ *   DESCRIPTION: Gather a line of pixels from mode X planes one pixel at
+ *                a time; the inverse of split_scalar.
+ *   INPUTS: dst -- destination for the pixels
+ *           plane0, stride, len, phase -- as for split_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void
+merge_scalar (unsigned char* dst, const unsigned char* plane0, int stride,
+	      int len, int phase)
+{
+    int i; /* loop index over pixels */
+
+    for (i = 0; i < len; i++, phase++)
+	dst[i] = plane0[(phase & 3) * stride + (phase >> 2)];
+}
+
+
+/*
+ * glyph_scalar
+ *   DESCRIPTION: Draw one row of font characters, testing one bit per
+ *                pixel.
+ *   INPUTS: dst -- row of 8 * n pixels to draw into
+ *           bits -- one font row bit pattern per character, with the
+ *                   leftmost pixel in the most significant bit
+ *           n -- number of characters
+ *           src, add -- each drawn pixel becomes src[i] + add
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the pixels of dst whose bits are set
+ */
+static void
+glyph_scalar (unsigned char* dst, const unsigned char* bits, int n,
+	      const unsigned char* src, int add)
+{
+    int c, j; /* loop indices over characters and pixels */
+
+    for (c = 0; c < n; c++, dst += 8, src += 8)
+	for (j = 0; j < 8; j++)
+	    if (bits[c] & (0x80 >> j))
+		dst[j] = src[j] + add;
+}
+
+
+/*
+ * blend_scalar
+ *   DESCRIPTION: Select between two images by a mask, one pixel at a
+ *                time.
+ *   INPUTS: dst -- destination image (may be the same as fg or bg)
+ *           mask -- non-zero where fg should be used
+ *           fg, bg -- foreground and background images
+ *           len -- number of pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void
+blend_scalar (unsigned char* dst, const unsigned char* mask,
+	      const unsigned char* fg, const unsigned char* bg, int len)
+{
+    int i; /* loop index over pixels */
+
+    for (i = 0; i < len; i++)
+	dst[i] = (mask[i] != 0 ? fg[i] : bg[i]);
+}
+
+
+#if KERNELS_SIMD
+
+/*
+ * detect_isa
+ *   DESCRIPTION: Find the highest instruction set level supported by the
+ *                CPU.  AVX2 also requires that the operating system saves
+ *                the YMM registers on context switches (XCR0 bits 1 and
+ *                2, read with XGETBV).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the level
+ *   SIDE EFFECTS: none
+ */
+static isa_t
+detect_isa ()
+{
+    unsigned int a, b, c, d; /* CPUID result registers */
+
+    if (!__get_cpuid (1, &a, &b, &c, &d) || (d & bit_SSE2) == 0)
+	return ISA_SCALAR;
+    if ((c & bit_SSSE3) == 0)
+	return ISA_SSE2;
+    if ((c & bit_OSXSAVE) == 0 || (c & bit_AVX) == 0)
+	return ISA_SSSE3;
+    asm volatile (
+	".byte 0x0F, 0x01, 0xD0     /* XGETBV; older assemblers lack it */"
+      : "=a" (a), "=d" (d)
+      : "c" (0)
+    );
+    if ((a & 6) != 6 || __get_cpuid_max (0, NULL) < 7)
+	return ISA_SSSE3;
+    __cpuid_count (7, 0, a, b, c, d);
+    return ((b & bit_AVX2) != 0 ? ISA_AVX2 : ISA_SSSE3);
+}
+
+
+/*
+ * copy_sse2
+ *   DESCRIPTION: Copy with SSE2 non-temporal (streaming) stores.  Video
+ *                memory is mapped write-combining, and streaming stores
+ *                fill whole write-combining buffers without reading the
+ *                destination or polluting the cache.  Single bytes are
+ *                copied until the destination is 16-byte aligned, and
+ *                after the last full vector.
+ *   INPUTS: dst, src, len -- destination, source, and byte count
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void __attribute__ ((target ("sse2")))
+copy_sse2 (unsigned char* dst, const unsigned char* src, int len)
+{
+    __m128i a, b, c, d; /* one 64-byte group of source data */
+
+    for (; len > 0 && ((unsigned long)dst & 15) != 0; len--)
+	*dst++ = *src++;
+    for (; len >= 64; len -= 64, src += 64, dst += 64) {
+	a = _mm_loadu_si128 ((const __m128i*)src);
+	b = _mm_loadu_si128 ((const __m128i*)(src + 16));
+	c = _mm_loadu_si128 ((const __m128i*)(src + 32));
+	d = _mm_loadu_si128 ((const __m128i*)(src + 48));
+	_mm_stream_si128 ((__m128i*)dst, a);
+	_mm_stream_si128 ((__m128i*)(dst + 16), b);
+	_mm_stream_si128 ((__m128i*)(dst + 32), c);
+	_mm_stream_si128 ((__m128i*)(dst + 48), d);
+    }
+    for (; len >= 16; len -= 16, src += 16, dst += 16)
+	_mm_stream_si128 ((__m128i*)dst, _mm_loadu_si128 ((const __m128i*)src));
+
+    /* Streaming stores are weakly ordered; drain them before returning. */
+    _mm_sfence ();
+    for (; len > 0; len--)
+	*dst++ = *src++;
+}
+
+
+/*
+ * copy_avx2
+ *   DESCRIPTION: Copy with AVX2 non-temporal stores; as copy_sse2, but
+ *                with 32-byte vectors and 32-byte destination alignment.
+ *   INPUTS: dst, src, len -- destination, source, and byte count
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void __attribute__ ((target ("avx2")))
+copy_avx2 (unsigned char* dst, const unsigned char* src, int len)
+{
+    __m256i a, b; /* one 64-byte group of source data */
+
+    for (; len > 0 && ((unsigned long)dst & 31) != 0; len--)
+	*dst++ = *src++;
+    for (; len >= 64; len -= 64, src += 64, dst += 64) {
+	a = _mm256_loadu_si256 ((const __m256i*)src);
+	b = _mm256_loadu_si256 ((const __m256i*)(src + 32));
+	_mm256_stream_si256 ((__m256i*)dst, a);
+	_mm256_stream_si256 ((__m256i*)(dst + 32), b);
+    }
+    for (; len >= 32; len -= 32, src += 32, dst += 32)
+	_mm256_stream_si256 ((__m256i*)dst,
+			     _mm256_loadu_si256 ((const __m256i*)src));
+    _mm_sfence ();
+    for (; len > 0; len--)
+	*dst++ = *src++;
+}
+
+
+/*
+ * split_sse2
+ *   DESCRIPTION: Scatter pixels into planes 32 at a time.  Pixels are
+ *                handled singly until the logical column is a multiple
+ *                of four, so that each 32-bit lane of a vector holds one
+ *                pixel for each plane in order.  Shifting and masking
+ *                isolate one plane's byte per lane, and two saturating
+ *                packs gather eight of them into the low half of a
+ *                vector.
+ *   INPUTS: plane0, stride, src, len, phase -- as for split_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes spread over the four planes
+ */
+static void __attribute__ ((target ("sse2")))
+split_sse2 (unsigned char* plane0, int stride, const unsigned char* src,
+	    int len, int phase)
+{
+    const __m128i low = _mm_set1_epi32 (0xFF); /* byte 0 of each lane */
+    __m128i a, b;    /* 32 source pixels              */
+    __m128i p;       /* eight pixels of one plane     */
+    unsigned char* col; /* current column in plane 0  */
+    int head;        /* pixels handled singly first   */
+
+    head = (4 - (phase & 3)) & 3;
+    if (head > len)
+	head = len;
+    split_scalar (plane0, stride, src, head, phase);
+    src += head;
+    len -= head;
+    col = plane0 + ((phase + head) >> 2);
+
+    for (; len >= 32; len -= 32, src += 32, col += 8) {
+	a = _mm_loadu_si128 ((const __m128i*)src);
+	b = _mm_loadu_si128 ((const __m128i*)(src + 16));
+	p = _mm_packs_epi32 (_mm_and_si128 (a, low), _mm_and_si128 (b, low));
+	_mm_storel_epi64 ((__m128i*)col, _mm_packus_epi16 (p, p));
+	p = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (a, 8), low),
+			     _mm_and_si128 (_mm_srli_epi32 (b, 8), low));
+	_mm_storel_epi64 ((__m128i*)(col + stride), _mm_packus_epi16 (p, p));
+	p = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (a, 16), low),
+			     _mm_and_si128 (_mm_srli_epi32 (b, 16), low));
+	_mm_storel_epi64 ((__m128i*)(col + 2 * stride),
+			  _mm_packus_epi16 (p, p));
+	p = _mm_packs_epi32 (_mm_srli_epi32 (a, 24), _mm_srli_epi32 (b, 24));
+	_mm_storel_epi64 ((__m128i*)(col + 3 * stride),
+			  _mm_packus_epi16 (p, p));
+    }
+    split_scalar (col, stride, src, len, 0);
+}
+
+
+/*
+ * split_ssse3
+ *   DESCRIPTION: Scatter pixels into planes 32 at a time using byte
+ *                shuffles.  After the same alignment step as split_sse2,
+ *                a shuffle regroups each 16 pixels so that each 32-bit
+ *                lane holds four pixels of one plane; interleaving the
+ *                lanes of two such vectors yields eight pixels per plane.
+ *   INPUTS: plane0, stride, src, len, phase -- as for split_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes spread over the four planes
+ */
+static void __attribute__ ((target ("ssse3")))
+split_ssse3 (unsigned char* plane0, int stride, const unsigned char* src,
+	     int len, int phase)
+{
+    const __m128i shuf = _mm_setr_epi8 (0, 4, 8, 12, 1, 5, 9, 13,
+					2, 6, 10, 14, 3, 7, 11, 15);
+    __m128i a, b;    /* 32 source pixels, then regrouped  */
+    __m128i p01, p23; /* planes 0 and 1, planes 2 and 3   */
+    unsigned char* col; /* current column in plane 0      */
+    int head;        /* pixels handled singly first       */
+
+    head = (4 - (phase & 3)) & 3;
+    if (head > len)
+	head = len;
+    split_scalar (plane0, stride, src, head, phase);
+    src += head;
+    len -= head;
+    col = plane0 + ((phase + head) >> 2);
+
+    for (; len >= 32; len -= 32, src += 32, col += 8) {
+	a = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i*)src), shuf);
+	b = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i*)(src + 16)),
+			      shuf);
+	p01 = _mm_unpacklo_epi32 (a, b);
+	p23 = _mm_unpackhi_epi32 (a, b);
+	_mm_storel_epi64 ((__m128i*)col, p01);
+	_mm_storel_epi64 ((__m128i*)(col + stride), _mm_srli_si128 (p01, 8));
+	_mm_storel_epi64 ((__m128i*)(col + 2 * stride), p23);
+	_mm_storel_epi64 ((__m128i*)(col + 3 * stride),
+			  _mm_srli_si128 (p23, 8));
+    }
+    split_scalar (col, stride, src, len, 0);
+}
+
+
+/*
+ * split_avx2
+ *   DESCRIPTION: Scatter pixels into planes 64 at a time.  The in-lane
+ *                shuffle of split_ssse3 is applied to both 128-bit
+ *                halves, a cross-lane permute brings the 32-bit groups
+ *                of each plane together, and 64-bit interleaving of two
+ *                vectors yields sixteen pixels per plane.
+ *   INPUTS: plane0, stride, src, len, phase -- as for split_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes spread over the four planes
+ */
+static void __attribute__ ((target ("avx2")))
+split_avx2 (unsigned char* plane0, int stride, const unsigned char* src,
+	    int len, int phase)
+{
+    const __m256i shuf = _mm256_setr_epi8 (0, 4, 8, 12, 1, 5, 9, 13,
+					   2, 6, 10, 14, 3, 7, 11, 15,
+					   0, 4, 8, 12, 1, 5, 9, 13,
+					   2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i perm = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i a, b;     /* 64 source pixels, then regrouped  */
+    __m256i p02, p13; /* planes 0 and 2, planes 1 and 3    */
+    unsigned char* col; /* current column in plane 0       */
+    int head;         /* pixels handled singly first       */
+
+    head = (4 - (phase & 3)) & 3;
+    if (head > len)
+	head = len;
+    split_scalar (plane0, stride, src, head, phase);
+    src += head;
+    len -= head;
+    col = plane0 + ((phase + head) >> 2);
+
+    for (; len >= 64; len -= 64, src += 64, col += 16) {
+	a = _mm256_loadu_si256 ((const __m256i*)src);
+	b = _mm256_loadu_si256 ((const __m256i*)(src + 32));
+	a = _mm256_permutevar8x32_epi32 (_mm256_shuffle_epi8 (a, shuf), perm);
+	b = _mm256_permutevar8x32_epi32 (_mm256_shuffle_epi8 (b, shuf), perm);
+	p02 = _mm256_unpacklo_epi64 (a, b);
+	p13 = _mm256_unpackhi_epi64 (a, b);
+	_mm_storeu_si128 ((__m128i*)col, _mm256_castsi256_si128 (p02));
+	_mm_storeu_si128 ((__m128i*)(col + stride),
+			  _mm256_castsi256_si128 (p13));
+	_mm_storeu_si128 ((__m128i*)(col + 2 * stride),
+			  _mm256_extracti128_si256 (p02, 1));
+	_mm_storeu_si128 ((__m128i*)(col + 3 * stride),
+			  _mm256_extracti128_si256 (p13, 1));
+    }
+    split_ssse3 (col, stride, src, len, 0);
+}
+
+
+/*
+ * merge_sse2
+ *   DESCRIPTION: Gather pixels from planes 32 at a time; the inverse of
+ *                split_sse2.  Eight pixels from each plane are
+ *                interleaved first by bytes (planes 0/1 and 2/3) and
+ *                then by 16-bit pairs.
+ *   INPUTS: dst, plane0, stride, len, phase -- as for merge_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void __attribute__ ((target ("sse2")))
+merge_sse2 (unsigned char* dst, const unsigned char* plane0, int stride,
+	    int len, int phase)
+{
+    __m128i p01, p23;         /* planes 0 and 1, 2 and 3, interleaved */
+    const unsigned char* col; /* current column in plane 0            */
+    int head;                 /* pixels handled singly first          */
+
+    head = (4 - (phase & 3)) & 3;
+    if (head > len)
+	head = len;
+    merge_scalar (dst, plane0, stride, head, phase);
+    dst += head;
+    len -= head;
+    col = plane0 + ((phase + head) >> 2);
+
+    for (; len >= 32; len -= 32, dst += 32, col += 8) {
+	p01 = _mm_unpacklo_epi8 (
+		_mm_loadl_epi64 ((const __m128i*)col),
+		_mm_loadl_epi64 ((const __m128i*)(col + stride)));
+	p23 = _mm_unpacklo_epi8 (
+		_mm_loadl_epi64 ((const __m128i*)(col + 2 * stride)),
+		_mm_loadl_epi64 ((const __m128i*)(col + 3 * stride)));
+	_mm_storeu_si128 ((__m128i*)dst, _mm_unpacklo_epi16 (p01, p23));
+	_mm_storeu_si128 ((__m128i*)(dst + 16), _mm_unpackhi_epi16 (p01, p23));
+    }
+    merge_scalar (dst, col, stride, len, 0);
+}
+
+
+/*
+ * glyph_sse2
+ *   DESCRIPTION: Draw font characters two at a time.  Each bit pattern
+ *                is broadcast to eight bytes, and comparing the pattern
+ *                masked by each byte's bit with that bit gives a byte
+ *                mask of pixels to draw.
+ *   INPUTS: dst, bits, n, src, add -- as for glyph_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the pixels of dst whose bits are set
+ */
+static void __attribute__ ((target ("sse2")))
+glyph_sse2 (unsigned char* dst, const unsigned char* bits, int n,
+	    const unsigned char* src, int add)
+{
+    const __m128i sel = _mm_setr_epi8 (0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+				       0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m128i inc = _mm_set1_epi8 ((char)add);
+    __m128i m, v; /* pixel mask and pixel values */
+
+    for (; n >= 2; n -= 2, bits += 2, dst += 16, src += 16) {
+	m = _mm_cvtsi32_si128 (bits[0] | (bits[1] << 8));
+	m = _mm_unpacklo_epi8 (m, m);
+	m = _mm_unpacklo_epi16 (m, m);
+	m = _mm_unpacklo_epi32 (m, m);
+	m = _mm_cmpeq_epi8 (_mm_and_si128 (m, sel), sel);
+	v = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i*)src), inc);
+	v = _mm_or_si128 (_mm_and_si128 (m, v), _mm_andnot_si128
+			  (m, _mm_loadu_si128 ((const __m128i*)dst)));
+	_mm_storeu_si128 ((__m128i*)dst, v);
+    }
+    glyph_scalar (dst, bits, n, src, add);
+}
+
+
+/*
+ * glyph_avx2
+ *   DESCRIPTION: Draw font characters four at a time; as glyph_sse2, but
+ *                with a byte shuffle broadcasting each bit pattern and a
+ *                byte blend selecting the pixels.
+ *   INPUTS: dst, bits, n, src, add -- as for glyph_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the pixels of dst whose bits are set
+ */
+static void __attribute__ ((target ("avx2")))
+glyph_avx2 (unsigned char* dst, const unsigned char* bits, int n,
+	    const unsigned char* src, int add)
+{
+    const __m256i sel = _mm256_setr_epi8 (
+	0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+	0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m256i bcast = _mm256_setr_epi8 (
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i inc = _mm256_set1_epi8 ((char)add);
+    __m256i m, v; /* pixel mask and pixel values */
+
+    for (; n >= 4; n -= 4, bits += 4, dst += 32, src += 32) {
+	m = _mm256_set1_epi32 (bits[0] | (bits[1] << 8) | (bits[2] << 16) |
+			       ((unsigned int)bits[3] << 24));
+	m = _mm256_shuffle_epi8 (m, bcast);
+	m = _mm256_cmpeq_epi8 (_mm256_and_si256 (m, sel), sel);
+	v = _mm256_add_epi8 (_mm256_loadu_si256 ((const __m256i*)src), inc);
+	v = _mm256_blendv_epi8 (_mm256_loadu_si256 ((const __m256i*)dst),
+				v, m);
+	_mm256_storeu_si256 ((__m256i*)dst, v);
+    }
+    glyph_sse2 (dst, bits, n, src, add);
+}
+
+
+/*
+ * blend_sse2
+ *   DESCRIPTION: Select between two images by a mask, 16 pixels at a
+ *                time, using compare and logical operations.
+ *   INPUTS: dst, mask, fg, bg, len -- as for blend_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void __attribute__ ((target ("sse2")))
+blend_sse2 (unsigned char* dst, const unsigned char* mask,
+	    const unsigned char* fg, const unsigned char* bg, int len)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i m; /* all ones where the background shows */
+
+    for (; len >= 16; len -= 16, dst += 16, mask += 16, fg += 16, bg += 16) {
+	m = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i*)mask), zero);
+	_mm_storeu_si128 ((__m128i*)dst, _mm_or_si128 (
+	    _mm_and_si128 (m, _mm_loadu_si128 ((const __m128i*)bg)),
+	    _mm_andnot_si128 (m, _mm_loadu_si128 ((const __m128i*)fg))));
+    }
+    blend_scalar (dst, mask, fg, bg, len);
+}
+
+
+/*
+ * blend_avx2
+ *   DESCRIPTION: Select between two images by a mask, 32 pixels at a
+ *                time, using a byte blend.
+ *   INPUTS: dst, mask, fg, bg, len -- as for blend_scalar
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes len bytes at dst
+ */
+static void __attribute__ ((target ("avx2")))
+blend_avx2 (unsigned char* dst, const unsigned char* mask,
+	    const unsigned char* fg, const unsigned char* bg, int len)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    __m256i m; /* all ones where the background shows */
+
+    for (; len >= 32; len -= 32, dst += 32, mask += 32, fg += 32, bg += 32) {
+	m = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i*)mask), zero);
+	_mm256_storeu_si256 ((__m256i*)dst, _mm256_blendv_epi8 (
+	    _mm256_loadu_si256 ((const __m256i*)fg),
+	    _mm256_loadu_si256 ((const __m256i*)bg), m));
+    }
+    blend_sse2 (dst, mask, fg, bg, len);
+}
+
+#else /* !KERNELS_SIMD */
+
+/*
+ * detect_isa
+ *   DESCRIPTION: Find the highest instruction set level usable by this
+ *                build, which has no vector kernels.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: ISA_SCALAR
+ *   SIDE EFFECTS: none
+ */
+static isa_t
+detect_isa ()
+{
+    return ISA_SCALAR;
+}
+
+#endif /* KERNELS_SIMD */
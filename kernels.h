@@ -0,0 +1,88 @@
+/*									tab:8
+ *
+ * kernels.h - pixel kernels with run-time instruction set dispatch
+ *
+ * Filename:	    kernels.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Generalized copy kernel selection into a dispatch table
+ *		for all pixel kernels.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+
+/*
+ * Instruction set levels, in increasing order.  Every level includes
+ * all lower levels, so a kernel written for level L runs on any CPU
+ * that supports a level >= L.
+ */
+typedef enum {
+    ISA_SCALAR, ISA_SSE2, ISA_SSSE3, ISA_AVX2,
+    NUM_ISA_LEVELS
+} isa_t;
+
+/*
+ * Kernel signatures.  Lengths are in pixels (bytes) and may take any
+ * value, including zero; pointers need no particular alignment.
+ *
+ * copy  -- copy len bytes from src to dst (regions must not overlap);
+ *          used for uploads to video memory
+ * split -- scatter a line of len pixels into mode X planes: pixel i has
+ *          logical column x = phase + i, and is written to
+ *          plane0[(x & 3) * stride + (x >> 2)]; stride may be negative
+ *          (the build buffer stores plane 3 first)
+ * merge -- the inverse of split: gather len pixels from the planes
+ * glyph -- draw one row of n font characters: bit (7 - j) of bits[c]
+ *          controls pixel 8c + j, which is set to src[8c + j] + add
+ *          where the bit is set and left alone elsewhere
+ * blend -- dst[i] = (mask[i] != 0 ? fg[i] : bg[i]) for len pixels
+ */
+typedef void (*copy_fn_t) (unsigned char* dst, const unsigned char* src,
+			   int len);
+typedef void (*split_fn_t) (unsigned char* plane0, int stride,
+			    const unsigned char* src, int len, int phase);
+typedef void (*merge_fn_t) (unsigned char* dst, const unsigned char* plane0,
+			    int stride, int len, int phase);
+typedef void (*glyph_fn_t) (unsigned char* dst, const unsigned char* bits,
+			    int n, const unsigned char* src, int add);
+typedef void (*blend_fn_t) (unsigned char* dst, const unsigned char* mask,
+			    const unsigned char* fg, const unsigned char* bg,
+			    int len);
+
+/* the dispatch table; one entry per kernel */
+typedef struct {
+    copy_fn_t copy;
+    split_fn_t split;
+    merge_fn_t merge;
+    glyph_fn_t glyph;
+    blend_fn_t blend;
+} pixel_kernels_t;
+
+/*
+ * kernels in use; holds the scalar kernels (and REP MOVSB for copies)
+ * until init_pixel_kernels is called
+ */
+extern pixel_kernels_t kernels;
+
+/*
+ * Fill the dispatch table once at startup.  The level is the highest
+ * supported by the CPU unless the MAZEGAME_ISA environment variable
+ * names a lower one (scalar, sse2, ssse3, or avx2).  Copy kernels are
+ * also timed by writing len bytes from src to the scratch area dst
+ * (normally off-screen video memory), and the fastest is kept.  The
+ * choices are reported in one line on stderr.
+ */
+extern void init_pixel_kernels (unsigned char* dst, const unsigned char* src,
+				int len);
+
+/* instruction set level selected by init_pixel_kernels */
+extern isa_t kernel_isa ();
+
+/* printable name of an instruction set level */
+extern const char* isa_name (isa_t isa);
+
+#endif /* KERNELS_H */
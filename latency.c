@@ -0,0 +1,233 @@
+/*									tab:8
+ *
+ * latency.c - input-to-photon latency measurement for the maze game
+ *
+ * Filename:	    latency.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <pthread.h>
+
+#include "latency.h"
+#include "lockprof.h"
+
+
+/* read times kept per source; a power of two */
+#define INPUT_RING_SIZE 1024
+
+/* frames shown but not yet known to be on the monitor */
+#define MAX_FRAMES 8
+
+/* histogram buckets: bucket b counts latencies in [2^b, 2^(b+1)) usec */
+#define NUM_BUCKETS 24
+
+
+/* local functions--see function headers for details */
+static void record (input_source_t src, long long usec);
+
+
+/*
+ * Read times of consumed inputs, indexed by input number modulo the ring
+ * size.  Only the logic thread writes them, and it publishes each new
+ * count with a release store; the count reaches the render thread in a
+ * snapshot.  The flip hook reads a time and then the count again: if the
+ * logic thread has since come round the ring to that slot, the input is
+ * counted as lost rather than timed from whatever was written there.
+ */
+static long long input_usec[NUM_INPUT_SOURCES][INPUT_RING_SIZE];
+static unsigned int input_count[NUM_INPUT_SOURCES];
+
+/*
+ * Frames shown by the render thread, oldest first, with the marks of the
+ * state drawn; and the marks of the newest frame on the monitor.  These
+ * are shared by the render thread and the thread that flips, under
+ * frame_lock.
+ */
+static struct {
+    unsigned long frame;
+    unsigned int marks[NUM_INPUT_SOURCES];
+} frames[MAX_FRAMES];
+static int num_frames = 0;
+static unsigned int done[NUM_INPUT_SOURCES];
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* latency statistics, under frame_lock */
+static unsigned long hist[NUM_INPUT_SOURCES][NUM_BUCKETS];
+static unsigned long shown[NUM_INPUT_SOURCES];
+static unsigned long lost[NUM_INPUT_SOURCES];
+static long long total_usec[NUM_INPUT_SOURCES];
+static long long max_usec[NUM_INPUT_SOURCES];
+
+
+/*
+ * latency_input
+ *   DESCRIPTION: Number an input consumed by the logic thread.
+ *   INPUTS: src -- where the input came from
+ *           usec -- time the input was read (CLOCK_MONOTONIC)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+latency_input (input_source_t src, long long usec)
+{
+    unsigned int n = input_count[src];
+
+    __atomic_store_n (&input_usec[src][n & (INPUT_RING_SIZE - 1)], usec,
+		      __ATOMIC_RELAXED);
+    __atomic_store_n (&input_count[src], n + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * latency_marks
+ *   DESCRIPTION: Get the number of inputs consumed so far from each
+ *                source.  Called only by the logic thread.
+ *   INPUTS: none
+ *   OUTPUTS: marks -- the counts
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+latency_marks (unsigned int marks[NUM_INPUT_SOURCES])
+{
+    int i;
+
+    for (i = 0; i < NUM_INPUT_SOURCES; i++)
+	marks[i] = input_count[i];
+}
+
+
+/*
+ * latency_frame
+ *   DESCRIPTION: Note that a frame showing the inputs up to the given
+ *                marks has been handed to the display.  If too many
+ *                frames are waiting, the newest waiting frame is taken
+ *                to be this one, which only lengthens its latencies.
+ *   INPUTS: frame -- number returned by show_screen
+ *           marks -- marks of the snapshot drawn
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+latency_frame (unsigned long frame, const unsigned int marks[NUM_INPUT_SOURCES])
+{
+    LOCK_SITE (site, "latency_frame");
+    int i;
+
+    (void)site_lock (&frame_lock, &site);
+    if (num_frames == MAX_FRAMES)
+	num_frames--;
+    frames[num_frames].frame = frame;
+    for (i = 0; i < NUM_INPUT_SOURCES; i++)
+	frames[num_frames].marks[i] = marks[i];
+    num_frames++;
+    site_unlock (&frame_lock, &site);
+}
+
+
+/*
+ * latency_on_screen
+ *   DESCRIPTION: Flip hook: record the latency of every input shown by
+ *                the frame (or by an earlier frame not reported).
+ *   INPUTS: frame -- number of the frame on the monitor
+ *           usec -- time from which it is on the monitor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the histograms
+ */
+void
+latency_on_screen (unsigned long frame, long long usec)
+{
+    LOCK_SITE (site, "latency_on_screen");
+    int src, n, i;
+    unsigned int in, newest;
+    long long read_usec;
+
+    (void)site_lock (&frame_lock, &site);
+    for (n = 0; n < num_frames && frames[n].frame <= frame; n++);
+    if (n > 0) {
+	for (src = 0; src < NUM_INPUT_SOURCES; src++) {
+	    for (in = done[src]; in != frames[n - 1].marks[src]; in++) {
+		/* Read the time first; the reload of the count after
+		   the fence then shows whether the slot was reused. */
+		read_usec = __atomic_load_n
+		    (&input_usec[src][in & (INPUT_RING_SIZE - 1)],
+		     __ATOMIC_RELAXED);
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+		newest = __atomic_load_n (&input_count[src], __ATOMIC_ACQUIRE);
+		if (newest - in >= INPUT_RING_SIZE)
+		    lost[src]++;
+		else
+		    record (src, usec - read_usec);
+	    }
+	    done[src] = in;
+	}
+	for (i = n; i < num_frames; i++)
+	    frames[i - n] = frames[i];
+	num_frames -= n;
+    }
+    site_unlock (&frame_lock, &site);
+}
+
+
+/*
+ * record
+ *   DESCRIPTION: Add one latency to the statistics of a source.  Called
+ *                with frame_lock held.
+ *   INPUTS: src -- the source
+ *           usec -- the latency
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the histograms
+ */
+static void
+record (input_source_t src, long long usec)
+{
+    int b;
+
+    if (usec < 0)
+	usec = 0;
+    for (b = 0; b < NUM_BUCKETS - 1 && (usec >> (b + 1)) != 0; b++);
+    hist[src][b]++;
+    shown[src]++;
+    total_usec[src] += usec;
+    if (usec > max_usec[src])
+	max_usec[src] = usec;
+}
+
+
+/*
+ * latency_report
+ *   DESCRIPTION: Print, for each source with inputs shown, the number of
+ *                inputs, the mean and maximum latency, and a histogram
+ *                with power-of-two buckets.
+ *   INPUTS: f -- where to print
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to f
+ */
+void
+latency_report (FILE* f)
+{
+    int src, b, lo, hi;
+
+    (void)pthread_mutex_lock (&frame_lock);
+    for (src = 0; src < NUM_INPUT_SOURCES; src++) {
+	if (shown[src] == 0 && lost[src] == 0)
+	    continue;
+	fprintf (f, "input-to-photon %s: %lu inputs, mean %lld us, "
+		 "max %lld us, %lu lost\n", input_source_names[src], shown[src],
+		 (shown[src] ? total_usec[src] / shown[src] : 0),
+		 max_usec[src], lost[src]);
+	for (lo = 0; lo < NUM_BUCKETS && hist[src][lo] == 0; lo++);
+	for (hi = NUM_BUCKETS; hi > lo && hist[src][hi - 1] == 0; hi--);
+	for (b = lo; b < hi; b++)
+	    fprintf (f, "  %8ld-%8ld us: %lu\n", (b == 0 ? 0L : 1L << b),
+		     (1L << (b + 1)) - 1, hist[src][b]);
+    }
+    (void)pthread_mutex_unlock (&frame_lock);
+}
@@ -0,0 +1,47 @@
+/*									tab:8
+ *
+ * latency.h - input-to-photon latency measurement for the maze game
+ *
+ * Filename:	    latency.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+
+#include <stdio.h>
+
+#include "reactor.h"
+
+
+/*
+ * An input is followed from the time it was read (the timestamp of its
+ * command) to the time the first frame drawn from a game state that
+ * includes it is known to be on the monitor.  The logic thread numbers
+ * the inputs of each source as it consumes them, and each snapshot it
+ * publishes carries the counts so far (the marks).  The render thread
+ * passes the marks of each frame it shows to latency_frame, and the
+ * display calls latency_on_screen (through set_flip_hook) once a frame
+ * is on the monitor; every input up to that frame's marks is then done.
+ */
+
+/* called by the logic thread as it consumes an input read at usec */
+extern void latency_input (input_source_t src, long long usec);
+
+/* called by the logic thread to get the marks for a snapshot */
+extern void latency_marks (unsigned int marks[NUM_INPUT_SOURCES]);
+
+/* called by the render thread after show_screen returns frame */
+extern void latency_frame (unsigned long frame,
+			   const unsigned int marks[NUM_INPUT_SOURCES]);
+
+/* flip hook: frame is on the monitor as of usec */
+extern void latency_on_screen (unsigned long frame, long long usec);
+
+/* print a latency histogram for each source that had inputs shown */
+extern void latency_report (FILE* f);
+
+#endif /* LATENCY_H */
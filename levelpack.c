@@ -0,0 +1,364 @@
+/*									tab:8
+ *
+ * levelpack.c - files of saved maze game levels
+ *
+ * Filename:	    levelpack.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "levelpack.h"
+
+
+/* a pack being written */
+struct pack_writer {
+    FILE* f;
+    char* path;                  /* removed if the pack fails   */
+    int n_levels, n_added;       /* levels to write, and so far */
+    pack_level_t* dir;           /* the directory, kept here    */
+    uint64_t size;               /* bytes written so far        */
+    int failed;                  /* 1 once a write has failed   */
+};
+
+
+/* local functions--see function headers for details */
+static int check_pack_level (const level_pack_t* pack,
+			     const pack_level_t* lev);
+static void write_pack (pack_writer_t* w, const void* buf, size_t len);
+
+
+/* the directory of a pack, which follows its header */
+#define PACK_DIR(pack) ((const pack_level_t*)((pack) + 1))
+
+/* 
+ * Packs are read by mapping them and written from memory as they are, so
+ * only a little-endian host can use them.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#define PACK_HOST_OK 0
+#else
+#define PACK_HOST_OK 1
+#endif
+
+
+/*
+ * open_level_pack
+ *   DESCRIPTION: Map a level pack, read-only, and check that its header,
+ *                directory, and the walls and fruits of each level lie
+ *                within the file.  The mazes themselves are checked as
+ *                they are loaded.
+ *   INPUTS: path -- the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pack, or NULL on failure (or on a big-endian host)
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+const level_pack_t*
+open_level_pack (const char* path)
+{
+    const level_pack_t* pack;
+    struct stat st;
+    void* map;
+    int fd;
+    uint32_t i;
+
+    if (!PACK_HOST_OK) {
+	fprintf (stderr, "%s: level packs need a little-endian host\n", path);
+	return NULL;
+    }
+    if ((fd = open (path, O_RDONLY)) == -1 || fstat (fd, &st) != 0) {
+	perror (path);
+	if (fd != -1)
+	    (void)close (fd);
+	return NULL;
+    }
+    if (st.st_size < (off_t)sizeof (level_pack_t)) {
+	fprintf (stderr, "%s: not a level pack\n", path);
+	(void)close (fd);
+	return NULL;
+    }
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close (fd);
+    if (map == MAP_FAILED) {
+	perror (path);
+	return NULL;
+    }
+
+    pack = map;
+    if (pack->magic != LEVEL_PACK_MAGIC ||
+	pack->size != (uint64_t)st.st_size) {
+	fprintf (stderr, "%s: not a level pack\n", path);
+    } else if (pack->version != LEVEL_PACK_VERSION) {
+	fprintf (stderr, "%s: level pack version %u, not %d\n", path,
+		 pack->version, LEVEL_PACK_VERSION);
+    } else if (pack->n_levels > (pack->size - sizeof (level_pack_t)) /
+				sizeof (pack_level_t)) {
+	fprintf (stderr, "%s: level pack directory is cut short\n", path);
+    } else {
+	for (i = 0; i < pack->n_levels; i++)
+	    if (check_pack_level (pack, &PACK_DIR (pack)[i]) != 0)
+		break;
+	if (i == pack->n_levels)
+	    return pack;
+	fprintf (stderr, "%s: level %u of the level pack is damaged\n",
+		 path, i + 1);
+    }
+    (void)munmap (map, st.st_size);
+    return NULL;
+}
+
+
+/*
+ * check_pack_level
+ *   DESCRIPTION: Check that the walls and fruits of a level of a pack lie
+ *                within it, aligned, and that the walls are as long as a
+ *                maze of the level's size needs.
+ *   INPUTS: pack -- the pack, its header checked
+ *           lev -- the level
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the level is good, -1 if not
+ *   SIDE EFFECTS: none
+ */
+static int
+check_pack_level (const level_pack_t* pack, const pack_level_t* lev)
+{
+    if (lev->x_dim > MAZE_LIMIT_DIM || lev->y_dim > MAZE_LIMIT_DIM ||
+	lev->n_fruits > lev->x_dim * lev->y_dim ||
+	lev->wall_words != maze_wall_words (lev->x_dim, lev->y_dim))
+	return -1;
+    if ((lev->walls & 7) != 0 || lev->walls > pack->size ||
+	lev->wall_words > (pack->size - lev->walls) / sizeof (uint64_t))
+	return -1;
+    if ((lev->fruits & 3) != 0 || lev->fruits > pack->size ||
+	lev->n_fruits > (pack->size - lev->fruits) / sizeof (maze_fruit_t))
+	return -1;
+    return 0;
+}
+
+
+/*
+ * close_level_pack
+ *   DESCRIPTION: Unmap a level pack.  No maze loaded from it may still be
+ *                used.
+ *   INPUTS: pack -- the pack
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+close_level_pack (const level_pack_t* pack)
+{
+    (void)munmap ((void*)pack, pack->size);
+}
+
+
+/*
+ * find_pack_level
+ *   DESCRIPTION: Find a level in a pack by its number.
+ *   INPUTS: pack -- the pack
+ *           number -- the level number
+ *   OUTPUTS: none
+ *   RETURN VALUE: the level, or NULL if the pack has none of that number
+ *   SIDE EFFECTS: none
+ */
+const pack_level_t*
+find_pack_level (const level_pack_t* pack, int number)
+{
+    uint32_t i;
+
+    for (i = 0; i < pack->n_levels; i++)
+	if (PACK_DIR (pack)[i].number == (uint32_t)number)
+	    return &PACK_DIR (pack)[i];
+    return NULL;
+}
+
+
+/*
+ * load_pack_level
+ *   DESCRIPTION: Put the maze of a level of a pack in a maze context (see
+ *                load_maze), using its walls where the pack is mapped.
+ *                The pack must stay open while the maze is used.
+ *   INPUTS: m -- the maze context
+ *           pack -- the pack
+ *           lev -- the level, from find_pack_level
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: reallocates the arrays of m
+ */
+int
+load_pack_level (maze_ctx_t* m, const level_pack_t* pack,
+		 const pack_level_t* lev)
+{
+    const char* base = (const char*)pack;
+    maze_saved_t s;
+
+    s.x_dim = lev->x_dim;
+    s.y_dim = lev->y_dim;
+    s.exit_x = lev->exit_x;
+    s.exit_y = lev->exit_y;
+    s.seed = lev->seed;
+    s.walls = (const uint64_t*)(base + lev->walls);
+    s.wall_words = lev->wall_words;
+    s.fruits = (const maze_fruit_t*)(base + lev->fruits);
+    s.n_fruits = lev->n_fruits;
+    return load_maze (m, &s);
+}
+
+
+/*
+ * start_level_pack
+ *   DESCRIPTION: Create a level pack file to be filled with add_pack_level
+ *                and finished with finish_level_pack.  Room is left for
+ *                the header and directory, which are written last.
+ *   INPUTS: path -- the file
+ *           n_levels -- the number of levels it will hold
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pack being written, or NULL on failure (or on a
+ *                 big-endian host)
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+pack_writer_t*
+start_level_pack (const char* path, int n_levels)
+{
+    pack_writer_t* w;
+
+    if (!PACK_HOST_OK) {
+	fprintf (stderr, "%s: level packs need a little-endian host\n", path);
+	return NULL;
+    }
+    if ((w = calloc (1, sizeof (*w))) == NULL ||
+	(w->dir = calloc (n_levels, sizeof (w->dir[0]))) == NULL ||
+	(w->path = strdup (path)) == NULL) {
+	fprintf (stderr, "%s: out of memory\n", path);
+	if (w != NULL)
+	    free (w->dir);
+	free (w);
+	return NULL;
+    }
+    if ((w->f = fopen (path, "wb")) == NULL) {
+	perror (path);
+	free (w->dir);
+	free (w->path);
+	free (w);
+	return NULL;
+    }
+    w->n_levels = n_levels;
+    w->size = sizeof (level_pack_t) + n_levels * sizeof (pack_level_t);
+    if (fseek (w->f, w->size, SEEK_SET) != 0)
+	w->failed = 1;
+    return w;
+}
+
+
+/*
+ * write_pack
+ *   DESCRIPTION: Append bytes to a pack being written, padded with zeros
+ *                to a whole number of 64-bit words.
+ *   INPUTS: w -- the pack
+ *           buf -- the bytes
+ *           len -- the number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: marks the pack failed if the write fails
+ */
+static void
+write_pack (pack_writer_t* w, const void* buf, size_t len)
+{
+    static const char zeros[8];
+    size_t pad = (8 - (len & 7)) & 7;
+
+    if (w->failed)
+	return;
+    if ((len > 0 && fwrite (buf, len, 1, w->f) != 1) ||
+	(pad > 0 && fwrite (zeros, pad, 1, w->f) != 1))
+	w->failed = 1;
+    w->size += len + pad;
+}
+
+
+/*
+ * add_pack_level
+ *   DESCRIPTION: Add the next level to a pack being written: the level's
+ *                parameters, and the walls, fruits, exit and seed of its
+ *                maze.
+ *   INPUTS: w -- the pack
+ *           lev -- the level's number and parameters (number through
+ *                  tick_usec; the rest is ignored)
+ *           m -- the maze context holding the level's (finite) maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: marks the pack failed on failure
+ */
+int
+add_pack_level (pack_writer_t* w, const pack_level_t* lev, maze_ctx_t* m)
+{
+    pack_level_t* d;
+    maze_saved_t s;
+
+    if (w->failed || w->n_added == w->n_levels || save_maze (m, &s) != 0) {
+	w->failed = 1;
+	return -1;
+    }
+    d = &w->dir[w->n_added++];
+    *d = *lev;
+    d->x_dim = s.x_dim;
+    d->y_dim = s.y_dim;
+    d->exit_x = s.exit_x;
+    d->exit_y = s.exit_y;
+    d->n_fruits = s.n_fruits;
+    d->seed = s.seed;
+    d->walls = w->size;
+    d->wall_words = s.wall_words;
+    write_pack (w, s.walls, s.wall_words * sizeof (uint64_t));
+    d->fruits = w->size;
+    write_pack (w, s.fruits, s.n_fruits * sizeof (maze_fruit_t));
+    free ((void*)s.fruits);
+    return (w->failed ? -1 : 0);
+}
+
+
+/*
+ * finish_level_pack
+ *   DESCRIPTION: Write the header and directory of a pack and close it,
+ *                or remove it if it could not be written whole.
+ *   INPUTS: w -- the pack, which is freed
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+int
+finish_level_pack (pack_writer_t* w)
+{
+    level_pack_t hdr;
+    int failed = w->failed || w->n_added != w->n_levels;
+
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.magic = LEVEL_PACK_MAGIC;
+    hdr.version = LEVEL_PACK_VERSION;
+    hdr.n_levels = w->n_levels;
+    hdr.size = w->size;
+    if (!failed &&
+	(fseek (w->f, 0, SEEK_SET) != 0 ||
+	 fwrite (&hdr, sizeof (hdr), 1, w->f) != 1 ||
+	 fwrite (w->dir, sizeof (w->dir[0]), w->n_levels, w->f) !=
+	 (size_t)w->n_levels))
+	failed = 1;
+    if (fclose (w->f) != 0)
+	failed = 1;
+    if (failed) {
+	fprintf (stderr, "%s: level pack not written\n", w->path);
+	(void)unlink (w->path);
+    }
+    free (w->dir);
+    free (w->path);
+    free (w);
+    return (failed ? -1 : 0);
+}
@@ -0,0 +1,86 @@
+/*									tab:8
+ *
+ * levelpack.h - files of saved maze game levels
+ *
+ * Filename:	    levelpack.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef LEVELPACK_H
+#define LEVELPACK_H
+
+
+#include <stdint.h>
+
+#include "maze.h"
+
+
+/*
+ * A level pack holds the mazes of a run of levels, with the parameters
+ * of each level, so that a game can play the same levels every time.
+ * The file is a header, a directory of the levels, and then the walls
+ * and fruits of each level in turn.  Every part is a whole number of
+ * 64-bit words, and every field is little-endian with a fixed width, so
+ * that a pack is read by mapping the file: the game plays each maze from
+ * its walls where they are mapped, and nothing is copied or parsed.
+ * Offsets are in bytes from the start of the file.  As nothing is
+ * converted, packs are opened and written only on little-endian hosts.
+ */
+#define LEVEL_PACK_MAGIC   0x4D5A4C5041434B31ULL  /* "MZLPACK1" */
+#define LEVEL_PACK_VERSION 1
+
+typedef struct {
+    uint64_t magic;               /* LEVEL_PACK_MAGIC                      */
+    uint32_t version;             /* LEVEL_PACK_VERSION                    */
+    uint32_t n_levels;            /* levels in the directory that follows  */
+    uint64_t size;                /* bytes in the file                     */
+} level_pack_t;
+
+typedef struct {
+    uint32_t number;              /* level number, from 1                  */
+    uint32_t x_dim, y_dim;        /* size of the maze, in squares          */
+    uint32_t initial_fruit_count; /* parameters of the level, as in the    */
+    uint32_t time_to_first_fruit; /*   game's game_info_t                  */
+    uint32_t time_between_fruits;
+    uint32_t tick_usec;
+    uint32_t exit_x, exit_y;      /* lattice point of the exit             */
+    uint32_t n_fruits;            /* fruits in the maze at the start       */
+    uint64_t seed;                /* seed the maze was made from           */
+    uint64_t walls;               /* offset of the walls (see maze_saved_t) */
+    uint64_t wall_words;          /*   and their length in 64-bit words    */
+    uint64_t fruits;              /* offset of the fruits (maze_fruit_t)   */
+} pack_level_t;
+
+/* a pack being written */
+typedef struct pack_writer pack_writer_t;
+
+/* map a level pack and check it; returns NULL on failure */
+extern const level_pack_t* open_level_pack (const char* path);
+
+/* unmap a level pack */
+extern void close_level_pack (const level_pack_t* pack);
+
+/* find a level in a pack by number; returns NULL if it has none */
+extern const pack_level_t* find_pack_level (const level_pack_t* pack,
+					    int number);
+
+/* put the maze of a level of a pack in a maze context */
+extern int load_pack_level (maze_ctx_t* m, const level_pack_t* pack,
+			    const pack_level_t* lev);
+
+/* start writing a pack of a number of levels; returns NULL on failure */
+extern pack_writer_t* start_level_pack (const char* path, int n_levels);
+
+/*
+ * add a level to a pack, with the parameters in lev (number through
+ * tick_usec) and the maze of a context; returns 0 on success
+ */
+extern int add_pack_level (pack_writer_t* w, const pack_level_t* lev,
+			   maze_ctx_t* m);
+
+/* finish writing a pack (abandoning it if it failed); returns 0 on success */
+extern int finish_level_pack (pack_writer_t* w);
+
+#endif /* LEVELPACK_H */
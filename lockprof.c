@@ -0,0 +1,202 @@
+/*									tab:8
+ *
+ * lockprof.c - lock wait and hold time profiling
+ *
+ * Filename:	    lockprof.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include "lockprof.h"
+
+#if LOCK_PROFILE
+
+#include <time.h>
+
+
+/* local functions--see function headers for details */
+static long long now_ns ();
+static void add_time (unsigned long hist[LOCK_BUCKETS], long long* total,
+		      long long* max, long long ns);
+static void print_hist (FILE* f, const char* what,
+			const unsigned long hist[LOCK_BUCKETS]);
+
+
+/* every site used so far, newest first */
+static lock_site_t* sites = NULL;
+
+
+/*
+ * site_lock
+ *   DESCRIPTION: Take a lock, recording how long it took.
+ *   INPUTS: m -- the lock
+ *           site -- the call site
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the lock was busy, 0 if not
+ *   SIDE EFFECTS: adds the site to the list of sites on first use
+ */
+int
+site_lock (pthread_mutex_t* m, lock_site_t* site)
+{
+    long long start;
+    int busy = 0;
+
+    start = now_ns ();
+    if (pthread_mutex_trylock (m) != 0) {
+	(void)pthread_mutex_lock (m);
+	busy = 1;
+    }
+    site->since = now_ns ();
+
+    /* The lock is held, so only this thread touches the site. */
+    if (!site->registered) {
+	site->registered = 1;
+	site->next = __atomic_load_n (&sites, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n (&sites, &site->next, site, 0,
+					     __ATOMIC_RELEASE,
+					     __ATOMIC_ACQUIRE));
+    }
+    site->acquires++;
+    site->contended += busy;
+    add_time (site->wait_hist, &site->wait_ns, &site->max_wait_ns,
+	      site->since - start);
+    return busy;
+}
+
+
+/*
+ * site_unlock
+ *   DESCRIPTION: Release a lock, recording how long it was held.
+ *   INPUTS: m -- the lock
+ *           site -- the call site that took it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+site_unlock (pthread_mutex_t* m, lock_site_t* site)
+{
+    add_time (site->hold_hist, &site->hold_ns, &site->max_hold_ns,
+	      now_ns () - site->since);
+    (void)pthread_mutex_unlock (m);
+}
+
+
+/*
+ * site_cond_wait
+ *   DESCRIPTION: Wait on a condition variable.  The lock is not held
+ *                while waiting, so the hold time so far is recorded, and
+ *                a new hold starts once the wait ends.
+ *   INPUTS: cv -- the condition variable
+ *           m -- the lock, which is held
+ *           site -- the call site that took it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+site_cond_wait (pthread_cond_t* cv, pthread_mutex_t* m, lock_site_t* site)
+{
+    add_time (site->hold_hist, &site->hold_ns, &site->max_hold_ns,
+	      now_ns () - site->since);
+    (void)pthread_cond_wait (cv, m);
+    site->since = now_ns ();
+}
+
+
+/*
+ * report_locks
+ *   DESCRIPTION: Print, for each site, the number of acquisitions and
+ *                how many found the lock busy, the mean and maximum wait
+ *                and hold times, and histograms of both.  Called once
+ *                no thread is using the locks.
+ *   INPUTS: f -- where to print
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to f
+ */
+void
+report_locks (FILE* f)
+{
+    lock_site_t* s;
+
+    for (s = __atomic_load_n (&sites, __ATOMIC_ACQUIRE); s != NULL;
+	 s = s->next) {
+	fprintf (f, "lock %s: %lu acquires, %lu contended; wait mean %lld ns, "
+		 "max %lld ns; hold mean %lld ns, max %lld ns\n", s->name,
+		 s->acquires, s->contended, s->wait_ns / s->acquires,
+		 s->max_wait_ns, s->hold_ns / s->acquires, s->max_hold_ns);
+	print_hist (f, "wait", s->wait_hist);
+	print_hist (f, "hold", s->hold_hist);
+    }
+}
+
+
+/*
+ * add_time
+ *   DESCRIPTION: Add a time to a histogram, total, and maximum.
+ *   INPUTS: ns -- the time
+ *   OUTPUTS: hist, total, max -- updated
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+add_time (unsigned long hist[LOCK_BUCKETS], long long* total, long long* max,
+	  long long ns)
+{
+    int b;
+
+    if (ns < 0)
+	ns = 0;
+    for (b = 0; b < LOCK_BUCKETS - 1 && (ns >> (b + 1)) != 0; b++);
+    hist[b]++;
+    *total += ns;
+    if (ns > *max)
+	*max = ns;
+}
+
+
+/*
+ * print_hist
+ *   DESCRIPTION: Print the non-empty range of a histogram on one line,
+ *                each bucket as its lower bound and count.
+ *   INPUTS: f -- where to print
+ *           what -- label for the line
+ *           hist -- the histogram
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to f
+ */
+static void
+print_hist (FILE* f, const char* what, const unsigned long hist[LOCK_BUCKETS])
+{
+    int lo, hi, b;
+
+    for (lo = 0; lo < LOCK_BUCKETS && hist[lo] == 0; lo++);
+    for (hi = LOCK_BUCKETS; hi > lo && hist[hi - 1] == 0; hi--);
+    fprintf (f, "  %s:", what);
+    for (b = lo; b < hi; b++)
+	fprintf (f, " %lldns:%lu", (b == 0 ? 0LL : 1LL << b), hist[b]);
+    fprintf (f, "\n");
+}
+
+
+/*
+ * now_ns
+ *   DESCRIPTION: Read the monotonic clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static long long
+now_ns ()
+{
+    struct timespec ts; /* current time */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#endif /* LOCK_PROFILE */
@@ -0,0 +1,87 @@
+/*									tab:8
+ *
+ * lockprof.h - lock wait and hold time profiling
+ *
+ * Filename:	    lockprof.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+
+#include <pthread.h>
+#include <stdio.h>
+
+
+/*
+ * Locks are taken through site_lock and released through site_unlock,
+ * naming a call site declared with LOCK_SITE; a condition variable wait
+ * goes through site_cond_wait.  Each site belongs to one mutex, and is
+ * written only by the thread holding it.
+ *
+ * Building with LOCK_PROFILE defined as 1 records, for each site, how
+ * long each acquisition waited for the lock and how long the lock was
+ * then held (excluding condition variable waits), in histograms that
+ * report_locks prints.  Otherwise the calls are plain mutex operations,
+ * and site_lock only tells whether the lock was busy.
+ */
+#if !defined(LOCK_PROFILE)
+#define LOCK_PROFILE 0
+#endif
+
+#define LOCK_BUCKETS 32  /* bucket b counts times in [2^b, 2^(b+1)) ns */
+
+typedef struct lock_site {
+    const char* name;
+#if LOCK_PROFILE
+    unsigned long acquires;              /* times the lock was taken      */
+    unsigned long contended;             /* ...after finding it busy      */
+    unsigned long wait_hist[LOCK_BUCKETS];
+    unsigned long hold_hist[LOCK_BUCKETS];
+    long long wait_ns, hold_ns;          /* totals                        */
+    long long max_wait_ns, max_hold_ns;
+    long long since;                     /* time the lock was last taken  */
+    int registered;                      /* on the list of sites          */
+    struct lock_site* next;              /* list of sites, for the report */
+#endif
+} lock_site_t;
+
+/* declare a call site */
+#define LOCK_SITE(var,name) static lock_site_t var = {name}
+
+#if LOCK_PROFILE
+
+/* take the lock; returns 1 if it was busy, 0 if not */
+extern int site_lock (pthread_mutex_t* m, lock_site_t* site);
+
+/* release the lock */
+extern void site_unlock (pthread_mutex_t* m, lock_site_t* site);
+
+/* wait on a condition variable with the lock held */
+extern void site_cond_wait (pthread_cond_t* cv, pthread_mutex_t* m,
+			    lock_site_t* site);
+
+/* print the statistics of every site used */
+extern void report_locks (FILE* f);
+
+#else /* !LOCK_PROFILE */
+
+static inline int
+site_lock (pthread_mutex_t* m, lock_site_t* site)
+{
+    if (pthread_mutex_trylock (m) == 0)
+	return 0;
+    (void)pthread_mutex_lock (m);
+    return 1;
+}
+
+#define site_unlock(m,site)       (void)pthread_mutex_unlock (m)
+#define site_cond_wait(cv,m,site) (void)pthread_cond_wait ((cv), (m))
+#define report_locks(f)           do { } while (0)
+
+#endif /* LOCK_PROFILE */
+
+#endif /* LOCKPROF_H */
@@ -35,6 +35,8 @@
  *		Integrated Nate Taylor's "god mode."
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,23 +47,55 @@
 #include "input.h"
 #include "maze.h"
 #include "modex.h"
+#include "rng.h"
 
 
 /* Set to 1 to test maze generation routines. */
 #define TEST_MAZE_GEN 0
 
 
-/* Set to 1 to remove all walls as a debugging aid. (Nate Taylor, S07). */
+/* 
+ * Set to 1 to remove all walls as a debugging aid. (Nate Taylor, S07).
+ * Tools that study the mazes made build with -DGOD_MODE=0.
+ */
+#if !defined(GOD_MODE)
 #define GOD_MODE 1
+#endif
+
+
+/* a band of rows of a maze, made on a thread of its own; see below */
+typedef struct maze_band maze_band_t;
 
 
 /* local functions--see function headers for details */
-static int mark_maze_area (int x, int y);
-static void add_a_fruit_internal ();
+static int find_region (maze_ctx_t* m, int p);
+static int join_regions (maze_ctx_t* m, int p, int q);
+static int count_bands (int x_dim, int y_dim);
+static void run_bands (maze_band_t* band, int n_bands, void* (*fn) (void*));
+static void* dig_band (void* arg);
+static void* join_band (void* arg);
+static int alloc_maze_bits (maze_ctx_t* m, int x_dim, int rows);
+static void sync_maze_bits (maze_ctx_t* m, int y0, int y1);
+static int count_bits (maze_ctx_t* m, int plane, int x0, int x1, int y);
+static int alloc_free_squares (maze_ctx_t* m, size_t squares, int listed);
+static void list_free_squares (maze_ctx_t* m, int y0, int y1);
+static void free_square (maze_ctx_t* m, int x, int y);
+static void fill_square (maze_ctx_t* m, int x, int y);
+static int pick_free_square (maze_ctx_t* m, int* x, int* y);
+static int check_saved_walls (const maze_saved_t* s);
+static void extend_rows (maze_ctx_t* m, int y);
+static void make_maze_row (maze_ctx_t* m);
+static int eller_root (int* link, int s);
+static void add_a_fruit_internal (maze_ctx_t* m);
 #if (TEST_MAZE_GEN == 0) /* not used when testing maze generation */
-static unsigned char* find_block (int x, int y);
-static void _add_a_fruit (int show);
+static unsigned char* find_block (maze_ctx_t* m, int x, int y);
+static unsigned char* block_image (maze_ctx_t* m, int x, int y, int pattern);
+static void wall_stencil (maze_ctx_t* m, int w, int y, uint64_t st[4]);
+static void fill_horiz_line (maze_ctx_t* m, int x, int y,
+			     unsigned char buf[SCROLL_X_DIM]);
+static void _add_a_fruit (maze_ctx_t* m, int show);
 #endif
+static uint64_t new_seed ();
 
 
 /*
@@ -77,105 +111,1005 @@ static void _add_a_fruit (int show);
  * and the lower right boundary is at (2 X_DIM, 2 Y_DIM + 1).  The stencil
  * calculation for the lower right boundary includes the point below it,
  * which is (2 X_DIM, 2 Y_DIM + 2).  As the width of the maze is 2 X_DIM,
- * the index of this point is 2 X_DIM + (2 Y_DIM + 2) * 2 X_DIM, or
- * 2 X_DIM (2 Y_DIM + 3), and the space allocated is one larger than this
- * maximum index value.
+ * this point wraps around to (0, 2 Y_DIM + 3), so the array needs rows
+ * -1 to 2 Y_DIM + 3 of lattice points 0 to 2 X_DIM - 1.
+ *
+ * The array is allocated by make_maze for the size of the maze, and laid
+ * out in square tiles of MAZE_TILE lattice points on a side, each tile
+ * stored contiguously, with the tiles in rows.  Neighbouring points then
+ * usually share a cache line or two whatever the width of the maze, and
+ * the memory used grows only with the area of the maze.
+ *
+ * An endless maze (see make_endless_maze) is made a row at a time as the
+ * view moves down, and keeps only the newest MAZE_WINDOW_ROWS rows of
+ * lattice points: row y is stored where row y mod MAZE_WINDOW_ROWS would
+ * be, over the row that has scrolled furthest out of sight.  Rows from
+ * maze_top to maze_made - 2 can be drawn (the stencil needs one row on
+ * either side); a finite maze has all of its rows made.  The render
+ * thread reads the two bounds while the logic thread makes rows, so
+ * make_maze_row raises maze_top before it recycles rows, and stores
+ * maze_made once the new rows and their bitboards are written; both
+ * stores release, and the render thread loads them with MAZE_TOP and
+ * MAZE_MADE.
+ */
+#define MAZE_TILE_BITS 4
+#define MAZE_TILE      (1 << MAZE_TILE_BITS)
+#define MAZE_WINDOW_ROWS 256
+#define MAZE_TOP(m)  __atomic_load_n (&(m)->maze_top, __ATOMIC_ACQUIRE)
+#define MAZE_MADE(m) __atomic_load_n (&(m)->maze_made, __ATOMIC_ACQUIRE)
+
+/*
+ * The bitboards (see below) keep the same maze again, with for each of
+ * these properties (planes) a bit per lattice point.
+ */
+#define PLANE_WALL  0
+#define PLANE_REACH 1
+#define PLANE_FRUIT 2  /* any fruit; the maze array says which */
+#define PLANE_EXIT  3
+#define NUM_PLANES  4
+
+/*
+ * During play the render thread reads the bitboards, the flags of the
+ * maze array, and n_fruits, while the logic thread changes them
+ * (unveil_space, check_for_fruit, add_a_fruit, make_maze_row).  Only the
+ * logic thread writes them, so each access is a relaxed atomic load or
+ * store rather than a locked update; a square drawn in the middle of a
+ * change is drawn again from the dirty ring (see mazegame.c).
+ */
+#define SHARED_LOAD(p)    __atomic_load_n ((p), __ATOMIC_RELAXED)
+#define SHARED_STORE(p,v) __atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+
+/*
+ * A maze and everything known about it.  The game plays and draws the
+ * current maze (cur_maze), while another may be made at the same time by
+ * another thread, and then made current with use_maze.
+ */
+struct maze_ctx {
+    unsigned char* maze;
+    size_t maze_bytes;     /* space allocated for the maze */
+    int maze_tiles_x;      /* tiles in each row of tiles   */
+    int maze_row_mask;     /* window rows - 1, or -1 (all) */
+    int maze_made;         /* rows made: -1 to maze_made-1 */
+    int maze_top;          /* first row that may be drawn  */
+    int maze_x_dim;	   /* horizontal dimension of maze */
+    int maze_y_dim;	   /* vertical dimension of maze   */
+    int n_fruits;          /* number of fruits in maze     */
+    int exit_x, exit_y;    /* lattice point of maze exit   */
+    maze_stats_t stats;    /* how the maze was generated   */
+    uint64_t seed;         /* seed it was made from        */
+    rng_t rng;             /* random numbers for the maze  */
+
+    /*
+     * The bitboards: each row of lattice points of a plane is in
+     * maze_row_words 64-bit words (point x in bit x % 64 of word x / 64).
+     * Rows are numbered and wrap as in the maze array, but are not tiled.
+     * The functions that change the maze keep the two in step, and queries
+     * about whole rows or regions (the wall stencil, whether anything is
+     * unveiled) work on 64 points at once.  The planes are kept one after
+     * another in maze_bits, except that the walls of a maze loaded from a
+     * level pack (see load_maze) are used where the pack is mapped.
+     */
+    uint64_t* maze_plane[NUM_PLANES];
+    uint64_t* maze_bits;
+    size_t maze_bits_words; /* words allocated for the planes */
+    size_t maze_plane_words;/* words in each plane            */
+    int maze_row_words;     /* words in each row of a plane   */
+
+    /*
+     * Disjoint sets of (odd,odd) lattice points connected by open space,
+     * used by make_maze to join the regions dug by the worms, and
+     * allocated only while it runs.  Point (x,y) is numbered
+     * x / 2 + (y / 2) * maze_x_dim, and each set is a tree linked through
+     * region[] to a root, which links to itself.  Roots are linked to
+     * roots of lower number, with atomic operations, so that the bands of
+     * a large maze (see join_band) can join sets at the same time.  The
+     * walls between neighbouring points are numbered 2 p for the wall
+     * east of point p and 2 p + 1 for the wall south of it.
+     */
+    int* region;
+    int* walls;
+
+    /*
+     * Set state of an endless maze, kept only for its newest row of
+     * squares (Eller's algorithm): square i is in set eller_set[i], a
+     * number from 0 to maze_x_dim - 1.  Squares in the same set are joined
+     * by paths above.  The other arrays are scratch space for
+     * make_maze_row, indexed by set.
+     */
+    int* eller_set;
+    int* eller_count;
+    unsigned char* eller_down;
+
+    /*
+     * The squares that may take a new fruit: every (odd,odd) lattice
+     * point with no fruit in the maze, or in the rows of an endless maze
+     * that may be shown (from the first odd row at or below maze_top to
+     * maze_made - 2).  free_list[0] to free_list[n_free - 1] hold their
+     * numbers in no order, and free_pos[] holds the place of each square
+     * in the list, or -1, so a square is listed, unlisted (by moving the
+     * last one into its place), or picked at random in constant time.
+     * Point (x,y) is numbered x / 2 + (y / 2) * maze_x_dim, with y / 2
+     * taken modulo the rows of squares in the window of an endless maze.
+     */
+    int* free_list;
+    int* free_pos;
+    int n_free;
+    size_t free_squares;   /* squares allocated in each    */
+};
+
+/* the maze played, and the one it starts as */
+static maze_ctx_t first_maze;
+static maze_ctx_t* cur_maze = &first_maze;
+
+/* 
+ * worm turn weights; the first dimension is relative direction
+ * (number of 90-degree turns clockwise from up); the second is 
+ * whether the resulting space is open (not a wall) or a wall.
+ * Changed only by set_turn_weights, between mazes.
+ */
+static int turn_wt[4][2] = {{1, 84}, {1, 9}, {3, 3}, {1, 9}};
+
+/* largest turn weight accepted, which keeps a worm's total in an int */
+#define MAX_TURN_WT (1 << 20)
+
+/*
+ * A large maze is made in bands of rows of squares, each on a thread of
+ * its own (see make_maze).  Each band draws from a random number stream
+ * of its own, split from the maze's by jump_rng, and counts down the
+ * regions left to join in the whole maze as it joins them.  Each band
+ * takes whole cache lines, so that a thread drawing numbers does not
+ * write the line its neighbour reads.
+ */
+#define MAZE_PARALLEL_MIN  (1 << 18) /* squares in the smallest maze split */
+#define MAZE_BAND_MIN_ROWS 64        /* rows of squares in a band, at least */
+#define MAZE_MAX_BANDS     64
+
+struct maze_band {
+    maze_ctx_t* m;
+    int y0, y1;              /* rows of squares y0 to y1 - 1 */
+    rng_t rng;               /* the band's random numbers    */
+    int regions;             /* regions dug by the worms     */
+    int n_open, n_inner;     /* walls between its rows that  */
+			     /*   they left open, and all    */
+    int walls_removed;       /* walls knocked down in band   */
+    int* regions_left;       /* regions left in the maze     */
+    pthread_t tid;
+    int threaded;            /* 1 if run by its own thread   */
+} __attribute__ ((aligned (64)));
+
+/* threads used to make a large maze, or 0 for one per processor */
+static int maze_threads = 0;
+
+
+/* 
+ * maze array index calculation macro, for the maze m; maze dimensions are
+ * valid only after a call to make_maze
+ */
+#define MAZE_INDEX(a,b) maze_index (m, (a), (b))
+
+
+/* 
+ * maze_index
+ *   DESCRIPTION: Find a maze lattice point in the tiled maze array.  A
+ *                point one past either side of a row wraps around to the
+ *                next or previous row, as in an array of rows.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the lattice point; x from -1 to 2 X_DIM + 1, and y
+ *                    from -1 to 2 Y_DIM + 2 (for an endless maze, within
+ *                    the window of rows kept)
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the point in the maze array
+ *   SIDE EFFECTS: none
+ */
+static inline size_t
+maze_index (maze_ctx_t* m, int x, int y)
+{
+    if (x >= 2 * m->maze_x_dim) {
+	x -= 2 * m->maze_x_dim;
+	y++;
+    } else if (x < 0) {
+	x += 2 * m->maze_x_dim;
+	y--;
+    }
+    y = (y + 1) & m->maze_row_mask;
+    return ((((size_t)(y >> MAZE_TILE_BITS) * m->maze_tiles_x +
+	      (x >> MAZE_TILE_BITS)) << (2 * MAZE_TILE_BITS)) +
+	    ((y & (MAZE_TILE - 1)) << MAZE_TILE_BITS) + (x & (MAZE_TILE - 1)));
+}
+
+
+/* 
+ * bit_word
+ *   DESCRIPTION: Find the word of a bitboard holding a lattice point.
+ *   INPUTS: m -- the maze context
+ *           plane -- the bitboard (PLANE_*)
+ *           (x,y) -- the lattice point, with the same range and
+ *                    wraparound as for maze_index
+ *   OUTPUTS: *bit -- the point's bit in the word
+ *   RETURN VALUE: pointer to the word
+ *   SIDE EFFECTS: none
+ */
+static inline uint64_t*
+bit_word (maze_ctx_t* m, int plane, int x, int y, int* bit)
+{
+    if (x >= 2 * m->maze_x_dim) {
+	x -= 2 * m->maze_x_dim;
+	y++;
+    } else if (x < 0) {
+	x += 2 * m->maze_x_dim;
+	y--;
+    }
+    *bit = (x & 63);
+    return &m->maze_plane[plane][(size_t)((y + 1) & m->maze_row_mask) *
+				 m->maze_row_words + (x >> 6)];
+}
+
+
+/* 
+ * get_maze_bit
+ *   DESCRIPTION: Read a lattice point's bit in a bitboard.
+ *   INPUTS: m -- the maze context
+ *           plane -- the bitboard (PLANE_*)
+ *           (x,y) -- the lattice point, as for bit_word
+ *   OUTPUTS: none
+ *   RETURN VALUE: the bit (0 or 1)
+ *   SIDE EFFECTS: none
  */
-static unsigned char maze[2 * MAZE_MAX_X_DIM * (2 * MAZE_MAX_Y_DIM + 3) + 1];
-static int maze_x_dim;	      /* horizontal dimension of maze */
-static int maze_y_dim;	      /* vertical dimension of maze   */
-static int n_fruits;          /* number of fruits in maze     */
-static int exit_x, exit_y;    /* lattice point of maze exit   */
+static inline int
+get_maze_bit (maze_ctx_t* m, int plane, int x, int y)
+{
+    uint64_t* word;
+    int bit;
+
+    word = bit_word (m, plane, x, y, &bit);
+    return (int)((SHARED_LOAD (word) >> bit) & 1);
+}
 
 
 /* 
- * maze array index calculation macro; maze dimensions are valid only
- * after a call to make_maze
+ * set_maze_bit
+ *   DESCRIPTION: Set or clear a lattice point's bit in a bitboard.  Only
+ *                the thread making or playing the maze may call this.
+ *   INPUTS: m -- the maze context
+ *           plane -- the bitboard (PLANE_*)
+ *           (x,y) -- the lattice point, as for bit_word
+ *           on -- 1 to set the bit, 0 to clear it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
  */
-#define MAZE_INDEX(a,b) ((a) + ((b) + 1) * maze_x_dim * 2)
+static inline void
+set_maze_bit (maze_ctx_t* m, int plane, int x, int y, int on)
+{
+    uint64_t* word;
+    int bit;
+
+    word = bit_word (m, plane, x, y, &bit);
+    if (on)
+	SHARED_STORE (word, SHARED_LOAD (word) | ((uint64_t)1 << bit));
+    else
+	SHARED_STORE (word, SHARED_LOAD (word) & ~((uint64_t)1 << bit));
+}
 
 
 /* 
- * mark_maze_area
- *   DESCRIPTION: Uses a breadth-first search to marks all parts of the 
- *                maze accessible from (x,y) with the MAZE_REACH bit.
- *                Stops at walls and at maze locations already marked 
- *                as reached.
- *   INPUTS: (x,y) -- starting coordinate within maze
+ * alloc_maze_bits
+ *   DESCRIPTION: Make room for the bitboards of a maze.  Space newly
+ *                allocated is zeroed.
+ *   INPUTS: m -- the maze context
+ *           x_dim -- width of the maze
+ *           rows -- rows of lattice points stored
  *   OUTPUTS: none
- *   RETURN VALUE: number of maze locations marked
- *   SIDE EFFECTS: leaves MAZE_REACH markers on marked portion of maze
+ *   RETURN VALUE: 0 on success, -1 if memory runs out
+ *   SIDE EFFECTS: may reallocate the bitboards
  */
 static int
-mark_maze_area (int x, int y)
+alloc_maze_bits (maze_ctx_t* m, int x_dim, int rows)
 {
-    /* 
-     * queue for breadth-first search
-     *
-     * The queue holds pointers to maze locations in memory.  It is 
-     * large enough to hold the whole maze, although it should never 
-     * hold more than twice the minimum of rows and columns at any 
-     * time with our maze graphs.
-     *
-     * q_start is the index of the first unexplored location in the queue
-     * q_end is the index just after the last unexplored location in the 
-     *       queue
-     * cur is the maze location being explored
-     */
-    unsigned char* q[MAZE_MAX_X_DIM * MAZE_MAX_Y_DIM];
-    int q_start, q_end;
-    unsigned char* cur;
+    size_t words;
+    int plane;
+
+    m->maze_row_words = (2 * x_dim + 63) / 64;
+    m->maze_plane_words = (size_t)rows * m->maze_row_words;
+    words = NUM_PLANES * m->maze_plane_words;
+    if (words > m->maze_bits_words) {
+	free (m->maze_bits);
+	m->maze_bits_words = 0;
+	if ((m->maze_bits = calloc (words, sizeof (m->maze_bits[0]))) == NULL)
+	    return -1;
+	m->maze_bits_words = words;
+    }
+    for (plane = 0; plane < NUM_PLANES; plane++)
+	m->maze_plane[plane] = m->maze_bits + plane * m->maze_plane_words;
+    return 0;
+}
+
+
+/* 
+ * sync_maze_bits
+ *   DESCRIPTION: Set the bitboards of a range of rows from the maze array,
+ *                after changes made to the array alone.
+ *   INPUTS: m -- the maze context
+ *           y0, y1 -- first and last lattice rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+sync_maze_bits (maze_ctx_t* m, int y0, int y1)
+{
+    uint64_t* row[NUM_PLANES];
+    uint64_t word[NUM_PLANES];  /* bits of one word of each plane */
+    uint64_t bit;
+    unsigned char v;
+    int x, y, w, plane;
+
+    /* Each word is built up here, then stored once (see SHARED_STORE). */
+    for (y = y0; y <= y1; y++) {
+	for (plane = 0; plane < NUM_PLANES; plane++)
+	    row[plane] = bit_word (m, plane, 0, y, &w);
+	for (w = 0; w < m->maze_row_words; w++) {
+	    for (plane = 0; plane < NUM_PLANES; plane++)
+		word[plane] = 0;
+	    for (x = 64 * w; x < 64 * w + 64 && x < 2 * m->maze_x_dim; x++) {
+		v = m->maze[MAZE_INDEX (x, y)];
+		bit = (uint64_t)1 << (x & 63);
+		if ((v & MAZE_WALL) != 0)
+		    word[PLANE_WALL] |= bit;
+		if ((v & MAZE_REACH) != 0)
+		    word[PLANE_REACH] |= bit;
+		if ((v & MAZE_FRUIT) != 0)
+		    word[PLANE_FRUIT] |= bit;
+		if ((v & MAZE_EXIT) != 0)
+		    word[PLANE_EXIT] |= bit;
+	    }
+	    for (plane = 0; plane < NUM_PLANES; plane++)
+		SHARED_STORE (&row[plane][w], word[plane]);
+	}
+    }
+}
 
-    /* Mark the starting location as reached, then put it into the queue. */
-    q[0] = &maze[MAZE_INDEX (x, y)];
-    *(q[0]) |= MAZE_REACH;
-    q_start = 0;
-    q_end = 1;
 
-    /* Loop until queue is empty. */
-    while (q_start != q_end) {
+/* 
+ * count_bits
+ *   DESCRIPTION: Count the bits set in a bitboard for a run of lattice
+ *                points in one row, a word at a time.
+ *   INPUTS: m -- the maze context
+ *           plane -- the bitboard (PLANE_*)
+ *           x0, x1 -- first and last points of the run, from 0 to
+ *                     2 X_DIM - 1
+ *           y -- the row
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of bits set
+ *   SIDE EFFECTS: none
+ */
+static int
+count_bits (maze_ctx_t* m, int plane, int x0, int x1, int y)
+{
+    uint64_t* row;
+    uint64_t mask;
+    int w, n, bit;
+
+    row = bit_word (m, plane, 0, y, &bit);
+    for (n = 0, w = x0 >> 6; w <= (x1 >> 6); w++) {
+	mask = ~(uint64_t)0;
+	if (w == (x0 >> 6))
+	    mask &= ~(uint64_t)0 << (x0 & 63);
+	if (w == (x1 >> 6))
+	    mask &= ~(uint64_t)0 >> (63 - (x1 & 63));
+	n += __builtin_popcountll (SHARED_LOAD (&row[w]) & mask);
+    }
+    return n;
+}
 
-        /* Get location from front of queue. */
-	cur = q[q_start++];
 
+/* 
+ * square_number
+ *   DESCRIPTION: Number a square of the maze for the free square list.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the square, an (odd,odd) lattice point
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number
+ *   SIDE EFFECTS: none
+ */
+static inline int
+square_number (maze_ctx_t* m, int x, int y)
+{
+    return x / 2 + ((y / 2) & (m->maze_row_mask >> 1)) * m->maze_x_dim;
+}
+
+
+/* 
+ * alloc_free_squares
+ *   DESCRIPTION: Make room for the free square list of a maze, and either
+ *                empty it or list every square.
+ *   INPUTS: m -- the maze context
+ *           squares -- the number of squares that can be numbered
+ *           listed -- 1 to list every square (of a finite maze, with no
+ *                     fruit yet), 0 to list none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if memory runs out
+ *   SIDE EFFECTS: may reallocate the list
+ */
+static int
+alloc_free_squares (maze_ctx_t* m, size_t squares, int listed)
+{
+    size_t i;
+
+    if (squares > m->free_squares) {
+	free (m->free_list);
+	free (m->free_pos);
+	m->free_squares = 0;
+	m->free_list = malloc (squares * sizeof (m->free_list[0]));
+	m->free_pos = malloc (squares * sizeof (m->free_pos[0]));
+	if (m->free_list == NULL || m->free_pos == NULL)
+	    return -1;
+	m->free_squares = squares;
+    }
+    for (i = 0; i < squares; i++)
+	m->free_list[i] = m->free_pos[i] = (listed ? (int)i : -1);
+    m->n_free = (listed ? (int)squares : 0);
+    return 0;
+}
+
+
+/* 
+ * list_free_squares
+ *   DESCRIPTION: List the squares with no fruit in a range of rows.
+ *   INPUTS: m -- the maze context
+ *           y0, y1 -- first and last lattice rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+list_free_squares (maze_ctx_t* m, int y0, int y1)
+{
+    int x, y;
+
+    for (y = (y0 | 1); y <= y1; y += 2)
+	for (x = 1; x < 2 * m->maze_x_dim; x += 2)
+	    if (!get_maze_bit (m, PLANE_FRUIT, x, y))
+		free_square (m, x, y);
+}
+
+
+/* 
+ * free_square
+ *   DESCRIPTION: List a square that has lost its fruit (or never had any),
+ *                if it is not listed already and may be shown.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the square, an (odd,odd) lattice point
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+free_square (maze_ctx_t* m, int x, int y)
+{
+    int p;
+
+    if (y < m->maze_top || y > m->maze_made - 2)
+	return;
+    p = square_number (m, x, y);
+    if (m->free_pos[p] == -1) {
+	m->free_pos[p] = m->n_free;
+	m->free_list[m->n_free++] = p;
+    }
+}
+
+
+/* 
+ * fill_square
+ *   DESCRIPTION: Unlist a square that has taken fruit, or that may no
+ *                longer be shown, if it is listed.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the square, an (odd,odd) lattice point
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+fill_square (maze_ctx_t* m, int x, int y)
+{
+    int p, i, last;
+
+    p = square_number (m, x, y);
+    if ((i = m->free_pos[p]) == -1)
+	return;
+    last = m->free_list[--m->n_free];
+    m->free_list[i] = last;
+    m->free_pos[last] = i;
+    m->free_pos[p] = -1;
+}
+
+
+/* 
+ * pick_free_square
+ *   DESCRIPTION: Pick a listed square at random.
+ *   INPUTS: m -- the maze context
+ *   OUTPUTS: (*x,*y) -- the square, an (odd,odd) lattice point
+ *   RETURN VALUE: 0 on success, -1 if no square is listed
+ *   SIDE EFFECTS: draws from the maze's random numbers
+ */
+static int
+pick_free_square (maze_ctx_t* m, int* x, int* y)
+{
+    int p, row, top;
+
+    if (m->n_free == 0)
+	return -1;
+    p = m->free_list[rng_below (&m->rng, m->n_free)];
+    *x = (p % m->maze_x_dim) * 2 + 1;
+
+    /* Find the row of an endless maze from its place in the window. */
+    row = p / m->maze_x_dim;
+    top = m->maze_top / 2;
+    *y = (top + ((row - top) & (m->maze_row_mask >> 1))) * 2 + 1;
+    return 0;
+}
+
+
+/* a point's link in region[], which other threads may change */
+#define REGION(p) __atomic_load_n (&m->region[p], __ATOMIC_RELAXED)
+
+
+/* 
+ * find_region
+ *   DESCRIPTION: Find the root of the set holding a lattice point, and
+ *                link every other point on the way to the point two up
+ *                from it (path halving), so later searches are short.
+ *                Only a point that is not a root is relinked, and only
+ *                further up its tree, so other threads may search and
+ *                join the same sets at the same time.
+ *   INPUTS: m -- the maze context
+ *           p -- number of an (odd,odd) lattice point
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of the root point
+ *   SIDE EFFECTS: shortens paths in region[]
+ */
+static int
+find_region (maze_ctx_t* m, int p)
+{
+    int up, up2;
+
+    while ((up = REGION (p)) != p) {
+	up2 = REGION (up);
+	if (up2 != up)
+	    __atomic_store_n (&m->region[p], up2, __ATOMIC_RELAXED);
+	p = up2;
+    }
+    return p;
+}
+
+
+/* 
+ * join_regions
+ *   DESCRIPTION: Merge the sets holding two lattice points, linking the
+ *                root of higher number to the other.  The link is made
+ *                only if that root is still a root, so another thread may
+ *                join the same sets at the same time; if not, the roots
+ *                are found again.
+ *   INPUTS: m -- the maze context
+ *           p, q -- numbers of (odd,odd) lattice points
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if they were in different sets, 0 if not
+ *   SIDE EFFECTS: changes region[]
+ */
+static int
+join_regions (maze_ctx_t* m, int p, int q)
+{
+    int r;
+
+    while (1) {
+	p = find_region (m, p);
+	q = find_region (m, q);
+	if (p == q)
+	    return 0;
+	if (p < q) {
+	    r = p;
+	    p = q;
+	    q = r;
+	}
+	r = p;
+	if (__atomic_compare_exchange_n (&m->region[p], &r, q, 0,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    return 1;
+    }
+}
+
+
+/* 
+ * count_bands
+ *   DESCRIPTION: Choose the number of bands in which to make a maze: one
+ *                per thread allowed (see set_maze_threads) for a large
+ *                maze, each at least MAZE_BAND_MIN_ROWS high, or else one.
+ *   INPUTS: (x_dim,y_dim) -- size of maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of bands, from 1 to MAZE_MAX_BANDS
+ *   SIDE EFFECTS: none
+ */
+static int
+count_bands (int x_dim, int y_dim)
+{
+    long n = maze_threads;
+
+    if ((long)x_dim * y_dim < MAZE_PARALLEL_MIN)
+	return 1;
+    if (n <= 0)
+	n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n > y_dim / MAZE_BAND_MIN_ROWS)
+	n = y_dim / MAZE_BAND_MIN_ROWS;
+    if (n > MAZE_MAX_BANDS)
+	n = MAZE_MAX_BANDS;
+    return (n < 1 ? 1 : (int)n);
+}
+
+
+/* 
+ * run_bands
+ *   DESCRIPTION: Run a function on every band of a maze at once, all but
+ *                the first on threads of their own (or on this one, if a
+ *                thread cannot be had), and wait for them all.
+ *   INPUTS: band -- the bands
+ *           n_bands -- the number of bands
+ *           fn -- the function, given a band
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: whatever fn does
+ */
+static void
+run_bands (maze_band_t* band, int n_bands, void* (*fn) (void*))
+{
+    int k;
+
+    for (k = 1; k < n_bands; k++)
+	band[k].threaded = (pthread_create (&band[k].tid, NULL, fn,
+					    &band[k]) == 0);
+    (void)(*fn) (&band[0]);
+    for (k = 1; k < n_bands; k++) {
+	if (band[k].threaded)
+	    (void)pthread_join (band[k].tid, NULL);
+	else
+	    (void)(*fn) (&band[k]);
+    }
+}
+
+
+/* 
+ * dig_band
+ *   DESCRIPTION: Run the first phase described for make_maze within a
+ *                band of rows of a maze: its worms stay inside it.  Then
+ *                sort the band's points into regions connected by open
+ *                space within it.  The band's rows must be filled with
+ *                walls.  Bands of a maze may be dug at the same time.
+ *   INPUTS: arg -- the band (maze_band_t)
+ *   OUTPUTS: regions -- the number of regions in the band
+ *            n_open, n_inner -- walls between the band's rows left open
+ *                               by the worms, and all of them
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: changes the band's rows of the maze, and its points of
+ *                 region[]
+ */
+static void*
+dig_band (void* arg)
+{
+    maze_band_t* b = arg;
+    maze_ctx_t* m = b->m;
+    int remaining, regions, scan;
+    int x, y, wt[4], pick, dir, pref_dir, total, i, p;
+    int y_lo, y_hi;       /* first and last rows of squares (odd lattice) */
+    int p0, p1;           /* first point, and one past the last           */
+
+    y_lo = 2 * b->y0 + 1;
+    y_hi = 2 * b->y1 - 1;
+    p0 = b->y0 * m->maze_x_dim;
+    p1 = b->y1 * m->maze_x_dim;
+
+    /*
+     * 'worm' phase of maze generation
+     */
+
+    /* 
+     * Track the number of (odd,odd) lattice points still marked 
+     * as MAZE_WALL. 
+     */
+    remaining = p1 - p0;
+    scan = p0;
+    do {
 	/* 
-	 * Explore four directions from current position.  Maze 
-	 * construction guarantees that an adjacent open space implies
-	 * that the subsequent space in the same direction both exists
-	 * and is open (not a MAZE_WALL).
-	 *
-	 * Newly found locations are marked as reached before being
-	 * added to the queue, which prevents the same location from
-	 * being added when reached by multiple paths of equal length
-	 * from the starting point.
+	 * Pick an (odd,odd) lattice point still marked as a MAZE_WALL.
+	 * Once few are left, random picks mostly miss, so after a few
+	 * misses we take the next one in a scan of the band instead.  The
+	 * scan only moves forward, as points never become walls again, so
+	 * it takes time linear in the size of the band in all.
 	 */
-	if ((cur[-2 * maze_x_dim] & MAZE_WALL) == 0 &&
-	    (cur[-4 * maze_x_dim] & MAZE_REACH) == 0) {
-	    cur[-4 * maze_x_dim] |= MAZE_REACH;
-	    q[q_end++] = &cur[-4 * maze_x_dim];
+	for (i = 0; i < 8; i++) {
+	    x = (rng_below (&b->rng, m->maze_x_dim)) * 2 + 1;
+	    y = (rng_below (&b->rng, b->y1 - b->y0) + b->y0) * 2 + 1;
+	    if ((m->maze[MAZE_INDEX (x, y)] & MAZE_WALL) != 0)
+		break;
 	}
-	if ((cur[1] & MAZE_WALL) == 0 &&
-	    (cur[2] & MAZE_REACH) == 0) {
-	    cur[2] |= MAZE_REACH;
-	    q[q_end++] = &cur[2];
-	}
-	if ((cur[2 * maze_x_dim] & MAZE_WALL) == 0 &&
-	    (cur[4 * maze_x_dim] & MAZE_REACH) == 0) {
-	    cur[4 * maze_x_dim] |= MAZE_REACH;
-	    q[q_end++] = &cur[4 * maze_x_dim];
+	if (i == 8) {
+	    do {
+		x = (scan % m->maze_x_dim) * 2 + 1;
+		y = (scan / m->maze_x_dim) * 2 + 1;
+		scan++;
+	    } while ((m->maze[MAZE_INDEX (x, y)] & MAZE_WALL) == 0);
 	}
-	if ((cur[-1] & MAZE_WALL) == 0 &&
-	    (cur[-2] & MAZE_REACH) == 0) {
-	    cur[-2] |= MAZE_REACH;
-	    q[q_end++] = &cur[-2];
+
+	/* Empty the starting point. */
+	m->maze[MAZE_INDEX (x, y)] = MAZE_NONE;
+	remaining--;
+
+	/* The worm's initial preferred direction is random. */
+	pref_dir = rng_below (&b->rng, 4);
+
+	/* Move around the band until worm turns back on itself. */
+	while (1) {
+	    /* 
+	     * Choose the next direction of motion using weighted random
+	     * selection.  The directions are hardcoded.  The wt array
+	     * is the cumulative weight for each direction, and total
+	     * holds the running total weight (==wt[3] at the end).
+	     * A random value from 0 to total-1 is then chosen, and the
+	     * direction picked according to the weight distribution.
+	     * Weighting depends on direction and whether or not the
+	     * maze location has already been visited (is not a MAZE_WALL).
+	     * This code 
+	     */
+	    total = 0;
+	    if (y > y_lo)
+	        total += turn_wt[pref_dir]
+			 [m->maze[MAZE_INDEX (x, y - 2)] == MAZE_WALL];
+	    wt[0] = total;
+	    if (x < m->maze_x_dim * 2 - 1)
+	        total += turn_wt[(pref_dir + 3) % 4]
+			 [m->maze[MAZE_INDEX (x + 2, y)] == MAZE_WALL];
+	    wt[1] = total;
+	    if (y < y_hi)
+	        total += turn_wt[(pref_dir + 2) % 4]
+			 [m->maze[MAZE_INDEX (x, y + 2)] == MAZE_WALL];
+	    wt[2] = total;
+	    if (x > 1)
+	        total += turn_wt[(pref_dir + 1) % 4]
+			 [m->maze[MAZE_INDEX (x - 2, y)] == MAZE_WALL];
+	    wt[3] = total;
+	    pick = rng_below (&b->rng, total);
+	    for (dir = 0; pick >= wt[dir]; dir++);
+
+	    /* If worm decides to turn around, it's done. */
+	    if (((dir - pref_dir + 4) % 4) == 2)
+	        break;
+
+	    /* Move one space in the preferred direction. */
+	    pref_dir = dir;
+	    switch (pref_dir) {
+	        case 0:
+		    m->maze[MAZE_INDEX (x, y - 1)] = MAZE_NONE;
+		    y -=2;
+		    break;
+	        case 1:
+		    m->maze[MAZE_INDEX (x + 1, y)] = MAZE_NONE;
+		    x += 2;
+		    break;
+	        case 2:
+		    m->maze[MAZE_INDEX (x, y + 1)] = MAZE_NONE;
+		    y +=2;
+		    break;
+	        case 3:
+		    m->maze[MAZE_INDEX (x - 1, y)] = MAZE_NONE;
+		    x -= 2;
+		    break;
+	    }
+
+	    /* If necessary, the worm 'eats' the wall at the new space. */
+	    if (m->maze[MAZE_INDEX (x, y)] == MAZE_WALL)
+		remaining--;
+	    m->maze[MAZE_INDEX (x, y)] = MAZE_NONE;
+	} /* loop for one worm */
+
+    /* 
+     * The worm phase continues until all of the (odd,odd) lattice
+     * points in the band are all empty.
+     */
+    } while (remaining > 0); 
+
+    /* 
+     * Worms cannot cross the seam above the band; count how often they
+     * opened the walls between the band's rows, for build_maze to open
+     * the seam about as often.
+     */
+    b->n_open = b->n_inner = 0;
+    for (y = y_lo + 1; y < y_hi; y += 2) {
+	for (x = 1; x < 2 * m->maze_x_dim; x += 2, b->n_inner++)
+	    if ((m->maze[MAZE_INDEX (x, y)] & MAZE_WALL) == 0)
+		b->n_open++;
+    }
+
+    /* 
+     * Begin the second phase of the algorithm, in which we guarantee 
+     * connectivity between all (odd,odd) lattice points in the maze.
+     * We start by putting each point in a region of its own, and join
+     * the regions of neighbours with open space between them within the
+     * band; build_maze then joins them across the seams.
+     */
+    regions = p1 - p0;
+    for (p = p0; p < p1; p++)
+	m->region[p] = p;
+    for (y = y_lo, p = p0; y <= y_hi; y += 2) {
+        for (x = 1; x < 2 * m->maze_x_dim; x += 2, p++) {
+	    if (x < 2 * m->maze_x_dim - 1 &&
+		(m->maze[MAZE_INDEX (x + 1, y)] & MAZE_WALL) == 0)
+		regions -= join_regions (m, p, p + 1);
+	    if (y < y_hi &&
+		(m->maze[MAZE_INDEX (x, y + 1)] & MAZE_WALL) == 0)
+		regions -= join_regions (m, p, p + m->maze_x_dim);
 	}
     }
+    b->regions = regions;
+    return NULL;
+}
+
+
+/* 
+ * join_band
+ *   DESCRIPTION: Join the regions of a maze by knocking down walls within
+ *                a band of its rows, chosen at random, until the maze is
+ *                one region (or the band's walls run out).  The regions
+ *                on either side of a wall may reach into other bands,
+ *                which may be joined at the same time.  Every band of the
+ *                maze must have been dug, and the regions joined across
+ *                the seams between bands.
+ *   INPUTS: arg -- the band (maze_band_t)
+ *   OUTPUTS: walls_removed -- the number of walls knocked down
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: changes the band's rows of the maze, its points of
+ *                 region[] and walls[], and other points of region[];
+ *                 counts down *regions_left
+ */
+static void*
+join_band (void* arg)
+{
+    maze_band_t* b = arg;
+    maze_ctx_t* m = b->m;
+    int n_walls;
+    int x, y, pick, dir, i, p, q, r;
+    int y_lo, y_hi;       /* first and last rows of squares (odd lattice) */
+    int p0, p1;           /* first point, and one past the last           */
+    int* walls;
+
+    y_lo = 2 * b->y0 + 1;
+    y_hi = 2 * b->y1 - 1;
+    p0 = b->y0 * m->maze_x_dim;
+    p1 = b->y1 * m->maze_x_dim;
+    walls = m->walls + 2 * p0;
 
     /* 
-     * The queue is empty.  The number of locations marked is just q_end,
-     * the number that passed through the queue.
+     * List the walls between neighbours in different regions; only these
+     * can join regions.  Most walls lie within a region.  Linking every
+     * point straight to its root first makes the comparisons cheap.  (A
+     * root found may since have been joined to another, but points found
+     * in the same region stay so.)
+     */
+    for (p = p0; p < p1; p++)
+	if ((r = find_region (m, p)) != p)
+	    __atomic_store_n (&m->region[p], r, __ATOMIC_RELAXED);
+    n_walls = 0;
+    for (y = y_lo, p = p0; y <= y_hi; y += 2) {
+        for (x = 1; x < 2 * m->maze_x_dim; x += 2, p++) {
+	    if (x < 2 * m->maze_x_dim - 1 && REGION (p) != REGION (p + 1))
+		walls[n_walls++] = 2 * p;
+	    if (y < y_hi && REGION (p) != REGION (p + m->maze_x_dim))
+		walls[n_walls++] = 2 * p + 1;
+	}
+    }
+    b->walls_removed = 0;
+
+    /*
+     * Pick walls in random order (shuffling the list as we go) and knock
+     * down each one that separates two regions, until one region is
+     * left in the maze.  The lattice of each band is connected, and each
+     * band is joined to the next by the seam, so the lists suffice.
      */
-    return q_end;
+    for (i = 0; i < n_walls &&
+	 __atomic_load_n (b->regions_left, __ATOMIC_RELAXED) > 1; i++) {
+	pick = i + rng_below (&b->rng, n_walls - i);
+	dir = walls[pick];
+	walls[pick] = walls[i];
+	p = dir / 2;
+	q = p + ((dir & 1) != 0 ? m->maze_x_dim : 1);
+	if (join_regions (m, p, q)) {
+	    x = (p % m->maze_x_dim) * 2 + 1;
+	    y = (p / m->maze_x_dim) * 2 + 1;
+	    if ((dir & 1) != 0)
+		m->maze[MAZE_INDEX (x, y + 1)] = MAZE_NONE;
+	    else
+		m->maze[MAZE_INDEX (x + 1, y)] = MAZE_NONE;
+	    (void)__atomic_fetch_sub (b->regions_left, 1, __ATOMIC_RELAXED);
+	    b->walls_removed++;
+	}
+    }
+    return NULL;
+}
+
+
+/* 
+ * set_maze_threads
+ *   DESCRIPTION: Set the number of threads used to make a large maze.
+ *   INPUTS: n -- the number of threads, or 0 for one per processor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+set_maze_threads (int n)
+{
+    maze_threads = n;
+}
+
+
+/* 
+ * new_maze
+ *   DESCRIPTION: Create an empty maze context, to be filled by build_maze
+ *                or build_endless_maze.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the context, or NULL if memory runs out
+ *   SIDE EFFECTS: none
+ */
+maze_ctx_t*
+new_maze ()
+{
+    return calloc (1, sizeof (maze_ctx_t));
+}
+
+
+/* 
+ * free_maze
+ *   DESCRIPTION: Free a maze context made by new_maze and everything it
+ *                holds.  It may not be the current context, nor be in use
+ *                by any thread.  (The walls of a maze loaded from a level
+ *                pack are the pack's, and are not freed.)
+ *   INPUTS: m -- the context, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the context
+ */
+void
+free_maze (maze_ctx_t* m)
+{
+    if (m == NULL)
+	return;
+    free (m->maze);
+    free (m->maze_bits);
+    free (m->region);
+    free (m->walls);
+    free (m->eller_set);
+    free (m->eller_count);
+    free (m->eller_down);
+    free (m->free_list);
+    free (m->free_pos);
+    free (m);
+}
+
+
+/* 
+ * use_maze
+ *   DESCRIPTION: Make a maze context the current one, which the game plays
+ *                and draws.  No thread may be drawing the current maze.
+ *   INPUTS: m -- the context, holding a maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: the context that was current
+ *   SIDE EFFECTS: none
+ */
+maze_ctx_t*
+use_maze (maze_ctx_t* m)
+{
+    maze_ctx_t* old = cur_maze;
+
+    cur_maze = m;
+    return old;
 }
 
 
@@ -204,241 +1138,794 @@ mark_maze_area (int x, int y)
  *                Once the worms have done their work, the second phase
  *                of the algorithm begins.  This phase ensures that a path
  *                exists from any (odd,odd) lattice point to any other
- *                (odd,odd) point.  First, those points connected to the
- *                point (1,1) are marked as reachable.  Next, an unconnected
- *                point adjacent to a connected point is chosen at random,
- *                and the wall between them is removed, making another
- *                section of the maze reachable from (1,1).  This process
- *                continues until most of the maze is reachable or a
- *                certain number of attempts have been made, at which point
- *                we scan the maze for such adjacent pairs (rather than
- *                choosing randomly) until the entire maze is reachable
- *                from (1,1).
+ *                (odd,odd) point.  First, the points are sorted into
+ *                regions connected by open space, using a disjoint-set
+ *                (union-find) structure, and the walls between
+ *                neighbours in different regions are listed.  Next,
+ *                walls are taken from the list in random order, and each
+ *                wall still between two different regions is removed,
+ *                joining them.  This process continues until one region
+ *                is left.  Each wall is considered at most once, so the
+ *                phase takes time linear in the size of the maze (nearly;
+ *                union-find is not quite constant time).
+ *
+ *                A large maze is split into bands of rows, dug at the
+ *                same time on threads of their own (see dig_band), as the
+ *                worms of a band never leave it.  The walls on the seams
+ *                between bands are then opened at random, about as often
+ *                as the worms opened walls inside the bands, where that
+ *                joins regions.  The bands then knock down walls at the
+ *                same time (see join_band) until one region is left.
  *   INPUTS: (x_dim,y_dim) -- size of maze
  *           start_fruits -- number of fruits to place in maze
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure (if requested maze size
- *   		   exceeds limits set by defined values, with minimum
- *   		   (MAZE_MIN_X_DIM,MAZE_MIN_Y_DIM) and maximum
- *   		   (MAZE_MAX_X_DIM,MAZE_MAX_Y_DIM))
- *   SIDE EFFECTS: leaves MAZE_REACH markers on marked portion of maze
+ *   		   is below the minimum (MAZE_MIN_X_DIM,MAZE_MIN_Y_DIM) or
+ *   		   above MAZE_LIMIT_DIM, or if memory runs out)
+ *   SIDE EFFECTS: records statistics for get_maze_stats; may reallocate
+ *   		   the maze array
  */
 int
 make_maze (int x_dim, int y_dim, int start_fruits)
 {
-    /* 
-     * worm turn weights; the first dimension is relative direction
-     * (number of 90-degree turns clockwise from up); the second is 
-     * whether the resulting space is open (not a wall) or a wall.
-     */
-    static int turn_wt[4][2] = {{1, 84}, {1, 9}, {3, 3}, {1, 9}};
+    return build_maze (cur_maze, x_dim, y_dim, start_fruits);
+}
 
-    int remaining, trials;
-    int x, y, wt[4], pick, dir, pref_dir, total, i;
-    unsigned char* cur;
 
-    /* Check the requested size, and save in local state if it is valid. */
-    if (x_dim < MAZE_MIN_X_DIM || x_dim > MAZE_MAX_X_DIM ||
-        y_dim < MAZE_MIN_Y_DIM || y_dim > MAZE_MAX_Y_DIM)
+/* 
+ * build_maze
+ *   DESCRIPTION: Create a maze of specified dimensions in a given maze
+ *                context, which need not be the current one; see make_maze.
+ *   INPUTS: m -- the maze context
+ *           (x_dim,y_dim) -- size of maze
+ *           start_fruits -- number of fruits to place in maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may reallocate the arrays of m
+ */
+int
+build_maze (maze_ctx_t* m, int x_dim, int y_dim, int start_fruits)
+{
+    maze_band_t band[MAZE_MAX_BANDS];
+    int n_bands, regions;
+    int x, y, i, k, p;
+    int tiles_x, tiles_y;
+    size_t bytes;
+
+    /* Check the requested size. */
+    if (x_dim < MAZE_MIN_X_DIM || x_dim > MAZE_LIMIT_DIM ||
+        y_dim < MAZE_MIN_Y_DIM || y_dim > MAZE_LIMIT_DIM)
         return -1;
-    maze_x_dim = x_dim;
-    maze_y_dim = y_dim;
 
-    /* Fill the maze with walls. */
-    memset (maze, MAZE_WALL, sizeof (maze));
+    /* 
+     * Make room for the maze (see MAZE_INDEX), and for the regions used
+     * while making it.
+     */
+    tiles_x = (2 * x_dim + MAZE_TILE - 1) / MAZE_TILE;
+    tiles_y = (2 * y_dim + 5 + MAZE_TILE - 1) / MAZE_TILE;
+    bytes = (size_t)tiles_x * tiles_y * MAZE_TILE * MAZE_TILE;
+    if (bytes > m->maze_bytes) {
+	free (m->maze);
+	m->maze_bytes = 0;
+	if ((m->maze = malloc (bytes)) == NULL)
+	    return -1;
+	m->maze_bytes = bytes;
+    }
+    if (alloc_maze_bits (m, x_dim, tiles_y * MAZE_TILE) != 0 ||
+	alloc_free_squares (m, (size_t)x_dim * y_dim, 1) != 0)
+	return -1;
+    m->region = malloc ((size_t)x_dim * y_dim * sizeof (m->region[0]));
+    m->walls = malloc ((size_t)2 * x_dim * y_dim * sizeof (m->walls[0]));
+    if (m->region == NULL || m->walls == NULL) {
+	free (m->region);
+	free (m->walls);
+	m->region = NULL;
+	m->walls = NULL;
+	return -1;
+    }
+
+    /* Save the size in local state, and fill the maze with walls. */
+    m->maze_x_dim = x_dim;
+    m->maze_y_dim = y_dim;
+    m->maze_tiles_x = tiles_x;
+    m->maze_row_mask = -1;
+    m->maze_made = 2 * y_dim + 3;
+    m->maze_top = 0;
+    memset (m->maze, MAZE_WALL, bytes);
 
     /* Seed the random number generator. */
-    srandom (time (NULL));
+    m->seed = new_seed ();
+    seed_rng (&m->rng, m->seed);
 
     /*
-     * 'worm' phase of maze generation
+     * Dig the maze in bands of rows at the same time, then join the
+     * regions across the seams between bands, and then join the rest by
+     * knocking down walls in the bands at the same time.
      */
+    n_bands = count_bands (x_dim, y_dim);
+    for (k = 0; k < n_bands; k++) {
+	band[k].m = m;
+	band[k].y0 = (int)((long)y_dim * k / n_bands);
+	band[k].y1 = (int)((long)y_dim * (k + 1) / n_bands);
+	band[k].rng = m->rng;
+	jump_rng (&m->rng);
+	band[k].regions_left = &regions;
+    }
+    run_bands (band, n_bands, dig_band);
+    regions = 0;
+    for (k = 0; k < n_bands; k++)
+	regions += band[k].regions;
+
+    /*
+     * Open each seam about as often as the worms opened the walls between
+     * the rows of the band below it, but only where that joins regions
+     * (so that the bands, each connected within, do not gain loops along
+     * the seam), and at least once.
+     */
+    for (k = 1; k < n_bands; k++) {
+	y = 2 * band[k].y0;
+	p = band[k].y0 * m->maze_x_dim;
+	for (x = 1, i = 0; x < 2 * m->maze_x_dim; x += 2, p++) {
+	    if (rng_below (&m->rng, band[k].n_inner) < band[k].n_open &&
+		join_regions (m, p - m->maze_x_dim, p)) {
+		m->maze[MAZE_INDEX (x, y)] = MAZE_NONE;
+		regions--;
+		i++;
+	    }
+	}
+	if (i == 0) {
+	    x = rng_below (&m->rng, m->maze_x_dim);
+	    p = band[k].y0 * m->maze_x_dim + x;
+	    m->maze[MAZE_INDEX (2 * x + 1, y)] = MAZE_NONE;
+	    regions -= join_regions (m, p - m->maze_x_dim, p);
+	}
+    }
+    m->stats.regions = regions;
+    run_bands (band, n_bands, join_band);
+    m->stats.walls_removed = 0;
+    for (k = 0; k < n_bands; k++)
+	m->stats.walls_removed += band[k].walls_removed;
+    free (m->region);
+    free (m->walls);
+    m->region = NULL;
+    m->walls = NULL;
+
+#if 0 /* Be kind and show the maze boundary at start. */
+    for (x = 0; x < 2 * m->maze_x_dim; x++) {
+        m->maze[MAZE_INDEX (x, 0)] |= MAZE_REACH;
+        m->maze[MAZE_INDEX (x, 2 * m->maze_y_dim)] |= MAZE_REACH;
+    }
+    /* The value at y == 2 * maze_y_dim is the bottom of the right boundary. */
+    for (y = 0; y <= 2 * m->maze_y_dim + 1; y++)
+        m->maze[MAZE_INDEX (0, y)] |= MAZE_REACH;
+#endif
+
+#if GOD_MODE /* Remove all walls! */
+    for (x = 1; x < 2 * m->maze_x_dim; x++) {
+	for (y = 1; y < 2 * m->maze_y_dim; y++) {
+	    m->maze[MAZE_INDEX (x, y)] = MAZE_NONE;
+	}
+    }
+#endif
+
+    /* Copy the maze into the bitboards; all its squares are free. */
+    sync_maze_bits (m, -1, 2 * m->maze_y_dim + 3);
+
+    /* Put the required number of fruits in the maze. */
+    m->n_fruits = 0;
+    for (i = 0; i < start_fruits; i++)
+	add_a_fruit_internal (m);
 
     /* 
-     * Track the number of (odd,odd) lattice points still marked 
-     * as MAZE_WALL. 
+     * Find an unfruited maze point and put the maze exit there (it stays
+     * free for fruit), or any point if every one holds fruit.
      */
-    remaining = maze_x_dim * maze_y_dim;
-    do {
-	/* Pick an (odd,odd) lattice point still marked as a MAZE_WALL. */
-        do {
-	    x = (random () % maze_x_dim) * 2 + 1;
-	    y = (random () % maze_y_dim) * 2 + 1;
-	} while ((maze[MAZE_INDEX (x, y)] & MAZE_WALL) == 0);
+    if (pick_free_square (m, &x, &y) != 0) {
+	x = rng_below (&m->rng, m->maze_x_dim) * 2 + 1;
+	y = rng_below (&m->rng, m->maze_y_dim) * 2 + 1;
+    }
+    m->maze[MAZE_INDEX (x, y)] |= MAZE_EXIT;
+    set_maze_bit (m, PLANE_EXIT, x, y, 1);
+    m->exit_x = x;
+    m->exit_y = y;
 
-	/* Empty the starting point. */
-	maze[MAZE_INDEX (x, y)] = MAZE_NONE;
-	remaining--;
+    return 0;
+}
+
+
+/* 
+ * maze_wall_words
+ *   DESCRIPTION: Count the 64-bit words in the saved walls of a maze: the
+ *                rows of its wall bitboard that hold the maze (see
+ *                maze_saved_t in maze.h).
+ *   INPUTS: (x_dim,y_dim) -- size of the maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of words
+ *   SIDE EFFECTS: none
+ */
+size_t
+maze_wall_words (int x_dim, int y_dim)
+{
+    return (size_t)(2 * y_dim + 5) * ((2 * x_dim + 63) / 64);
+}
+
+
+/* 
+ * save_maze
+ *   DESCRIPTION: Describe the maze of a context for saving: its size,
+ *                exit and seed, its walls (in the context, which must not
+ *                change while they are used), and its fruits (copied).
+ *                An endless maze cannot be saved.
+ *   INPUTS: m -- the maze context, holding a finite maze
+ *   OUTPUTS: s -- the saved maze; s->fruits is allocated, or NULL if the
+ *                 maze has none
+ *   RETURN VALUE: 0 on success, -1 on failure (an endless maze, or if
+ *                 memory runs out)
+ *   SIDE EFFECTS: none
+ */
+int
+save_maze (maze_ctx_t* m, maze_saved_t* s)
+{
+    maze_fruit_t* fruits = NULL;
+    int x, y, n;
+
+    if (m->maze_row_mask != -1)
+	return -1;
+    if (m->n_fruits > 0 &&
+	(fruits = malloc (m->n_fruits * sizeof (fruits[0]))) == NULL)
+	return -1;
+    for (n = 0, y = 1; y < 2 * m->maze_y_dim && n < m->n_fruits; y += 2) {
+	for (x = 1; x < 2 * m->maze_x_dim; x += 2) {
+	    if (get_maze_bit (m, PLANE_FRUIT, x, y)) {
+		fruits[n].x = x;
+		fruits[n].y = y;
+		fruits[n++].fruit = (m->maze[MAZE_INDEX (x, y)] & MAZE_FRUIT) /
+				    MAZE_FRUIT_1;
+	    }
+	}
+    }
+
+    s->x_dim = m->maze_x_dim;
+    s->y_dim = m->maze_y_dim;
+    s->exit_x = m->exit_x;
+    s->exit_y = m->exit_y;
+    s->seed = m->seed;
+    s->walls = m->maze_plane[PLANE_WALL];
+    s->wall_words = maze_wall_words (m->maze_x_dim, m->maze_y_dim);
+    s->fruits = fruits;
+    s->n_fruits = n;
+    return 0;
+}
+
+
+/* 
+ * check_saved_walls
+ *   DESCRIPTION: Check that the walls of a saved maze close it in: that
+ *                the rows above and below it (lattice rows -1, 0, and
+ *                2 y_dim to 2 y_dim + 3) are all wall, as is the left
+ *                boundary (which is also the right, see bit_word), so that
+ *                play never leaves the rows of the maze.  Unless walls are
+ *                removed (GOD_MODE), the (even,even) points must be wall
+ *                too, as in every maze made.
+ *   INPUTS: s -- the saved maze, its size and wall_words checked
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the walls are good, -1 if not
+ *   SIDE EFFECTS: none
+ */
+static int
+check_saved_walls (const maze_saved_t* s)
+{
+    size_t row_words = (2 * s->x_dim + 63) / 64;
+    uint64_t last;        /* points of the maze in the last word of a row */
+    const uint64_t* row;
+    size_t w;
+    int y;
+
+    last = ((2 * s->x_dim) % 64 == 0 ? ~0ULL :
+	    (1ULL << ((2 * s->x_dim) % 64)) - 1);
+    row = s->walls;
+    for (y = -1; y <= 2 * s->y_dim + 3; y++, row += row_words) {
+	if (y <= 0 || y >= 2 * s->y_dim) {
+	    for (w = 0; w + 1 < row_words; w++)
+		if (row[w] != ~0ULL)
+		    return -1;
+	    if ((row[row_words - 1] & last) != last)
+		return -1;
+	} else if ((row[0] & 1) == 0) {
+	    return -1;
+	}
+#if (GOD_MODE == 0)
+	else if ((y & 1) == 0) {
+	    for (w = 0; w + 1 < row_words; w++)
+		if ((row[w] & 0x5555555555555555ULL) != 0x5555555555555555ULL)
+		    return -1;
+	    if ((row[row_words - 1] & last & 0x5555555555555555ULL) !=
+		(last & 0x5555555555555555ULL))
+		return -1;
+	}
+#endif
+    }
+    return 0;
+}
+
+
+/* 
+ * load_maze
+ *   DESCRIPTION: Put a saved maze in a maze context, which need not be the
+ *                current one.  The saved walls become the context's wall
+ *                bitboard where they are, so they must stay in memory (a
+ *                level pack stays mapped) and unchanged while the maze is
+ *                used.  The maze array then holds only what changes in
+ *                play (mist, fruit and exit), and starts out zeroed, as
+ *                do the other bitboards; space allocated afresh for them
+ *                is not touched until used.
+ *   INPUTS: m -- the maze context
+ *           s -- the saved maze
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (if the saved maze is not
+ *                 valid, or if memory runs out)
+ *   SIDE EFFECTS: reallocates the arrays of m; seeds its random numbers
+ *                 from the saved seed
+ */
+int
+load_maze (maze_ctx_t* m, const maze_saved_t* s)
+{
+    const maze_fruit_t* f;
+    int tiles_x, tiles_y, i;
+    size_t bytes;
+
+    /* Check the saved maze. */
+    if (s->x_dim < MAZE_MIN_X_DIM || s->x_dim > MAZE_LIMIT_DIM ||
+	s->y_dim < MAZE_MIN_Y_DIM || s->y_dim > MAZE_LIMIT_DIM ||
+	s->wall_words != maze_wall_words (s->x_dim, s->y_dim) ||
+	(s->exit_x & 1) == 0 || s->exit_x < 0 || s->exit_x >= 2 * s->x_dim ||
+	(s->exit_y & 1) == 0 || s->exit_y < 0 || s->exit_y >= 2 * s->y_dim ||
+	s->n_fruits < 0 || s->n_fruits > s->x_dim * s->y_dim ||
+	check_saved_walls (s) != 0)
+	return -1;
+    for (i = 0, f = s->fruits; i < s->n_fruits; i++, f++)
+	if ((f->x & 1) == 0 || f->x >= 2 * (uint32_t)s->x_dim ||
+	    (f->y & 1) == 0 || f->y >= 2 * (uint32_t)s->y_dim ||
+	    f->fruit < 1 || f->fruit > NUM_FRUIT_TYPES)
+	    return -1;
+
+    /* 
+     * Make room for the maze array and the bitboards afresh, zeroed, and
+     * for the free square list.
+     */
+    tiles_x = (2 * s->x_dim + MAZE_TILE - 1) / MAZE_TILE;
+    tiles_y = (2 * s->y_dim + 5 + MAZE_TILE - 1) / MAZE_TILE;
+    bytes = (size_t)tiles_x * tiles_y * MAZE_TILE * MAZE_TILE;
+    free (m->maze);
+    free (m->maze_bits);
+    m->maze_bytes = m->maze_bits_words = 0;
+    m->maze_bits = NULL;
+    if ((m->maze = calloc (bytes, 1)) == NULL)
+	return -1;
+    m->maze_bytes = bytes;
+    if (alloc_maze_bits (m, s->x_dim, 2 * s->y_dim + 5) != 0 ||
+	alloc_free_squares (m, (size_t)s->x_dim * s->y_dim, 1) != 0)
+	return -1;
+    m->maze_plane[PLANE_WALL] = (uint64_t*)s->walls;
+
+    /* Save the size in local state. */
+    m->maze_x_dim = s->x_dim;
+    m->maze_y_dim = s->y_dim;
+    m->maze_tiles_x = tiles_x;
+    m->maze_row_mask = -1;
+    m->maze_made = 2 * s->y_dim + 3;
+    m->maze_top = 0;
+    memset (&m->stats, 0, sizeof (m->stats));
+    m->seed = s->seed;
+    seed_rng (&m->rng, m->seed);
+
+    /* Put the fruits and the exit in the maze. */
+    m->n_fruits = 0;
+    for (i = 0, f = s->fruits; i < s->n_fruits; i++, f++) {
+	if (get_maze_bit (m, PLANE_FRUIT, f->x, f->y))
+	    return -1;
+	m->maze[MAZE_INDEX (f->x, f->y)] |= f->fruit * MAZE_FRUIT_1;
+	set_maze_bit (m, PLANE_FRUIT, f->x, f->y, 1);
+	fill_square (m, f->x, f->y);
+	m->n_fruits++;
+    }
+    m->exit_x = s->exit_x;
+    m->exit_y = s->exit_y;
+    m->maze[MAZE_INDEX (m->exit_x, m->exit_y)] |= MAZE_EXIT;
+    set_maze_bit (m, PLANE_EXIT, m->exit_x, m->exit_y, 1);
+
+    return 0;
+}
+
+
+/* 
+ * make_endless_maze
+ *   DESCRIPTION: Start a maze of a given width that goes down without end,
+ *                made a row of squares at a time by extend_maze as the
+ *                view moves down, using Eller's algorithm.  Only the set
+ *                of each square in the newest row is kept: the squares of
+ *                a row are first joined to neighbours in other sets at
+ *                random, then each set opens downwards at one or more
+ *                random squares, and the squares below with no opening
+ *                start sets of their own.  Every square is then joined to
+ *                every square above it, so every square can be reached.
+ *                Rows more than MAZE_WINDOW_ROWS lattice rows above the
+ *                newest are forgotten, fruit and all, so memory is fixed
+ *                however far the player goes.  The maze has no exit; it
+ *                counts as MAZE_ENDLESS_Y_DIM squares high.
+ *   INPUTS: x_dim -- width of the maze
+ *           start_fruits -- number of fruits to place in the first rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (if the width is below
+ *   		   MAZE_MIN_X_DIM or above MAZE_LIMIT_DIM, or if memory
+ *   		   runs out)
+ *   SIDE EFFECTS: may reallocate the maze array
+ */
+int
+make_endless_maze (int x_dim, int start_fruits)
+{
+    return build_endless_maze (cur_maze, x_dim, start_fruits);
+}
+
+
+/* 
+ * build_endless_maze
+ *   DESCRIPTION: Start an endless maze in a given maze context, which need
+ *                not be the current one; see make_endless_maze.
+ *   INPUTS: m -- the maze context
+ *           x_dim -- width of the maze
+ *           start_fruits -- number of fruits to place in the first rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may reallocate the arrays of m
+ */
+int
+build_endless_maze (maze_ctx_t* m, int x_dim, int start_fruits)
+{
+    int tiles_x, i;
+    size_t bytes;
+
+    /* Check the requested size. */
+    if (x_dim < MAZE_MIN_X_DIM || x_dim > MAZE_LIMIT_DIM)
+        return -1;
+
+    /* Make room for the window of rows, and for the set state. */
+    tiles_x = (2 * x_dim + MAZE_TILE - 1) / MAZE_TILE;
+    bytes = (size_t)tiles_x * MAZE_WINDOW_ROWS * MAZE_TILE;
+    if (bytes > m->maze_bytes) {
+	free (m->maze);
+	m->maze_bytes = 0;
+	if ((m->maze = malloc (bytes)) == NULL)
+	    return -1;
+	m->maze_bytes = bytes;
+    }
+    if (alloc_maze_bits (m, x_dim, MAZE_WINDOW_ROWS) != 0 ||
+	alloc_free_squares (m, (size_t)x_dim * (MAZE_WINDOW_ROWS / 2), 0) != 0)
+	return -1;
+    free (m->eller_set);
+    free (m->eller_count);
+    free (m->eller_down);
+    m->eller_set = malloc (x_dim * sizeof (m->eller_set[0]));
+    m->eller_count = malloc (x_dim * sizeof (m->eller_count[0]));
+    m->eller_down = malloc (x_dim * sizeof (m->eller_down[0]));
+    if (m->eller_set == NULL || m->eller_count == NULL || m->eller_down == NULL)
+	return -1;
+
+    /* 
+     * Save the size in local state, and fill the window with walls,
+     * which make rows -1 and 0 (the top boundary).
+     */
+    m->maze_x_dim = x_dim;
+    m->maze_y_dim = MAZE_ENDLESS_Y_DIM;
+    m->maze_tiles_x = tiles_x;
+    m->maze_row_mask = MAZE_WINDOW_ROWS - 1;
+    m->maze_made = 1;
+    m->maze_top = 0;
+    memset (m->maze, MAZE_WALL, bytes);
+    sync_maze_bits (m, -1, MAZE_WINDOW_ROWS - 2);
+    memset (&m->stats, 0, sizeof (m->stats));
+    m->exit_x = m->exit_y = -1;
+    m->n_fruits = 0;
+
+    /* Seed the random number generator, and start each square in a set. */
+    m->seed = new_seed ();
+    seed_rng (&m->rng, m->seed);
+    for (i = 0; i < x_dim; i++)
+	m->eller_set[i] = i;
+
+    /* Make the rows that start on the screen, and put fruit in them. */
+    extend_rows (m, SCROLL_Y_DIM / BLOCK_Y_DIM + 1);
+    for (i = 0; i < start_fruits; i++)
+	add_a_fruit_internal (m);
+
+    return 0;
+}
+
+
+/* 
+ * extend_maze
+ *   DESCRIPTION: Make the rows of an endless maze down to a given lattice
+ *                row, and one more for the stencil, forgetting rows that
+ *                leave the window.  Does nothing for other mazes.  Called
+ *                only by the thread that changes the maze; rows drawn by
+ *                another thread must be within the window.
+ *   INPUTS: y -- the lattice row wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may forget fruits in rows that leave the window
+ */
+void
+extend_maze (int y)
+{
+    extend_rows (cur_maze, y);
+}
 
-	/* The worm's initial preferred direction is random. */
-	pref_dir = (random () % 4);
 
-	/* Move around the maze until worm turns back on itself. */
-	while (1) {
-	    /* 
-	     * Choose the next direction of motion using weighted random
-	     * selection.  The directions are hardcoded.  The wt array
-	     * is the cumulative weight for each direction, and total
-	     * holds the running total weight (==wt[3] at the end).
-	     * A random value from 0 to total-1 is then chosen, and the
-	     * direction picked according to the weight distribution.
-	     * Weighting depends on direction and whether or not the
-	     * maze location has already been visited (is not a MAZE_WALL).
-	     * This code 
-	     */
-	    total = 0;
-	    if (y > 1)
-	        total += turn_wt[pref_dir]
-			 [maze[MAZE_INDEX (x, y - 2)] == MAZE_WALL];
-	    wt[0] = total;
-	    if (x < maze_x_dim * 2 - 1)
-	        total += turn_wt[(pref_dir + 3) % 4]
-			 [maze[MAZE_INDEX (x + 2, y)] == MAZE_WALL];
-	    wt[1] = total;
-	    if (y < maze_y_dim * 2 - 1)
-	        total += turn_wt[(pref_dir + 2) % 4]
-			 [maze[MAZE_INDEX (x, y + 2)] == MAZE_WALL];
-	    wt[2] = total;
-	    if (x > 1)
-	        total += turn_wt[(pref_dir + 1) % 4]
-			 [maze[MAZE_INDEX (x - 2, y)] == MAZE_WALL];
-	    wt[3] = total;
-	    pick = (random () % total);
-	    for (dir = 0; pick >= wt[dir]; dir++);
+/* 
+ * extend_rows
+ *   DESCRIPTION: Make the rows of an endless maze down to a given lattice
+ *                row; see extend_maze.
+ *   INPUTS: m -- the maze context
+ *           y -- the lattice row wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may forget fruits in rows that leave the window
+ */
+static void
+extend_rows (maze_ctx_t* m, int y)
+{
+    if (m->maze_row_mask == -1)
+	return;
+    while (m->maze_made <= y + 1 && m->maze_made < 2 * m->maze_y_dim)
+	make_maze_row (m);
+}
 
-	    /* If worm decides to turn around, it's done. */
-	    if (((dir - pref_dir + 4) % 4) == 2)
-	        break;
 
-	    /* Move one space in the preferred direction. */
-	    pref_dir = dir;
-	    switch (pref_dir) {
-	        case 0:
-		    maze[MAZE_INDEX (x, y - 1)] = MAZE_NONE;
-		    y -=2;
-		    break;
-	        case 1:
-		    maze[MAZE_INDEX (x + 1, y)] = MAZE_NONE;
-		    x += 2;
-		    break;
-	        case 2:
-		    maze[MAZE_INDEX (x, y + 1)] = MAZE_NONE;
-		    y +=2;
-		    break;
-	        case 3:
-		    maze[MAZE_INDEX (x - 1, y)] = MAZE_NONE;
-		    x -= 2;
-		    break;
-	    }
+/* 
+ * make_maze_row
+ *   DESCRIPTION: Make the next row of squares of an endless maze, and the
+ *                row of walls and openings below it, over the oldest two
+ *                rows of the window; see make_endless_maze.
+ *   INPUTS: m -- the maze context
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the set state; may forget fruits
+ */
+static void
+make_maze_row (maze_ctx_t* m)
+{
+    unsigned char* cur; /* lattice point being recycled         */
+    int y;              /* lattice row of the new squares        */
+    int old_top;        /* first row that could be drawn before  */
+    int* link;          /* sets joined in the row (see below)    */
+    int x, i, s, a, b;
 
-	    /* If necessary, the worm 'eats' the wall at the new space. */
-	    if (maze[MAZE_INDEX (x, y)] == MAZE_WALL)
-		remaining--;
-	    maze[MAZE_INDEX (x, y)] = MAZE_NONE;
-	} /* loop for one worm */
+    /* 
+     * The two oldest rows may no longer be drawn; then fill them with
+     * walls, dropping any fruit in them.
+     */
+    y = m->maze_made;
+    old_top = m->maze_top;
+    if (y + 2 - MAZE_WINDOW_ROWS + 1 > old_top)
+	__atomic_store_n (&m->maze_top, y + 2 - MAZE_WINDOW_ROWS + 1,
+			  __ATOMIC_RELEASE);
+    for (x = 0; x < 2 * m->maze_x_dim; x++) {
+	for (i = y; i < y + 2; i++) {
+	    cur = &m->maze[MAZE_INDEX (x, i)];
+	    if ((*cur & MAZE_FRUIT) != 0)
+		SHARED_STORE (&m->n_fruits, m->n_fruits - 1);
+	    SHARED_STORE (cur, MAZE_WALL);
+	}
+    }
 
     /* 
-     * The worm phase continues until all of the (odd,odd) lattice
-     * points in the maze are all empty.
+     * Open the squares, and join neighbours in different sets at random.
+     * The sets joined are kept as trees of links between set numbers
+     * (in eller_count, free until the joins are done), so that a join
+     * does not renumber the row; each square then takes the number of
+     * the root of its set.
      */
-    } while (remaining > 0); 
+    for (i = 0; i < m->maze_x_dim; i++)
+	SHARED_STORE (&m->maze[MAZE_INDEX (2 * i + 1, y)], MAZE_NONE);
+    link = m->eller_count;
+    for (i = 0; i < m->maze_x_dim; i++)
+	link[i] = i;
+    for (i = 0; i + 1 < m->maze_x_dim; i++) {
+	a = eller_root (link, m->eller_set[i]);
+	b = eller_root (link, m->eller_set[i + 1]);
+	if (a == b || rng_below (&m->rng, 2) == 0)
+	    continue;
+	SHARED_STORE (&m->maze[MAZE_INDEX (2 * i + 2, y)], MAZE_NONE);
+	link[b] = a;
+    }
+    for (i = 0; i < m->maze_x_dim; i++)
+	m->eller_set[i] = eller_root (link, m->eller_set[i]);
 
     /* 
-     * Begin the second phase of the algorithm, in which we guarantee 
-     * connectivity between all (odd,odd) lattice points in the maze.
-     * We start by marking everything connected to (1,1).
+     * Open the way down from squares at random, and from the last square
+     * of any set that has no opening yet.  Squares not opened leave their
+     * set (marked -1 for now).
      */
-    remaining = maze_x_dim * maze_y_dim - mark_maze_area (1, 1);
-    trials = 0;
-    do {
-        /*
-	 * Once most of the maze is connected, or we have tried randomly
-	 * "enough" times (arbitrarily defined as 100 times here, we scan 
-	 * the rest of the maze for opportunities for connecting new regions
-	 * of the maze to the (1,1) lattice point.
-	 */
-        if (remaining < 20 || ++trials > 100) {
-	    if ((x += 2) > maze_x_dim * 2) {
-		x -= maze_x_dim * 2;
-		if ((y += 2) > 2 * maze_y_dim)
-		    y -= 2 * maze_y_dim;
-	    }
-	    cur = &maze[MAZE_INDEX (x, y)];
-	    if ((cur[0] & MAZE_REACH) != 0)
-		continue;
+    for (i = 0; i < m->maze_x_dim; i++) {
+	m->eller_count[i] = 0;
+	m->eller_down[i] = 0;
+    }
+    for (i = 0; i < m->maze_x_dim; i++)
+	m->eller_count[m->eller_set[i]]++;
+    for (i = 0; i < m->maze_x_dim; i++) {
+	s = m->eller_set[i];
+	if ((--m->eller_count[s] == 0 && !m->eller_down[s]) ||
+	    rng_below (&m->rng, 3) == 0) {
+	    SHARED_STORE (&m->maze[MAZE_INDEX (2 * i + 1, y + 1)], MAZE_NONE);
+	    m->eller_down[s] = 1;
 	} else {
-	    /* Pick an unconnected (odd,odd) lattice point at random. */
-	    do {
-		x = (random () % maze_x_dim) * 2 + 1;
-		y = (random () % maze_y_dim) * 2 + 1;
-		cur = &maze[MAZE_INDEX (x, y)];
-	    } while ((cur[0] & MAZE_REACH) != 0);
+	    m->eller_set[i] = -1;
 	}
-	/* 
-	 * Try to connect the unconnected point by knocking down a wall
-	 * in some direction.
-	 */
-	if (y > 1 && (cur[-4 * maze_x_dim] & MAZE_REACH) != 0)
-	    cur[-2 * maze_x_dim] = MAZE_NONE;
-	else if (x > 1 && (cur[-2] & MAZE_REACH) != 0)
-	    cur[-1] = MAZE_NONE;
-	else if (x < 2 * maze_x_dim - 1 && (cur[2] & MAZE_REACH) != 0)
-	    cur[1] = MAZE_NONE;
-	else if (y < 2 * maze_y_dim - 1 &&
-		 (cur[4 * maze_x_dim] & MAZE_REACH) != 0)
-	    cur[2 * maze_x_dim] = MAZE_NONE;
-	else 
-	    continue;
-	/* 
-	 * Success!  Mark the newly connected portion of the maze
-	 * as reachable.
-	 */
-	remaining -= mark_maze_area (x, y);
-    } while (remaining > 0);
+    }
 
     /* 
-     * Remove the MAZE_REACH markers--these are reused to mark those
-     * portions of the maze already seen by the player.
-     */ 
-    for (x = 1; x < 2 * maze_x_dim; x += 2)
-        for (y = 1; y < 2 * maze_y_dim; y += 2)
-	    maze[MAZE_INDEX (x, y)] &= ~MAZE_REACH;
-
-#if 0 /* Be kind and show the maze boundary at start. */
-    for (x = 0; x < 2 * maze_x_dim; x++) {
-        maze[MAZE_INDEX (x, 0)] |= MAZE_REACH;
-        maze[MAZE_INDEX (x, 2 * maze_y_dim)] |= MAZE_REACH;
+     * Every set in the row went down, so the sets not used are those with
+     * no opening; give them to the squares that start new sets.
+     */
+    for (i = 0, s = 0; i < m->maze_x_dim; i++) {
+	if (m->eller_set[i] != -1)
+	    continue;
+	while (m->eller_down[s])
+	    s++;
+	m->eller_set[i] = s++;
     }
-    /* The value at y == 2 * maze_y_dim is the bottom of the right boundary. */
-    for (y = 0; y <= 2 * maze_y_dim + 1; y++)
-        maze[MAZE_INDEX (0, y)] |= MAZE_REACH;
-#endif
 
 #if GOD_MODE /* Remove all walls! */
-    for (x = 1; x < 2 * maze_x_dim; x++) {
-	for (y = 1; y < 2 * maze_y_dim; y++) {
-	    maze[MAZE_INDEX (x, y)] = MAZE_NONE;
-	}
+    for (x = 1; x < 2 * m->maze_x_dim; x++) {
+	SHARED_STORE (&m->maze[MAZE_INDEX (x, y)], MAZE_NONE);
+	SHARED_STORE (&m->maze[MAZE_INDEX (x, y + 1)], MAZE_NONE);
     }
 #endif
 
-    /* Put the required number of fruits in the maze. */
-    n_fruits = 0;
-    for (i = 0; i < start_fruits; i++)
-	add_a_fruit_internal ();
+    /* 
+     * The rows are made; the oldest two are gone.  List the new squares
+     * as free, and unlist those that may no longer be shown.
+     */
+    sync_maze_bits (m, y, y + 1);
+    __atomic_store_n (&m->maze_made, y + 2, __ATOMIC_RELEASE);
+    for (i = (old_top | 1); i < m->maze_top; i += 2)
+	for (x = 1; x < 2 * m->maze_x_dim; x += 2)
+	    fill_square (m, x, i);
+    list_free_squares (m, y, y);
+}
 
-    /* Find an unfruited maze point and put the maze exit there. */
-    do {
-	x = (random () % maze_x_dim) * 2 + 1;
-	y = (random () % maze_y_dim) * 2 + 1;
-    } while ((maze[MAZE_INDEX (x, y)] & MAZE_FRUIT));
-    maze[MAZE_INDEX (x, y)] |= MAZE_EXIT;
-    exit_x = x;
-    exit_y = y;
 
+/* 
+ * eller_root
+ *   DESCRIPTION: Find the set a set of an endless maze's row has been
+ *                joined into, halving the path to it as we go.
+ *   INPUTS: link -- the links between sets (see make_maze_row)
+ *           s -- the set
+ *   OUTPUTS: none
+ *   RETURN VALUE: the root set
+ *   SIDE EFFECTS: shortens links
+ */
+static int
+eller_root (int* link, int s)
+{
+    while (link[s] != s) {
+	link[s] = link[link[s]];
+	s = link[s];
+    }
+    return s;
+}
+
+
+/* 
+ * get_maze_top
+ *   DESCRIPTION: Get the first lattice row of the maze that may be shown:
+ *                0 unless rows at the top of an endless maze are gone.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the row
+ *   SIDE EFFECTS: none
+ */
+int
+get_maze_top ()
+{
+    maze_ctx_t* m = cur_maze;
+
+    return m->maze_top;
+}
+
+
+/* 
+ * set_turn_weights
+ *   DESCRIPTION: Set the worm turn weights used to make mazes (see
+ *                turn_wt).  No maze may be being made.
+ *   INPUTS: wt -- the weights, by relative direction and by whether the
+ *                 space moved to is open or a wall; each from 1 to
+ *                 MAX_TURN_WT, so a worm always has a way to go
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if a weight is out of range
+ *   SIDE EFFECTS: none
+ */
+int
+set_turn_weights (const int wt[4][2])
+{
+    int dir, wall;
+
+    for (dir = 0; dir < 4; dir++)
+	for (wall = 0; wall < 2; wall++)
+	    if (wt[dir][wall] < 1 || wt[dir][wall] > MAX_TURN_WT)
+		return -1;
+    memcpy (turn_wt, wt, sizeof (turn_wt));
     return 0;
 }
 
+
+/* 
+ * get_turn_weights
+ *   DESCRIPTION: Get the worm turn weights used to make mazes.
+ *   INPUTS: none
+ *   OUTPUTS: wt -- the weights, as for set_turn_weights
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+get_turn_weights (int wt[4][2])
+{
+    memcpy (wt, turn_wt, sizeof (turn_wt));
+}
+
+
+/* 
+ * get_maze_stats
+ *   DESCRIPTION: Get statistics about the generation of the last maze.
+ *   INPUTS: none
+ *   OUTPUTS: ms -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+get_maze_stats (maze_stats_t* ms)
+{
+    read_maze_stats (cur_maze, ms);
+}
+
+
+/* 
+ * read_maze_stats
+ *   DESCRIPTION: Get statistics about the generation of the maze of a
+ *                given context.
+ *   INPUTS: m -- the maze context
+ *   OUTPUTS: ms -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+read_maze_stats (maze_ctx_t* m, maze_stats_t* ms)
+{
+    *ms = m->stats;
+}
+
+
+/* 
+ * new_seed
+ *   DESCRIPTION: Pick a seed for the random numbers of a new maze: the
+ *                time, mixed with a count of the seeds picked, so that
+ *                mazes made in the same second (as the next level is
+ *                made during the current one) differ.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the seed
+ *   SIDE EFFECTS: counts the seed
+ */
+static uint64_t
+new_seed ()
+{
+    static unsigned long seeds = 0;
+
+    return ((uint64_t)time (NULL) << 20) ^
+	   __atomic_fetch_add (&seeds, 1, __ATOMIC_RELAXED);
+}
+
+
 /*
  * The functions inside the preprocessor block below rely on block image
  * data in blocks.s.  These external data are neither available nor 
@@ -448,11 +1935,19 @@ make_maze (int x_dim, int y_dim, int start_fruits)
 #if (TEST_MAZE_GEN == 0)
 
 
+/* 
+ * function called to draw maze squares whose images change; draws them
+ * immediately unless replaced with set_redraw_fn
+ */
+static void (*redraw_fn) (int x, int y) = draw_space;
+
+
 /* 
  * find_block
  *   DESCRIPTION: Find the appropriate image to be used for a given maze
  *                lattice point.
- *   INPUTS: (x,y) -- the maze lattice point
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the maze lattice point
  *   OUTPUTS: none
  *   RETURN VALUE: a pointer to an image of a BLOCK_X_DIM x BLOCK_Y_DIM
  *                 block of data with one byte per pixel laid out as a
@@ -460,23 +1955,55 @@ make_maze (int x_dim, int y_dim, int start_fruits)
  *   SIDE EFFECTS: none
  */
 static unsigned char*
-find_block (int x, int y)
+find_block (maze_ctx_t* m, int x, int y)
 {
-    int fnum;     /* fruit found                           */
     int pattern;  /* stencil pattern for surrounding walls */
 
+    pattern = (get_maze_bit (m, PLANE_WALL, x, y - 1) << 0) |
+	      (get_maze_bit (m, PLANE_WALL, x + 1, y) << 1) |
+	      (get_maze_bit (m, PLANE_WALL, x, y + 1) << 2) |
+	      (get_maze_bit (m, PLANE_WALL, x - 1, y) << 3);
+    return block_image (m, x, y, pattern);
+}
+
+
+/* 
+ * block_image
+ *   DESCRIPTION: Find the image for a maze lattice point, given the
+ *                stencil pattern of the walls around it.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- the maze lattice point
+ *           pattern -- walls to the north, east, south, and west, in
+ *                      bits 0 to 3
+ *   OUTPUTS: none
+ *   RETURN VALUE: a pointer to an image, as for find_block
+ *   SIDE EFFECTS: none
+ */
+static unsigned char*
+block_image (maze_ctx_t* m, int x, int y, int pattern)
+{
+    int fnum;     /* fruit found */
+
+    /* Rows of an endless maze gone or not yet made are under mist. */
+    if (y < MAZE_TOP (m) || y > MAZE_MADE (m) - 2)
+        return (unsigned char*)blocks[BLOCK_SHADOW];
+
     /* Record whether fruit is present. */
-    fnum = (maze[MAZE_INDEX (x, y)] & MAZE_FRUIT) / MAZE_FRUIT_1;
+    fnum = 0;
+    if (get_maze_bit (m, PLANE_FRUIT, x, y))
+	fnum = ((SHARED_LOAD (&m->maze[MAZE_INDEX (x, y)]) & MAZE_FRUIT) /
+		MAZE_FRUIT_1);
 
     /* The exit is always visible once the last fruit is collected. */
-    if (n_fruits == 0 && (maze[MAZE_INDEX (x, y)] & MAZE_EXIT) != 0)
+    if (SHARED_LOAD (&m->n_fruits) == 0 &&
+	get_maze_bit (m, PLANE_EXIT, x, y))
         return (unsigned char*)blocks[BLOCK_EXIT];
 
     /* 
      * Everything else not reached is shrouded in mist, although fruits
      * show up as bumps.
      */
-    if ((maze[MAZE_INDEX (x, y)] & MAZE_REACH) == 0) {
+    if (!get_maze_bit (m, PLANE_REACH, x, y)) {
         if (fnum != 0)
             return (unsigned char*)blocks[BLOCK_FRUIT_SHADOW];
         return (unsigned char*)blocks[BLOCK_SHADOW];
@@ -487,24 +2014,70 @@ find_block (int x, int y)
         return (unsigned char*)blocks[BLOCK_FRUIT_1 + fnum - 1];
 
     /* Show empty space. */
-    if ((maze[MAZE_INDEX (x, y)] & MAZE_WALL) == 0)
+    if (!get_maze_bit (m, PLANE_WALL, x, y))
         return (unsigned char*)blocks[BLOCK_EMPTY];
 
     /* Show different types of walls. */
-    pattern = (((maze[MAZE_INDEX (x, y - 1)] & MAZE_WALL) != 0) << 0) |
-	      (((maze[MAZE_INDEX (x + 1, y)] & MAZE_WALL) != 0) << 1) |
-	      (((maze[MAZE_INDEX (x, y + 1)] & MAZE_WALL) != 0) << 2) |
-	      (((maze[MAZE_INDEX (x - 1, y)] & MAZE_WALL) != 0) << 3);
     return (unsigned char*)blocks[pattern];
 }
 
 
+/* 
+ * wall_stencil
+ *   DESCRIPTION: Find the stencil of walls around each of 64 lattice
+ *                points in a row at once, by shifting and masking the
+ *                wall bitboards of the row and its neighbours.
+ *   INPUTS: m -- the maze context
+ *           w -- word of the row holding the points (x from 64 w)
+ *           y -- the row, which must be in the window
+ *   OUTPUTS: st -- for each point, whether there is a wall to the north,
+ *                  east, south, and west, in words 0 to 3
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+wall_stencil (maze_ctx_t* m, int w, int y, uint64_t st[4])
+{
+    uint64_t* row;  /* walls of row y      */
+    uint64_t cur;   /* the word itself     */
+    int last;       /* last point in word  */
+    int bit;
+
+    row = bit_word (m, PLANE_WALL, 0, y, &bit);
+    cur = SHARED_LOAD (&row[w]);
+    st[0] = SHARED_LOAD (&bit_word (m, PLANE_WALL, 0, y - 1, &bit)[w]);
+    st[2] = SHARED_LOAD (&bit_word (m, PLANE_WALL, 0, y + 1, &bit)[w]);
+
+    /* 
+     * East and west come from the row itself, shifted, with the bits
+     * that cross a word or the edge of the maze (which wraps around)
+     * filled in one at a time.
+     */
+    if (w < m->maze_row_words - 1) {
+	st[1] = (cur >> 1) | (SHARED_LOAD (&row[w + 1]) << 63);
+    } else {
+	last = 2 * m->maze_x_dim - 1 - 64 * w;
+	st[1] = ((cur >> 1) & (((uint64_t)1 << last) - 1)) |
+		((uint64_t)get_maze_bit (m, PLANE_WALL, 2 * m->maze_x_dim, y) <<
+		 last);
+    }
+    if (w > 0)
+	st[3] = (cur << 1) | (SHARED_LOAD (&row[w - 1]) >> 63);
+    else
+	st[3] = (cur << 1) | (uint64_t)get_maze_bit (m, PLANE_WALL, -1, y);
+}
+
+
 /* 
  * fill_horiz_buffer
  *   DESCRIPTION: Given the (x,y) map pixel coordinate of the leftmost 
  *                pixel of a line to be drawn on the screen, this routine 
  *                produces an image of the line.  Each pixel on the line
- *                is represented as a single byte in the image.
+ *                is represented as a single byte in the image.  Rows
+ *                of an endless maze are not made here, as this runs on
+ *                the render thread; the logic thread makes them (with
+ *                extend_maze) as it moves the view down, and rows not
+ *                made are drawn as mist.
  *   INPUTS: (x,y) -- leftmost pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
  *   RETURN VALUE: none
@@ -512,10 +2085,31 @@ find_block (int x, int y)
  */
 void
 fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
+{
+    fill_horiz_line (cur_maze, x, y, buf);
+}
+
+
+/* 
+ * fill_horiz_line
+ *   DESCRIPTION: Produce the image of a horizontal line of a maze context;
+ *                see fill_horiz_buffer.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- leftmost pixel of line to be drawn 
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+fill_horiz_line (maze_ctx_t* m, int x, int y, unsigned char buf[SCROLL_X_DIM])
 {
     int map_x, map_y;     /* maze lattice point of the first block on line */
     int sub_x, sub_y;     /* sub-block address                             */
+    int last_x;           /* maze lattice point of the last block on line  */
     int idx;              /* loop index over pixels in the line            */ 
+    int w;                /* bitboard word of the stencil in st            */
+    int pattern;          /* stencil pattern for surrounding walls         */
+    uint64_t st[4] = {0}; /* wall stencil of 64 blocks (see wall_stencil)  */
     unsigned char* block; /* pointer to current maze block image           */
 
     /* Find the maze lattice point and the pixel address within that block. */
@@ -523,12 +2117,48 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
     map_y = y / BLOCK_Y_DIM;
     sub_x = x - map_x * BLOCK_X_DIM;
     sub_y = y - map_y * BLOCK_Y_DIM;
+    last_x = (x + SCROLL_X_DIM - 1) / BLOCK_X_DIM;
+
+    /* 
+     * A line in which nothing is unveiled and nothing shows through the
+     * mist is all mist.
+     */
+    if (map_y < MAZE_TOP (m) || map_y > MAZE_MADE (m) - 2 ||
+	(last_x < 2 * m->maze_x_dim &&
+	 count_bits (m, PLANE_REACH, map_x, last_x, map_y) == 0 &&
+	 count_bits (m, PLANE_FRUIT, map_x, last_x, map_y) == 0 &&
+	 count_bits (m, PLANE_EXIT, map_x, last_x, map_y) == 0)) {
+	block = (unsigned char*)blocks[BLOCK_SHADOW] + sub_y * BLOCK_X_DIM;
+	for (idx = 0; idx < SCROLL_X_DIM; idx++, sub_x++) {
+	    if (sub_x == BLOCK_X_DIM)
+		sub_x = 0;
+	    buf[idx] = block[sub_x];
+	}
+	return;
+    }
 
     /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_X_DIM; ) {
+    for (w = -1, idx = 0; idx < SCROLL_X_DIM; map_x++) {
 
-	/* Find address of block to be drawn. */
-        block = find_block (map_x++, map_y) + sub_y * BLOCK_X_DIM + sub_x;
+	/* 
+	 * Find address of block to be drawn, taking the wall stencil from
+	 * that of its 64-block word (the right boundary, at 2 X_DIM, is
+	 * past the last word).
+	 */
+	if (map_x < 2 * m->maze_x_dim) {
+	    if ((map_x >> 6) != w) {
+		w = (map_x >> 6);
+		wall_stencil (m, w, map_y, st);
+	    }
+	    pattern = (int)(((st[0] >> (map_x & 63)) & 1) |
+			    (((st[1] >> (map_x & 63)) & 1) << 1) |
+			    (((st[2] >> (map_x & 63)) & 1) << 2) |
+			    (((st[3] >> (map_x & 63)) & 1) << 3));
+	    block = block_image (m, map_x, map_y, pattern);
+	} else {
+	    block = find_block (m, map_x, map_y);
+	}
+	block += sub_y * BLOCK_X_DIM + sub_x;
 
 	/* Write block colors from one line into buffer. */
 	for (; idx < SCROLL_X_DIM && sub_x < BLOCK_X_DIM; idx++, sub_x++)
@@ -547,7 +2177,8 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
  *   DESCRIPTION: Given the (x,y) map pixel coordinate of the top pixel of 
  *                a vertical line to be drawn on the screen, this routine 
  *                produces an image of the line.  Each pixel on the line
- *                is represented as a single byte in the image.
+ *                is represented as a single byte in the image.  As
+ *                for fill_horiz_buffer, rows not made are drawn as mist.
  *   INPUTS: (x,y) -- top pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
  *   RETURN VALUE: none
@@ -556,6 +2187,7 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
 void
 fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
 {
+    maze_ctx_t* m = cur_maze;
     int map_x, map_y;     /* maze lattice point of the first block on line */
     int sub_x, sub_y;     /* sub-block address                             */
     int idx;              /* loop index over pixels in the line            */ 
@@ -571,7 +2203,7 @@ fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
     for (idx = 0; idx < SCROLL_Y_DIM; ) {
 
 	/* Find address of block to be drawn. */
-	block = find_block (map_x, map_y++) + sub_y * BLOCK_X_DIM + sub_x;
+	block = find_block (m, map_x, map_y++) + sub_y * BLOCK_X_DIM + sub_x;
 
 	/* Write block colors from one line into buffer. */
 	for (; idx < SCROLL_Y_DIM && sub_y < BLOCK_Y_DIM; 
@@ -589,6 +2221,65 @@ fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
 }
 
 
+/* 
+ * render_maze_view
+ *   DESCRIPTION: Draw a whole view window of a maze context, which need
+ *                not be the current one, into an image in memory, as
+ *                draw_horiz_line would draw each line of it.
+ *   INPUTS: m -- the maze context
+ *           (x,y) -- upper left pixel of the view window
+ *   OUTPUTS: img -- SCROLL_Y_DIM lines of SCROLL_X_DIM pixels
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+render_maze_view (maze_ctx_t* m, int x, int y, unsigned char* img)
+{
+    int i;
+
+    for (i = 0; i < SCROLL_Y_DIM; i++)
+	fill_horiz_line (m, x, y + i, img + i * SCROLL_X_DIM);
+}
+
+
+/* 
+ * draw_space
+ *   DESCRIPTION: Draws the image of a maze lattice point into the build
+ *                buffer (clipped to the logical view window).
+ *   INPUTS: (x,y) -- the lattice point to be drawn
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws to the build buffer
+ */
+void
+draw_space (int x, int y)
+{
+    maze_ctx_t* m = cur_maze;
+
+    draw_full_block (x * BLOCK_X_DIM, y * BLOCK_Y_DIM, find_block (m, x, y));
+}
+
+
+/* 
+ * set_redraw_fn
+ *   DESCRIPTION: Chooses what happens to maze lattice points whose images
+ *                are changed by unveiling, eating, or adding fruit.  By
+ *                default they are drawn at once with draw_space; a program
+ *                that draws from another thread can instead record them
+ *                and call draw_space later.
+ *   INPUTS: fn -- function called with each changed lattice point, or
+ *                 NULL to restore draw_space
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+set_redraw_fn (void (*fn) (int x, int y))
+{
+    redraw_fn = (fn != NULL ? fn : draw_space);
+}
+
+
 /* 
  * unveil_space
  *   DESCRIPTION: Unveils a maze lattice point (marks as MAZE_REACH, which
@@ -602,6 +2293,7 @@ fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
 void
 unveil_space (int x, int y)
 {
+    maze_ctx_t* m = cur_maze;
     unsigned char* cur; /* pointer to the maze lattice point */
     
     /* 
@@ -619,17 +2311,18 @@ unveil_space (int x, int y)
      * Allow exposure of bottom and right boundaries (left and right 
      * boundaries are the same lattice point in the maze).
      */
-    if (x < 0 || x > 2 * maze_x_dim || y < 0 || y > 2 * maze_y_dim)
+    if (x < 0 || x > 2 * m->maze_x_dim || y < 0 || y > 2 * m->maze_y_dim)
         return;
 
     /* Has the location already been seen?  If so, do nothing. */
-    cur = &maze[MAZE_INDEX (x, y)];
-    if (*cur & MAZE_REACH)
+    if (get_maze_bit (m, PLANE_REACH, x, y))
         return;
+    cur = &m->maze[MAZE_INDEX (x, y)];
 
     /* Unveil the location and redraw it. */
-    *cur |= MAZE_REACH;
-    draw_full_block (x * BLOCK_X_DIM, y * BLOCK_Y_DIM, find_block (x, y));
+    SHARED_STORE (cur, *cur | MAZE_REACH);
+    set_maze_bit (m, PLANE_REACH, x, y, 1);
+    (*redraw_fn) (x, y);
 }
 
 
@@ -647,30 +2340,35 @@ unveil_space (int x, int y)
 int
 check_for_fruit (int x, int y)
 {
+    maze_ctx_t* m = cur_maze;
     int fnum;  /* fruit number found */
     
     /* If outside the feasible fruit range, return no fruit. */
-    if (x < 0 || x >= 2 * maze_x_dim || y < 0 || y >= 2 * maze_y_dim)
+    if (x < 0 || x >= 2 * m->maze_x_dim || y < 0 || y >= 2 * m->maze_y_dim)
         return 0;
 
     /* Calculate the fruit number. */
-    fnum = (maze[MAZE_INDEX (x, y)] & MAZE_FRUIT) / MAZE_FRUIT_1;
+    if (!get_maze_bit (m, PLANE_FRUIT, x, y))
+        return 0;
+    fnum = (m->maze[MAZE_INDEX (x, y)] & MAZE_FRUIT) / MAZE_FRUIT_1;
 
     /* If fruit was present... */
     if (fnum != 0) {
 	/* ...remove it. */
-        maze[MAZE_INDEX (x, y)] &= ~MAZE_FRUIT;
+        SHARED_STORE (&m->maze[MAZE_INDEX (x, y)],
+		      m->maze[MAZE_INDEX (x, y)] & ~MAZE_FRUIT);
+	set_maze_bit (m, PLANE_FRUIT, x, y, 0);
 
-	/* Update the count of fruits. */
-	--n_fruits;
+	/* Update the count of fruits, and free the square for more. */
+	SHARED_STORE (&m->n_fruits, m->n_fruits - 1);
+	free_square (m, x, y);
 
 	/* The exit may appear. */
-	if (n_fruits == 0)
-	    draw_full_block (exit_x * BLOCK_X_DIM, exit_y * BLOCK_Y_DIM, 
-			     find_block (exit_x, exit_y));
+	if (m->n_fruits == 0 && m->exit_y != -1)
+	    (*redraw_fn) (m->exit_x, m->exit_y);
 
 	/* Redraw the space with no fruit. */
-        draw_full_block (x * BLOCK_X_DIM, y * BLOCK_Y_DIM, find_block (x, y));
+        (*redraw_fn) (x, y);
     }
 
     /* Return the fruit number found. */
@@ -691,12 +2389,14 @@ check_for_fruit (int x, int y)
 int
 check_for_win (int x, int y)
 {
+    maze_ctx_t* m = cur_maze;
+
     /* Check that position falls within valid boundaries for exit. */
-    if (x < 0 || x >= 2 * maze_x_dim || y < 0 || y >= 2 * maze_y_dim)
+    if (x < 0 || x >= 2 * m->maze_x_dim || y < 0 || y >= 2 * m->maze_y_dim)
         return 0;
     
     /* Return win condition. */
-    return (n_fruits == 0 && (maze[MAZE_INDEX (x, y)] & MAZE_EXIT) != 0);
+    return (m->n_fruits == 0 && get_maze_bit (m, PLANE_EXIT, x, y));
 }
 
 
@@ -705,35 +2405,38 @@ check_for_win (int x, int y)
  *   DESCRIPTION: Add a fruit to a random (odd,odd) lattice point in the
  *                maze.  Update the number of fruits, including the displayed
  *                value.  If requested, draw the new fruit on the screen.
- *   INPUTS: show -- 1 if new fruit should be drawn, 0 if not
+ *                Does nothing if every point holds fruit already.
+ *   INPUTS: m -- the maze context
+ *           show -- 1 if new fruit should be drawn, 0 if not
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: changes displayed fruit value, may draw to screen
  */
 static void
-_add_a_fruit (int show)
+_add_a_fruit (maze_ctx_t* m, int show)
 {
     int x, y;    /* lattice point for new fruit */
 
     /*
-     * Pick an unfruited lattice point at random.  Could fall on the 
-     * maze exit, if that is already defined.
+     * Pick an unfruited lattice point at random from the free squares.
+     * Could fall on the maze exit, if that is already defined.  Give up
+     * if every point holds fruit.
      */
-    do {
-	x = (random () % maze_x_dim) * 2 + 1;
-	y = (random () % maze_y_dim) * 2 + 1;
-    } while ((maze[MAZE_INDEX (x, y)] & MAZE_FRUIT));
+    if (pick_free_square (m, &x, &y) != 0)
+	return;
+    fill_square (m, x, y);
 
     /* Add a random fruit to that location. */
-    maze[MAZE_INDEX (x, y)] |= 
-        ((random () % NUM_FRUIT_TYPES) + 1) * MAZE_FRUIT_1;
+    SHARED_STORE (&m->maze[MAZE_INDEX (x, y)], m->maze[MAZE_INDEX (x, y)] |
+		  (rng_below (&m->rng, NUM_FRUIT_TYPES) + 1) * MAZE_FRUIT_1);
+    set_maze_bit (m, PLANE_FRUIT, x, y, 1);
 
     /* Update the number of fruits. */
-    ++n_fruits;
+    SHARED_STORE (&m->n_fruits, m->n_fruits + 1);
 
     /* If necessary, draw the fruit on the screen. */
     if (show)
-	draw_full_block (x * BLOCK_X_DIM, y * BLOCK_Y_DIM, find_block (x, y));
+	(*redraw_fn) (x, y);
 }
 
 
@@ -742,7 +2445,8 @@ _add_a_fruit (int show)
  *   DESCRIPTION: Add a fruit to a random (odd,odd) lattice point in the
  *                maze.  Update the number of fruits, including the displayed
  *                value.  Draw the new fruit on the screen.  If the new fruit
- *                is the only one in the maze, erase the maze exit.
+ *                is the only one in the maze, erase the maze exit.  Does
+ *                nothing if every point holds fruit already.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: the number of fruits in the maze (after addition)
@@ -751,16 +2455,17 @@ _add_a_fruit (int show)
 int
 add_a_fruit ()
 {
+    maze_ctx_t* m = cur_maze;
+
     /* Most of the work is done by a helper function. */
-    _add_a_fruit (1);
+    _add_a_fruit (m, 1);
 
     /* The exit may disappear. */
-    if (n_fruits == 1)
-	draw_full_block (exit_x * BLOCK_X_DIM, exit_y * BLOCK_Y_DIM, 
-			 find_block (exit_x, exit_y));
+    if (m->n_fruits == 1 && m->exit_y != -1)
+	(*redraw_fn) (m->exit_x, m->exit_y);
 
     /* Return the current number of fruits in the maze. */
-    return n_fruits;
+    return m->n_fruits;
 }
 
 /* 
@@ -773,9 +2478,11 @@ add_a_fruit ()
 int
 get_fruit_num ()
 {
+    maze_ctx_t* m = cur_maze;
+
 
     /* Return the current number of fruits in the maze. */
-    return n_fruits;
+    return m->n_fruits;
 }
 
 /* 
@@ -783,19 +2490,19 @@ get_fruit_num ()
  *   DESCRIPTION: Add a fruit to a random (odd,odd) lattice point in the
  *                maze.  Update the number of fruits, including the displayed
  *                value.
- *   INPUTS: none
+ *   INPUTS: m -- the maze context
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: changes displayed fruit value
  */
 static void
-add_a_fruit_internal ()
+add_a_fruit_internal (maze_ctx_t* m)
 {
     /* 
      * Call a helper function, indicating that fruit should not be drawn 
      * on the screen at this point.
      */
-    _add_a_fruit (0);
+    _add_a_fruit (m, 0);
 }
 
 
@@ -840,7 +2547,8 @@ get_player_mask (dir_t cur_dir)
 /* 
  * find_open_directions
  *   DESCRIPTION: Determine which directions are open to movement from a 
- *   	 	  given maze point.
+ *   	 	  given maze point.  The way up is closed above the rows
+ *   	 	  that may be shown.
  *   INPUTS: (x,y) -- lattice point of interest in maze
  *   OUTPUTS: open[] -- array of boolean values indicating that a direction
  *   		        is open; indexed by DIR_* enumeration values 
@@ -850,10 +2558,45 @@ get_player_mask (dir_t cur_dir)
 void 
 find_open_directions (int x, int y, int op[NUM_DIRS])
 {
-    op[DIR_UP]    = (0 == (maze[MAZE_INDEX (x, y - 1)] & MAZE_WALL));
-    op[DIR_RIGHT] = (0 == (maze[MAZE_INDEX (x + 1, y)] & MAZE_WALL));
-    op[DIR_DOWN]  = (0 == (maze[MAZE_INDEX (x, y + 1)] & MAZE_WALL));
-    op[DIR_LEFT]  = (0 == (maze[MAZE_INDEX (x - 1, y)] & MAZE_WALL));
+    maze_ctx_t* m = cur_maze;
+
+    op[DIR_UP]    = (!get_maze_bit (m, PLANE_WALL, x, y - 1) &&
+		     y - 2 > m->maze_top);
+    op[DIR_RIGHT] = !get_maze_bit (m, PLANE_WALL, x + 1, y);
+    op[DIR_DOWN]  = !get_maze_bit (m, PLANE_WALL, x, y + 1);
+    op[DIR_LEFT]  = !get_maze_bit (m, PLANE_WALL, x - 1, y);
+}
+
+
+/* 
+ * count_unveiled
+ *   DESCRIPTION: Count the unveiled lattice points in a rectangle of the
+ *                maze, 64 points of a row at a time.
+ *   INPUTS: (x0,y0) -- upper left corner of the rectangle
+ *           (x1,y1) -- lower right corner of the rectangle
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of points in the rectangle, clipped to the
+ *                 maze (or to the rows kept of an endless maze), that
+ *                 have been unveiled
+ *   SIDE EFFECTS: none
+ */
+int
+count_unveiled (int x0, int y0, int x1, int y1)
+{
+    maze_ctx_t* m = cur_maze;
+    int y, n;
+
+    if (x0 < 0)
+	x0 = 0;
+    if (x1 > 2 * m->maze_x_dim - 1)
+	x1 = 2 * m->maze_x_dim - 1;
+    if (y0 < m->maze_top)
+	y0 = m->maze_top;
+    if (y1 > m->maze_made - 2)
+	y1 = m->maze_made - 2;
+    for (n = 0, y = y0; x0 <= x1 && y <= y1; y++)
+	n += count_bits (m, PLANE_REACH, x0, x1, y);
+    return n;
 }
 
 
@@ -875,23 +2618,24 @@ find_open_directions (int x, int y, int op[NUM_DIRS])
 void
 print_maze ()
 {
+    maze_ctx_t* m = cur_maze;
     int i;  /* vertical loop index   */
     int j;  /* horizontal loop index */
 
     /* Loop over maze rows. */
-    for (i = 0; i <= 2 * maze_y_dim; i++) {
+    for (i = 0; i <= 2 * m->maze_y_dim; i++) {
 
         /* Loop over maze columns. */
-	for (j = 0; j <= 2 * maze_x_dim; j++) {
+	for (j = 0; j <= 2 * m->maze_x_dim; j++) {
 
 	    /* 
 	     * Print open spaces and walls, reached and unreached, as
 	     * distinct characters.
 	     */
 	    printf ("%c", 
-	            ((maze[MAZE_INDEX (j, i)] & MAZE_WALL) ? 
-		      ((maze[MAZE_INDEX (j, i)] & MAZE_REACH) ? '*' : '%') :
-		      ((maze[MAZE_INDEX (j, i)] & MAZE_REACH) ? '.' : ' ')));
+	            ((m->maze[MAZE_INDEX (j, i)] & MAZE_WALL) ? 
+		      ((m->maze[MAZE_INDEX (j, i)] & MAZE_REACH) ? '*' : '%') :
+		      ((m->maze[MAZE_INDEX (j, i)] & MAZE_REACH) ? '.' : ' ')));
 	}
 
 	/* End the printed line. */
@@ -904,7 +2648,7 @@ print_maze ()
  * This function is called in maze generation.  We define a stub to keep
  * the linker happy.
  */
-static void add_a_fruit_internal () {}
+static void add_a_fruit_internal (maze_ctx_t* m) {}
 
 
 /* 
@@ -37,6 +37,9 @@
 #define MAZE_H
 
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "blocks.h"
 #include "modex.h"
 
@@ -47,7 +50,9 @@
  * Define maze minimum and maximum dimensions.  The description of make_maze
  * in maze.c gives details on the layout of the maze.  Minimum values are
  * chosen to ensure that a maze fills the scrolling region of the screen.
- * Maximum values are somewhat arbitrary.
+ * Maximum values are somewhat arbitrary, and bound only the mazes of the
+ * game's levels; make_maze accepts any size up to MAZE_LIMIT_DIM in each
+ * dimension (memory permitting), which keeps lattice indices in an int.
  */
 #define MAZE_MIN_X_DIM \
     ((SCROLL_X_DIM + (BLOCK_X_DIM - 1) + 2 * SHOW_MIN) / (2 * BLOCK_X_DIM))
@@ -55,6 +60,13 @@
 #define MAZE_MIN_Y_DIM \
     ((SCROLL_Y_DIM + (BLOCK_Y_DIM - 1) + 2 * SHOW_MIN) / (2 * BLOCK_Y_DIM))
 #define MAZE_MAX_Y_DIM 30
+#define MAZE_LIMIT_DIM 16384
+
+/*
+ * height counted for an endless maze, in squares; as far down as pixel
+ * coordinates fit in an int
+ */
+#define MAZE_ENDLESS_Y_DIM 80000000
 
 
 /* bit vector of properties for spaces in the maze */
@@ -70,15 +82,118 @@ typedef enum {
 } maze_bit_t;
 
 
+/* a fruit in a saved maze */
+typedef struct {
+    uint32_t x, y;   /* lattice point, (odd,odd)            */
+    uint32_t fruit;  /* fruit number, 1 to NUM_FRUIT_TYPES  */
+} maze_fruit_t;
+
+/*
+ * A maze as saved in a level pack (see levelpack.h).  The walls are the
+ * maze's wall bitboard: for each lattice row from -1 to 2 y_dim + 3, the
+ * points of the row in (2 x_dim + 63) / 64 64-bit words, point x in bit
+ * x % 64 of word x / 64 (see maze_wall_words).
+ */
+typedef struct {
+    int x_dim, y_dim;            /* size of the maze, in squares  */
+    int exit_x, exit_y;          /* lattice point of the exit     */
+    uint64_t seed;               /* seed the maze was made from   */
+    const uint64_t* walls;       /* the wall bitboard             */
+    size_t wall_words;           /* 64-bit words in it            */
+    const maze_fruit_t* fruits;  /* the fruits in the maze        */
+    int n_fruits;
+} maze_saved_t;
+
+/* statistics about the generation of a maze */
+typedef struct {
+    int regions;        /* regions dug by the worms, before joining */
+    int walls_removed;  /* walls knocked down to join them          */
+} maze_stats_t;
+
+/*
+ * A maze context holds a maze and its state.  The functions below that
+ * take no context work on the current one, which the game plays and draws;
+ * another context may be built at the same time by another thread, and
+ * then made current.
+ */
+typedef struct maze_ctx maze_ctx_t;
+
+/* create an empty maze context; returns NULL if memory runs out */
+extern maze_ctx_t* new_maze ();
+
+/* free a maze context made by new_maze (not the current one) */
+extern void free_maze (maze_ctx_t* m);
+
+/* make a maze context current; returns the one that was */
+extern maze_ctx_t* use_maze (maze_ctx_t* m);
+
 /* create a maze and place some fruits inside it */
 extern int make_maze (int x_dim, int y_dim, int start_fruits);
 
+/* ...in a given context */
+extern int build_maze (maze_ctx_t* m, int x_dim, int y_dim, int start_fruits);
+
+/* get the 64-bit words in the saved walls of a maze of a given size */
+extern size_t maze_wall_words (int x_dim, int y_dim);
+
+/*
+ * save a maze context's maze; the walls stay in the context, and the
+ * fruits are in space allocated for them, which the caller frees
+ */
+extern int save_maze (maze_ctx_t* m, maze_saved_t* s);
+
+/* put a saved maze in a maze context, using its walls where they are */
+extern int load_maze (maze_ctx_t* m, const maze_saved_t* s);
+
+/* set the threads used to make a large maze (0, the default: one per CPU) */
+extern void set_maze_threads (int n);
+
+/* start a maze that is made row by row as the view moves down */
+extern int make_endless_maze (int x_dim, int start_fruits);
+
+/* ...in a given context */
+extern int build_endless_maze (maze_ctx_t* m, int x_dim, int start_fruits);
+
+/* make the rows of an endless maze down to lattice row y */
+extern void extend_maze (int y);
+
+/* get the first lattice row that may be shown (0 unless endless) */
+extern int get_maze_top ();
+
+/* get statistics about the generation of the last maze */
+extern void get_maze_stats (maze_stats_t* ms);
+
+/* ...of a given context */
+extern void read_maze_stats (maze_ctx_t* m, maze_stats_t* ms);
+
+/*
+ * set the worm turn weights used to make mazes, by relative direction
+ * (turns clockwise from straight on) and by whether the space moved to
+ * is open (0) or a wall (1); returns -1 unless each is from 1 to 2^20
+ */
+extern int set_turn_weights (const int wt[4][2]);
+
+/* get the worm turn weights */
+extern void get_turn_weights (int wt[4][2]);
+
 /* fill a buffer with the pixels for a horizontal line of the maze */
 extern void fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM]);
 
 /* fill a buffer with the pixels for a vertical line of the maze */
 extern void fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM]);
 
+/*
+ * draw the view window with upper left pixel (x,y) of a maze context into
+ * an image of SCROLL_Y_DIM lines of SCROLL_X_DIM pixels
+ */
+extern void render_maze_view (maze_ctx_t* m, int x, int y, unsigned char* img);
+
+/* draw a maze location into the build buffer */
+extern void draw_space (int x, int y);
+
+/* choose how changed maze locations are drawn (NULL: draw_space at once) */
+extern void set_redraw_fn (void (*fn) (int x, int y));
+
 /* mark a maze location as reached and draw it onto the screen if necessary */
 extern void unveil_space (int x, int y);
 
@@ -103,4 +218,7 @@ extern unsigned char* get_player_mask (dir_t cur_dir);
 /* determine which directions are open to movement from a given maze point */
 extern void find_open_directions (int x, int y, int op[NUM_DIRS]);
 
+/* count the unveiled maze locations in a rectangle of lattice points */
+extern int count_unveiled (int x0, int y0, int x1, int y1);
+
 #endif /* MAZE_H */
@@ -36,13 +36,23 @@
 #include <sys/time.h>
 
 #include "blocks.h"
+#include "feeder.h"
+#include "kernels.h"
+#include "latency.h"
+#include "levelpack.h"
+#include "lockprof.h"
 #include "maze.h"
 #include "modex.h"
+#include "monotime.h"
+#include "reactor.h"
+#include "telemetry.h"
 #include "text.h"
+#include "ticksrc.h"
+#include "trace.h"
+#include "wheel.h"
 #include "module/tuxctl-ioctl.h"
 
 // New Includes and Defines
-#include <linux/rtc.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -53,14 +63,9 @@
 #include <termios.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 
-#define BACKQUOTE 96
-#define UP 65
-#define DOWN 66
-#define RIGHT 67
-#define LEFT 68
-
 #define APPLE 1
 #define GRAPE 2
 #define PEACH 3
@@ -89,6 +94,10 @@ static int sanity_check ();
 /* a few constants */
 #define PAN_BORDER      5  /* pan when border in maze squares reaches 5    */
 #define MAX_LEVEL      10  /* maximum level number                         */
+#define MAX_STEPS       8  /* simulation steps run for one wakeup, at most */
+#define LABEL_USEC 5000000 /* how long an eaten fruit's name floats        */
+#define PLAYER_CORE 0x20   /* color of the core of the player, which glows */
+#define RENDER_USEC_DEFAULT 14286 /* render period if no retrace was seen */
 
 /* outcome of each level, and of the game as a whole */
 typedef enum {GAME_WON, GAME_LOST, GAME_QUIT} game_condition_t;
@@ -100,8 +109,8 @@ typedef struct {
     int number;                  /* starts at 1...                   */
     int maze_x_dim, maze_y_dim;  /* min to max, in steps of 2        */
     int initial_fruit_count;     /* 1 to 6, in steps of 1/2          */
-    int time_to_first_fruit;     /* 300 to 120, in steps of -30      */
-    int time_between_fruits;     /* 300 to 60, in steps of -30       */
+    int time_to_first_fruit;     /* 300 to 120 s, in steps of -30    */
+    int time_between_fruits;     /* 300 to 60 s, in steps of -30     */
     int tick_usec;		 /* 20000 to 5000, in steps of -1750 */
     
     /* dynamic values within a level -- you may want to add more... */
@@ -110,80 +119,403 @@ typedef struct {
 
 static game_info_t game_info;
 
+/* maze size of every level for an endurance run, or 0 to grow by level */
+static int endurance_x_dim = 0, endurance_y_dim = 0;
+
+/* 1 to play in endless mazes, made row by row on the way down */
+static int endless = 0;
+
+/* the levels to play, if taken from a level pack, and the last of them */
+static const level_pack_t* level_pack = NULL;
+static int last_level = MAX_LEVEL;
+
+
+/*
+ * A level's maze is made in one of two maze contexts (see maze.h), along
+ * with an image of its first view window.  While a level is played in one,
+ * the pregen thread makes the next level in the other, so that starting
+ * the next level is only a matter of making that context current, and the
+ * render thread need only copy the image rather than draw each line.
+ */
+typedef struct {
+    maze_ctx_t* maze;       /* the maze context                          */
+    unsigned char* view;    /* image of the first view window, or NULL   */
+    int view_ok;            /* 1 if the image shows the maze made        */
+    int status;             /* 0 if the maze was made, -1 if not         */
+    long long gen_usec;     /* time taken to make it (and the image)     */
+} level_slot_t;
+
+static level_slot_t level_slot[2];
+static int cur_slot = 0;           /* slot of the level being played     */
+
+static pthread_t pregen_tid;
+static int pregen_on = 0;          /* the pregen thread is running       */
+static pthread_mutex_t pregen_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pregen_cv = PTHREAD_COND_INITIALIZER;
+static int pregen_level = 0;       /* level asked for, in the other slot */
+static int pregen_done = 0;        /* 1 once it has been made            */
+static int pregen_quit = 0;        /* the pregen thread should end       */
+
 
 /* local functions--see function headers for details */
+static void set_level_params (int level, game_info_t* info);
+static int save_level_pack (const char* path);
+static int make_level_maze (level_slot_t* slot, const game_info_t* info,
+			    int with_view);
 static int prepare_maze_level (int level);
+static void start_pregen ();
+static void stop_pregen ();
+static void pregen_next_level (int level);
+static void* pregen_thread (void* arg);
 static void move_up (int* ypos);
 static void move_right (int* xpos);
 static void move_down (int* ypos);
 static void move_left (int* xpos);
 static int unveil_around_player (int play_x, int play_y);
+static void mark_dirty (int x, int y);
+static void wait_for_render ();
+static void draw_view (int map_x, int map_y);
+static void pan_view (int old_x, int old_y, int new_x, int new_y);
+static void compose_player (unsigned char* buf, const unsigned char* floor,
+			    dir_t cur_dir, int glow);
+static void start_level_clock ();
+static int advance_level_clock (int n);
+static unsigned long step_at (long long usec);
+static void next_second (wheel_event_t* ev);
+static void add_timed_fruit (wheel_event_t* ev);
+static void show_fruit_label (int fruit);
+static void hide_fruit_label (wheel_event_t* ev);
 static void *rtc_thread(void *arg);
-static void *keyboard_thread(void *arg);
-static void *tux_thread(void *arg);
+static void *render_thread(void *arg);
+static dir_t sample_tux();
+static void queue_turn(int d);
+static void drop_turn();
+static int wait_for_ticks();
 
 /* 
- * prepare_maze_level
- *   DESCRIPTION: Prepare for a maze of a given level.  Fills the game_info
- *		  structure, creates a maze, and initializes the display.
+ * set_level_params
+ *   DESCRIPTION: Fill a game_info structure with the parameters of a
+ *		  given level, from the level pack if one is played.
  *   INPUTS: level -- level to be used for selecting parameter values
- *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, -1 on failure
- *   SIDE EFFECTS: writes entire game_info structure; changes maze;
- *                 initializes display
+ *   OUTPUTS: info -- the entire structure
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
  */
-static int
-prepare_maze_level (int level)
+static void
+set_level_params (int level, game_info_t* info)
 {
-    int i; /* loop index for drawing display */
-    
+    const pack_level_t* lev;
+
+    /* Take the parameters of a level from the level pack, if any. */
+    if (level_pack != NULL &&
+	(lev = find_pack_level (level_pack, level)) != NULL) {
+	info->number = level;
+	info->maze_x_dim = lev->x_dim;
+	info->maze_y_dim = lev->y_dim;
+	info->initial_fruit_count = lev->initial_fruit_count;
+	info->time_to_first_fruit = lev->time_to_first_fruit;
+	info->time_between_fruits = lev->time_between_fruits;
+	info->tick_usec = lev->tick_usec;
+	info->map_x = info->map_y = SHOW_MIN;
+	return;
+    }
+
     /*
      * Record level in game_info; other calculations use offset from
      * level 1.
      */
-    game_info.number = level--;
+    info->number = level--;
 
     /* Set per-level parameter values. */
-    if ((game_info.maze_x_dim = MAZE_MIN_X_DIM + 2 * level) >
-	MAZE_MAX_X_DIM)
-	game_info.maze_x_dim = MAZE_MAX_X_DIM;
-    if ((game_info.maze_y_dim = MAZE_MIN_Y_DIM + 2 * level) >
-	MAZE_MAX_Y_DIM)
-	game_info.maze_y_dim = MAZE_MAX_Y_DIM;
-    if ((game_info.initial_fruit_count = 1 + level / 2) > 6)
-	game_info.initial_fruit_count = 6;
-    if ((game_info.time_to_first_fruit = 300 - 30 * level) < 120)
-	game_info.time_to_first_fruit = 120;
-    if ((game_info.time_between_fruits = 300 - 60 * level) < 60)
-	game_info.time_between_fruits = 60;
-    if ((game_info.tick_usec = 20000 - 1750 * level) < 5000)
-	game_info.tick_usec = 5000;
+    if ((info->maze_x_dim = MAZE_MIN_X_DIM + 2 * level) > MAZE_MAX_X_DIM)
+	info->maze_x_dim = MAZE_MAX_X_DIM;
+    if ((info->maze_y_dim = MAZE_MIN_Y_DIM + 2 * level) > MAZE_MAX_Y_DIM)
+	info->maze_y_dim = MAZE_MAX_Y_DIM;
+    if (endurance_x_dim != 0) {
+	info->maze_x_dim = endurance_x_dim;
+	info->maze_y_dim = endurance_y_dim;
+    }
+    if (endless)
+	info->maze_y_dim = MAZE_ENDLESS_Y_DIM;
+    if ((info->initial_fruit_count = 1 + level / 2) > 6)
+	info->initial_fruit_count = 6;
+    if ((info->time_to_first_fruit = 300 - 30 * level) < 120)
+	info->time_to_first_fruit = 120;
+    if ((info->time_between_fruits = 300 - 60 * level) < 60)
+	info->time_between_fruits = 60;
+    if ((info->tick_usec = 20000 - 1750 * level) < 5000)
+	info->tick_usec = 5000;
 
     /* Initialize dynamic values. */
-    game_info.map_x = game_info.map_y = SHOW_MIN;
+    info->map_x = info->map_y = SHOW_MIN;
+}
+
 
-    /* Create a maze. */
-    if (make_maze (game_info.maze_x_dim, game_info.maze_y_dim,
-		   game_info.initial_fruit_count) != 0)
+/* 
+ * make_level_maze
+ *   DESCRIPTION: Create the maze of a level in a slot's context, which
+ *		  need not be current, or load it from the level pack, and
+ *		  optionally make an image of the level's first view window.
+ *   INPUTS: slot -- the slot
+ *	     info -- the level's parameters
+ *	     with_view -- 1 to make the image, if the slot has room for it
+ *   OUTPUTS: slot -- status, view_ok and gen_usec set
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: changes the slot's maze
+ */
+static int
+make_level_maze (level_slot_t* slot, const game_info_t* info, int with_view)
+{
+    long long start = now_usec ();
+    const pack_level_t* lev;
+
+    slot->view_ok = 0;
+    if (level_pack != NULL)
+	slot->status = ((lev = find_pack_level (level_pack,
+						info->number)) == NULL ? -1 :
+			load_pack_level (slot->maze, level_pack, lev));
+    else if (endless)
+	slot->status = build_endless_maze (slot->maze, info->maze_x_dim,
+					   info->initial_fruit_count);
+    else
+	slot->status = build_maze (slot->maze, info->maze_x_dim,
+				   info->maze_y_dim,
+				   info->initial_fruit_count);
+    if (slot->status == 0 && with_view && slot->view != NULL) {
+	render_maze_view (slot->maze, info->map_x, info->map_y, slot->view);
+	slot->view_ok = 1;
+    }
+    slot->gen_usec = now_usec () - start;
+    return slot->status;
+}
+
+
+/* 
+ * save_level_pack
+ *   DESCRIPTION: Make the maze of every level as it would be made for
+ *		  play, and write the mazes with the levels' parameters to
+ *		  a level pack.
+ *   INPUTS: path -- the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int
+save_level_pack (const char* path)
+{
+    game_info_t info;
+    pack_level_t lev;
+    pack_writer_t* w;
+    maze_ctx_t* m;
+    int level, rval;
+
+    if (endless) {
+	fprintf (stderr, "%s: endless mazes cannot be saved\n", path);
 	return -1;
-    
-    /* Set logical view and draw initial screen. */
-    set_view_window (game_info.map_x, game_info.map_y);
-    for (i = 0; i < SCROLL_Y_DIM; i++)
-	(void)draw_horiz_line (i);
+    }
+    if ((m = new_maze ()) == NULL)
+	return -1;
+    if ((w = start_level_pack (path, MAX_LEVEL)) == NULL) {
+	free_maze (m);
+	return -1;
+    }
+    for (level = 1; level <= MAX_LEVEL; level++) {
+	set_level_params (level, &info);
+	memset (&lev, 0, sizeof (lev));
+	lev.number = info.number;
+	lev.initial_fruit_count = info.initial_fruit_count;
+	lev.time_to_first_fruit = info.time_to_first_fruit;
+	lev.time_between_fruits = info.time_between_fruits;
+	lev.tick_usec = info.tick_usec;
+	if (build_maze (m, info.maze_x_dim, info.maze_y_dim,
+			info.initial_fruit_count) != 0 ||
+	    add_pack_level (w, &lev, m) != 0)
+	    break;
+    }
+    rval = finish_level_pack (w);
+    free_maze (m);
+    return rval;
+}
+
+
+/* 
+ * prepare_maze_level
+ *   DESCRIPTION: Prepare for a maze of a given level.  Fills the game_info
+ *		  structure and makes the level's maze current, taking it
+ *		  from the pregen thread if that thread was asked for it
+ *		  (waiting if it is not yet done), or creating it if not.
+ *		  Must follow wait_for_render.
+ *   INPUTS: level -- level to be used for selecting parameter values
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: writes entire game_info structure; changes cur_slot and
+ *		   the current maze
+ */
+static int
+prepare_maze_level (int level)
+{
+    LOCK_SITE (site, "prepare_maze_level");
+    int made = 0;
+
+    set_level_params (level, &game_info);
+
+    /* Take the maze from the pregen thread if it is making it. */
+    if (pregen_on) {
+	(void)site_lock (&pregen_lock, &site);
+	if (pregen_level == level) {
+	    while (!pregen_done)
+		site_cond_wait (&pregen_cv, &pregen_lock, &site);
+	    cur_slot ^= 1;
+	    pregen_level = 0;
+	    made = 1;
+	}
+	site_unlock (&pregen_lock, &site);
+    }
+
+    /* 
+     * Otherwise create it here.  The render thread draws the initial
+     * screen for the new level, so no image is needed.
+     */
+    if (!made) {
+	if (level_slot[cur_slot].maze == NULL ||
+	    make_level_maze (&level_slot[cur_slot], &game_info, 0) != 0)
+	    return -1;
+    }
+    if (level_slot[cur_slot].status != 0)
+	return -1;
+    (void)use_maze (level_slot[cur_slot].maze);
 
     /* Return success. */
     return 0;
 }
 
 
+/* 
+ * start_pregen
+ *   DESCRIPTION: Create the maze contexts of the level slots, and start
+ *		  the pregen thread.  Without the thread (or room for the
+ *		  images), levels are made when they start, in the first
+ *		  slot's context; if that cannot be created,
+ *		  prepare_maze_level fails.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+start_pregen ()
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+	level_slot[i].maze = new_maze ();
+	level_slot[i].view = malloc (SCROLL_X_DIM * SCROLL_Y_DIM);
+	if (level_slot[i].maze == NULL || level_slot[i].view == NULL)
+	    return;
+    }
+    pregen_on = (pthread_create (&pregen_tid, NULL, pregen_thread,
+				 NULL) == 0);
+}
+
+
+/* 
+ * stop_pregen
+ *   DESCRIPTION: Stop the pregen thread, waiting for it to finish any
+ *		  maze it is making.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+stop_pregen ()
+{
+    LOCK_SITE (site, "stop_pregen");
+
+    if (!pregen_on)
+	return;
+    (void)site_lock (&pregen_lock, &site);
+    pregen_quit = 1;
+    (void)pthread_cond_broadcast (&pregen_cv);
+    site_unlock (&pregen_lock, &site);
+    (void)pthread_join (pregen_tid, NULL);
+    pregen_on = 0;
+}
+
+
+/* 
+ * pregen_next_level
+ *   DESCRIPTION: Ask the pregen thread to make a level in the slot not
+ *		  being played.  Must follow prepare_maze_level, which takes
+ *		  the level made.
+ *   INPUTS: level -- the level
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+pregen_next_level (int level)
+{
+    LOCK_SITE (site, "pregen_next_level");
+
+    if (!pregen_on || level > last_level)
+	return;
+    (void)site_lock (&pregen_lock, &site);
+    pregen_level = level;
+    pregen_done = 0;
+    (void)pthread_cond_broadcast (&pregen_cv);
+    site_unlock (&pregen_lock, &site);
+}
+
+
+/* 
+ * pregen_thread
+ *   DESCRIPTION: Thread that makes the level asked for by
+ *		  pregen_next_level, with the image of its first view
+ *		  window, while the logic thread plays the current level.
+ *   INPUTS: arg -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: changes the maze and image of the slot not being played
+ */
+static void*
+pregen_thread (void* arg)
+{
+    LOCK_SITE (site, "pregen_thread");
+    game_info_t info;
+    level_slot_t* slot;
+    int level;
+
+    trace_thread ("pregen");
+    (void)site_lock (&pregen_lock, &site);
+    while (!pregen_quit) {
+	if (pregen_level == 0 || pregen_done) {
+	    site_cond_wait (&pregen_cv, &pregen_lock, &site);
+	    continue;
+	}
+	level = pregen_level;
+	slot = &level_slot[cur_slot ^ 1];
+	site_unlock (&pregen_lock, &site);
+
+	set_level_params (level, &info);
+	(void)make_level_maze (slot, &info, 1);
+
+	(void)site_lock (&pregen_lock, &site);
+	pregen_done = 1;
+	(void)pthread_cond_broadcast (&pregen_cv);
+    }
+    site_unlock (&pregen_lock, &site);
+    return NULL;
+}
+
+
 /* 
  * move_up
  *   DESCRIPTION: Move the player up one pixel (assumed to be a legal move)
  *   INPUTS: ypos -- pointer to player's y position (pixel) in the maze
  *   OUTPUTS: *ypos -- reduced by one from initial value
  *   RETURN VALUE: none
- *   SIDE EFFECTS: pans display by one pixel when appropriate
+ *   SIDE EFFECTS: pans view window by one pixel when appropriate
  */
 static void
 move_up (int* ypos)
@@ -191,16 +523,16 @@ move_up (int* ypos)
     /*
      * Move player by one pixel and check whether display should be panned.
      * Panning is necessary when the player moves past the upper pan border
-     * while the top pixels of the maze are not on-screen.
+     * while the top pixels of the maze (or of the rows of an endless maze
+     * still kept) are not on-screen.
      */
     if (--(*ypos) < game_info.map_y + BLOCK_Y_DIM * PAN_BORDER && 
-	game_info.map_y > SHOW_MIN) {
+	game_info.map_y > get_maze_top () * BLOCK_Y_DIM + SHOW_MIN) {
 	/*
-	 * Shift the logical view upwards by one pixel and draw the
-	 * new line.
+	 * Shift the logical view upwards by one pixel; the render thread
+	 * draws the new line.
 	 */
-	set_view_window (game_info.map_x, --game_info.map_y);
-	(void)draw_horiz_line (0);
+	--game_info.map_y;
     }
 }
 
@@ -211,7 +543,7 @@ move_up (int* ypos)
  *   INPUTS: xpos -- pointer to player's x position (pixel) in the maze
  *   OUTPUTS: *xpos -- increased by one from initial value
  *   RETURN VALUE: none
- *   SIDE EFFECTS: pans display by one pixel when appropriate
+ *   SIDE EFFECTS: pans view window by one pixel when appropriate
  */
 static void
 move_right (int* xpos)
@@ -226,11 +558,10 @@ move_right (int* xpos)
 	game_info.map_x + SCROLL_X_DIM < 
 	    (2 * game_info.maze_x_dim + 1) * BLOCK_X_DIM - SHOW_MIN) {
 	/*
-	 * Shift the logical view to the right by one pixel and draw the
-	 * new line.
+	 * Shift the logical view to the right by one pixel; the render
+	 * thread draws the new line.
 	 */
-	set_view_window (++game_info.map_x, game_info.map_y);
-	(void)draw_vert_line (SCROLL_X_DIM - 1);
+	++game_info.map_x;
     }
 }
 
@@ -241,7 +572,7 @@ move_right (int* xpos)
  *   INPUTS: ypos -- pointer to player's y position (pixel) in the maze
  *   OUTPUTS: *ypos -- increased by one from initial value
  *   RETURN VALUE: none
- *   SIDE EFFECTS: pans display by one pixel when appropriate
+ *   SIDE EFFECTS: pans view window by one pixel when appropriate
  */
 static void
 move_down (int* ypos)
@@ -256,11 +587,12 @@ move_down (int* ypos)
 	game_info.map_y + SCROLL_Y_DIM < 
 	    (2 * game_info.maze_y_dim + 1) * BLOCK_Y_DIM - SHOW_MIN) {
 	/*
-	 * Shift the logical view downwards by one pixel and draw the
-	 * new line.
+	 * Shift the logical view downwards by one pixel, making the rows
+	 * of an endless maze that come into view; the render thread
+	 * draws the new line.
 	 */
-	set_view_window (game_info.map_x, ++game_info.map_y);
-	(void)draw_horiz_line (SCROLL_Y_DIM - 1);
+	++game_info.map_y;
+	extend_maze ((game_info.map_y + SCROLL_Y_DIM) / BLOCK_Y_DIM);
     }
 }
 
@@ -271,7 +603,7 @@ move_down (int* ypos)
  *   INPUTS: xpos -- pointer to player's x position (pixel) in the maze
  *   OUTPUTS: *xpos -- decreased by one from initial value
  *   RETURN VALUE: none
- *   SIDE EFFECTS: pans display by one pixel when appropriate
+ *   SIDE EFFECTS: pans view window by one pixel when appropriate
  */
 static void
 move_left (int* xpos)
@@ -284,11 +616,10 @@ move_left (int* xpos)
     if (--(*xpos) < game_info.map_x + BLOCK_X_DIM * PAN_BORDER && 
 	game_info.map_x > SHOW_MIN) {
 	/*
-	 * Shift the logical view to the left by one pixel and draw the
-	 * new line.
+	 * Shift the logical view to the left by one pixel; the render
+	 * thread draws the new line.
 	 */
-	set_view_window (--game_info.map_x, game_info.map_y);
-	(void)draw_vert_line (0);
+	--game_info.map_x;
     }
 }
 
@@ -330,6 +661,37 @@ unveil_around_player (int play_x, int play_y)
 }
 
 
+/* 
+ * compose_player
+ *   DESCRIPTION: Draw the player over a saved floor block.  The player's
+ *                mask selects between the player image and the floor
+ *                (with the blend kernel), and the core of the player may
+ *                be recolored to make it glow.
+ *   INPUTS: floor -- floor pixels under the player
+ *           cur_dir -- direction of the player image to use
+ *           glow -- color for the core of the player, or -1 to keep it
+ *   OUTPUTS: buf -- the composed block
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+compose_player (unsigned char* buf, const unsigned char* floor,
+		dir_t cur_dir, int glow)
+{
+    unsigned char glowing[BLOCK_X_DIM * BLOCK_Y_DIM]; /* recolored image */
+    unsigned char* blk = get_player_block (cur_dir);  /* player image    */
+    int i;                                            /* pixel index     */
+
+    if (glow >= 0) {
+	for (i = 0; i < BLOCK_X_DIM * BLOCK_Y_DIM; i++)
+	    glowing[i] = (blk[i] == PLAYER_CORE ? glow : blk[i]);
+	blk = glowing;
+    }
+    (*kernels.blend) (buf, get_player_mask (cur_dir), blk, floor,
+		      BLOCK_X_DIM * BLOCK_Y_DIM);
+}
+
+
 #if !defined(NDEBUG)
 /* 
  * sanity_check 
@@ -359,139 +721,520 @@ sanity_check ()
 // Shared Global Variables
 int quit_flag = 0;
 int winner= 0;
-int next_dir = UP;
+int next_dir = DIR_UP;
 int play_x, play_y, last_dir, dir;
 int move_cnt = 0;
-int fd, fd_tux;
-unsigned long data;
+int fd_tux;
+static tick_source_t ticks;
 static struct termios tio_orig;
-static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static int key_tty = 0;   /* keyboard is a terminal whose settings we changed */
+
+
+/*
+ * sample_tux
+ *   DESCRIPTION: Read the direction pressed on the tux controller; called
+ *		  by the input reactor each time clock ticks arrive
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: direction pressed, or DIR_STOP if none (or several)
+ *   SIDE EFFECTS: none
+ */
+static dir_t sample_tux()
+{
+	unsigned long button;
+
+	//get the button status from controller
+	if (ioctl(fd_tux, TUX_BUTTONS, &button) != 0)
+		return DIR_STOP;
+
+	switch(button)
+	{
+		case MOVE_UP:
+			return DIR_UP;
+		case MOVE_DOWN:
+			return DIR_DOWN;
+		case MOVE_RIGHT:
+			return DIR_RIGHT;
+		case MOVE_LEFT:
+			return DIR_LEFT;
+	}
+	return DIR_STOP;
+}
+
+/* turns chosen by the player but not yet taken; see queue_turn */
+#define MAX_TURNS 4
+static int turns[MAX_TURNS];
+static int num_turns = 0;
+
+/* how long input commands waited before a tick handled them */
+static unsigned long input_cmds[NUM_INPUT_SOURCES];
+static long long input_wait_usec[NUM_INPUT_SOURCES];
+static long long input_max_usec[NUM_INPUT_SOURCES];
+
+/* some stats about how often we take longer than a single timer tick */
+static int goodcount = 0;
+static int badcount = 0;
+
+/*
+ * The level clock, kept by the logic thread.  Each clock tick stands for
+ * ticks.period_usec of game time; the simulation takes one step for each
+ * game_info.tick_usec of game time.  Timed events (the level timer, new
+ * fruit, and the end of a fruit's floating name) wait on a timing wheel
+ * turned by the steps, so each step does only the work due then, and
+ * events keep to game time however the ticks are delivered.
+ */
+static long long clock_usec;      /* game time elapsed in the level    */
+static long long step_usec;       /* game time simulated so far        */
+static unsigned long level_step;  /* value of sim_ticks at level start */
+static wheel_t events;            /* timed events, by simulation step  */
+static wheel_event_t second_event = WHEEL_EVENT (next_second);
+static wheel_event_t fruit_event = WHEEL_EVENT (add_timed_fruit);
+static wheel_event_t label_event = WHEEL_EVENT (hide_fruit_label);
+static long long fruit_usec;      /* game time of the next new fruit   */
+static int seconds;               /* whole seconds simulated           */
+static int fruit_label = 0;       /* fruit whose name floats, or 0     */
+static int label_at;              /* value of seconds when it was eaten */
+
+/* how often the simulation ran, and how often its state was drawn */
+static unsigned long sim_ticks = 0;       /* simulation steps taken       */
+static unsigned long rendered_frames = 0; /* render steps that drew       */
+static unsigned long skipped_frames = 0;  /* render steps with no changes */
+
+
+/*
+ * Game state published by the logic thread (rtc_thread) for the render
+ * thread.  Snapshots pass through a lock-free double buffer: the logic
+ * thread writes the slot not holding the newest snapshot, marking the
+ * slot's version odd while writing, and the render thread copies the
+ * newest slot and retries if the version was odd or changed during the
+ * copy.  The logic thread never waits for the render thread.
+ *
+ * The render thread may skip snapshots, so maze squares redrawn by the
+ * simulation are recorded in a ring rather than in the snapshots; each
+ * snapshot gives the number of squares recorded when it was taken.
+ *
+ * The maze itself is not copied.  The logic thread owns the current maze
+ * and is the only thread that writes it; the render thread only reads
+ * it, through the maze.c drawing functions.  Between levels the logic
+ * thread waits for the render thread (wait_for_render) before changing
+ * the maze.  During play, what the logic thread changes (unveiled
+ * squares, fruits, the rows of an endless maze) is read and written
+ * with atomic accesses in maze.c, and each change is then recorded in
+ * the dirty ring, so a square drawn mid-change is drawn again.
+ */
+#define DIRTY_RING_SIZE 256  /* maze squares; must be a power of two */
+
+typedef struct {
+    int level;               /* level number, from 1; 0 before the game    */
+    int map_x, map_y;        /* upper left pixel of the view window        */
+    int play_x, play_y;      /* player position in pixels                  */
+    int last_dir;            /* direction the player faces                 */
+    int fruits;              /* fruits left in the maze                    */
+    int seconds;             /* time spent in the level                    */
+    int fruit_eaten;         /* fruit eaten in the last five seconds, or 0 */
+    int eaten_at;            /* time at which that fruit was eaten         */
+    unsigned long dirty_end; /* maze squares recorded so far               */
+    unsigned long dirty_start; /* ...when the level started                */
+    const unsigned char* view; /* image of the level's first view, or NULL */
+    unsigned int inputs[NUM_INPUT_SOURCES]; /* latency marks; see latency.h */
+} snapshot_t;
+
+static snapshot_t snap_slot[2];          /* the double buffer             */
+static unsigned long snap_version[2];    /* odd while a slot is written   */
+static unsigned long snap_published = 0; /* snapshots published so far    */
+static unsigned long snap_rendered = 0;  /* newest snapshot drawn         */
+static int logic_done = 0;               /* no more snapshots will come   */
+
+static struct {int x, y;} dirty_ring[DIRTY_RING_SIZE];
+static unsigned long dirty_count = 0;    /* maze squares recorded so far  */
+
+/* names of fruits, indexed by fruit number */
+static const char* const fruit_names[NUM_FRUIT_TYPES + 1] = {
+	"", "an apple!", "grapes!", "peaches!", "a strawberry!",
+	"a banana!", "a watermelon!", "a dew!"
+};
 
 
 /*
- * tux_thread
- *   DESCRIPTION: Thread that handles tux controller inputs
+ * mark_dirty
+ *   DESCRIPTION: Record a maze square to be redrawn by the render thread;
+ *		  called by the maze code from the logic thread.
+ *   INPUTS: (x,y) -- maze lattice point
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: adds the point to the dirty ring
+ */
+static void
+mark_dirty (int x, int y)
+{
+	unsigned long n = dirty_count;
+
+	dirty_ring[n & (DIRTY_RING_SIZE - 1)].x = x;
+	dirty_ring[n & (DIRTY_RING_SIZE - 1)].y = y;
+	__atomic_store_n (&dirty_count, n + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * publish_snapshot
+ *   DESCRIPTION: Make a snapshot of the game state the newest one seen by
+ *		  the render thread.  Called only by the logic thread.
+ *   INPUTS: snap -- the game state
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: overwrites the older slot of the double buffer
+ */
+static void
+publish_snapshot (const snapshot_t* snap)
+{
+	unsigned long n = snap_published + 1;
+	unsigned long v = snap_version[n & 1];
+
+	__atomic_store_n (&snap_version[n & 1], v + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	snap_slot[n & 1] = *snap;
+	__atomic_store_n (&snap_version[n & 1], v + 2, __ATOMIC_RELEASE);
+	__atomic_store_n (&snap_published, n, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * read_snapshot
+ *   DESCRIPTION: Copy the newest snapshot of the game state.  Called only
+ *		  by the render thread.
+ *   INPUTS: none
+ *   OUTPUTS: snap -- the game state
+ *   RETURN VALUE: the number of the snapshot (0 if none was published);
+ *		   the copy may come from a newer one published meanwhile
+ *   SIDE EFFECTS: none
+ */
+static unsigned long
+read_snapshot (snapshot_t* snap)
+{
+	unsigned long n, v;
+
+	do {
+		n = __atomic_load_n (&snap_published, __ATOMIC_ACQUIRE);
+		v = __atomic_load_n (&snap_version[n & 1], __ATOMIC_ACQUIRE);
+		*snap = snap_slot[n & 1];
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	} while ((v & 1) != 0 ||
+		 v != __atomic_load_n (&snap_version[n & 1], __ATOMIC_RELAXED));
+	return n;
+}
+
+
+/*
+ * wait_for_render
+ *   DESCRIPTION: Wait until the render thread has drawn the newest
+ *		  snapshot.  After this returns, the render thread does not
+ *		  touch the maze or the build buffer until the next snapshot
+ *		  is published.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-static void *tux_thread(void *arg)
+static void
+wait_for_render ()
 {
-	//ioctl(fd_tux, TUX_INIT, 0 );
-	//char key;
-	//int state = 0;
-	// Break only on win or quit input - '`'
-	while (winner == 0)
-	{		
-			unsigned long button;
+	while (__atomic_load_n (&snap_rendered, __ATOMIC_ACQUIRE) !=
+	       snap_published)
+		usleep (1000);
+}
 
-			//check if the game is over
-			if(quit_flag == 1)
-			break;
 
-			//get the button status from controller
-		    ioctl(fd_tux, TUX_BUTTONS, &button);
+/*
+ * draw_view
+ *   DESCRIPTION: Set the logical view window and draw all of it.
+ *   INPUTS: (map_x,map_y) -- upper left pixel of the view window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws to the build buffer
+ */
+static void
+draw_view (int map_x, int map_y)
+{
+	int i;
+
+	set_view_window (map_x, map_y);
+	for (i = 0; i < SCROLL_Y_DIM; i++)
+		(void)draw_horiz_line (i);
+}
 
-					pthread_mutex_lock(&mtx); //critical section
-					switch(button)
-					{
-						//printf("%lu\n",button);
 
-						//change next_dir according to the button pressed
-						case MOVE_UP:
-							next_dir = DIR_UP;
-							break;
-						case MOVE_DOWN:
-							next_dir = DIR_DOWN;
-							break;
-						case MOVE_RIGHT:
-							next_dir = DIR_RIGHT;
-							break;
-						case MOVE_LEFT:
-							next_dir = DIR_LEFT;
-							break;
-					}
-					pthread_mutex_unlock(&mtx);
+/*
+ * pan_view
+ *   DESCRIPTION: Move the logical view window, drawing the lines that
+ *		  come into view.
+ *   INPUTS: (old_x,old_y) -- current upper left pixel of the view window
+ *	     (new_x,new_y) -- new upper left pixel of the view window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws to the build buffer
+ */
+static void
+pan_view (int old_x, int old_y, int new_x, int new_y)
+{
+	int dx = new_x - old_x;
+	int dy = new_y - old_y;
+	int i;
+
+	if (dx <= -SCROLL_X_DIM || dx >= SCROLL_X_DIM ||
+	    dy <= -SCROLL_Y_DIM || dy >= SCROLL_Y_DIM) {
+		draw_view (new_x, new_y);
+		return;
 	}
+	set_view_window (new_x, new_y);
+	for (i = 0; i < dx; i++)
+		(void)draw_vert_line (SCROLL_X_DIM - 1 - i);
+	for (i = 0; i < -dx; i++)
+		(void)draw_vert_line (i);
+	for (i = 0; i < dy; i++)
+		(void)draw_horiz_line (SCROLL_Y_DIM - 1 - i);
+	for (i = 0; i < -dy; i++)
+		(void)draw_horiz_line (i);
+}
 
-	return 0;
+
+/*
+ * queue_turn
+ *   DESCRIPTION: Buffer a direction chosen by the player.  The oldest
+ *		  buffered turn is next_dir.  It stays there until the
+ *		  player moves in that direction, or, if later turns are
+ *		  waiting, until the player passes one maze square without
+ *		  taking it; so two quick taps between ticks are both used.
+ *   INPUTS: d -- the direction
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes next_dir; drops the oldest turn if full
+ */
+static void queue_turn(int d)
+{
+	if (num_turns == MAX_TURNS)
+		drop_turn ();
+	turns[num_turns++] = d;
+	next_dir = turns[0];
 }
 
+
 /*
- * keyboard_thread
- *   DESCRIPTION: Thread that handles keyboard inputs
+ * drop_turn
+ *   DESCRIPTION: Discard the oldest buffered turn if another is waiting
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: changes next_dir
  */
-static void *keyboard_thread(void *arg)
+static void drop_turn()
 {
-	char key;
-	int state = 0;
-	// Break only on win or quit input - '`'
-	while (winner == 0)
+	int i;
+
+	if (num_turns < 2)
+		return;
+	for (i = 1; i < num_turns; i++)
+		turns[i - 1] = turns[i];
+	next_dir = turns[0];
+	num_turns--;
+}
+
+
+/*
+ * wait_for_ticks
+ *   DESCRIPTION: Drain the input command rings, and wait for more until
+ *		  clock ticks have arrived; records how long each command
+ *		  waited
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks, or 0 if the player quit
+ *   SIDE EFFECTS: may change next_dir, quit_flag, and the present mode
+ */
+static int wait_for_ticks()
+{
+	input_cmd_t cmd;
+	long long now, wait;
+	int ticks = 0;
+
+	while (1)
 	{
-		if (quit_flag == 1) { break; }		
-		// Get Keyboard Input
-		key = getc(stdin);
-		
-		// Check for '`' to quit
-		if (key == BACKQUOTE)
-		{
-			quit_flag = 1;
-			break;
-		}
-		
-		// Compare and Set next_dir
-		// Arrow keys deliver 27, 91, ##
-		if (key == 27)
-		{
-			state = 1;
-		}
-		else if (key == 91 && state == 1)
+		now = now_usec ();
+		while (next_input_command (&cmd))
 		{
-			state = 2;
-		}
-		else
-		{	
-			if (key >= UP && key <= LEFT && state == 2)
+			wait = now - cmd.usec;
+			input_cmds[cmd.source]++;
+			input_wait_usec[cmd.source] += wait;
+			if (wait > input_max_usec[cmd.source])
+				input_max_usec[cmd.source] = wait;
+
+			switch (cmd.kind)
 			{
-				pthread_mutex_lock(&mtx);
-				switch(key)
-				{
-					case UP:
-						next_dir = DIR_UP;
-						break;
-					case DOWN:
-						next_dir = DIR_DOWN;
-						break;
-					case RIGHT:
-						next_dir = DIR_RIGHT;
-						break;
-					case LEFT:
-						next_dir = DIR_LEFT;
-						break;
-				}
-				pthread_mutex_unlock(&mtx);
+				case INPUT_TICKS:
+					ticks += cmd.arg;
+					break;
+				case INPUT_DIR:
+					queue_turn (cmd.arg);
+					latency_input (cmd.source, cmd.usec);
+					break;
+				case INPUT_TOGGLE_PRESENT:
+					set_present_mode (get_present_mode () ==
+							  PRESENT_TRIPLE ? PRESENT_DOUBLE :
+							  PRESENT_TRIPLE);
+					break;
+				case INPUT_QUIT:
+					quit_flag = 1;
+					return 0;
 			}
-			state = 0;
 		}
+		if (ticks > 0)
+			return ticks;
+		wait_for_input ();
 	}
+}
 
-	return 0;
+
+/*
+ * start_level_clock
+ *   DESCRIPTION: Start the clock for a new level: ask the tick source for
+ *		  one tick per simulation step of the level (a source that
+ *		  cannot be reprogrammed keeps its rate), and schedule the
+ *		  level's timed events afresh
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may change the tick rate
+ */
+static void start_level_clock()
+{
+	(void)set_tick_period (&ticks, game_info.tick_usec);
+	clock_usec = 0;
+	step_usec = 0;
+	level_step = sim_ticks;
+	seconds = 0;
+	fruit_label = 0;
+	cancel_event (&label_event);
+	add_event (&events, &second_event, step_at (1000000));
+	fruit_usec = game_info.time_to_first_fruit * 1000000LL;
+	add_event (&events, &fruit_event, step_at (fruit_usec));
 }
 
-/* some stats about how often we take longer than a single timer tick */
-static int goodcount = 0;
-static int badcount = 0;
-static int total = 0;
+
+/*
+ * advance_level_clock
+ *   DESCRIPTION: Advance game time by some clock ticks, and find how many
+ *		  simulation steps are now due.  If more than MAX_STEPS are
+ *		  due, the rest are dropped, so that an overwhelmed system
+ *		  slows the game down instead of falling further behind.
+ *   INPUTS: n -- number of ticks
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of steps to run
+ *   SIDE EFFECTS: none
+ */
+static int advance_level_clock(int n)
+{
+	int steps;
+
+	clock_usec += (long long)n * ticks.period_usec;
+	steps = (clock_usec - step_usec) / game_info.tick_usec;
+	if (steps > MAX_STEPS)
+	{
+		TELEMETRY_ADD (clamped_ticks, steps - MAX_STEPS);
+		step_usec += (long long)(steps - MAX_STEPS) * game_info.tick_usec;
+		steps = MAX_STEPS;
+	}
+	step_usec += (long long)steps * game_info.tick_usec;
+	return steps;
+}
+
+
+/*
+ * step_at
+ *   DESCRIPTION: Find the simulation step that ends a stretch of game time
+ *		  in the level, rounding up to a whole step
+ *   INPUTS: usec -- game time from the start of the level
+ *   OUTPUTS: none
+ *   RETURN VALUE: the step, as a value of sim_ticks
+ *   SIDE EFFECTS: none
+ */
+static unsigned long step_at(long long usec)
+{
+	return level_step + (usec + game_info.tick_usec - 1) /
+		game_info.tick_usec;
+}
+
+
+/*
+ * next_second
+ *   DESCRIPTION: Timed event: count a second of the level, and wait for
+ *		  the next
+ *   INPUTS: ev -- second_event
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void next_second(wheel_event_t* ev)
+{
+	seconds++;
+	add_event (&events, ev, step_at ((seconds + 1) * 1000000LL));
+}
+
+
+/*
+ * add_timed_fruit
+ *   DESCRIPTION: Timed event: add a fruit, unless every square of the
+ *		  maze holds one, and wait for the next.  The first comes
+ *		  time_to_first_fruit seconds into the level, and then one
+ *		  every time_between_fruits seconds.
+ *   INPUTS: ev -- fruit_event
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may add fruit to the maze
+ */
+static void add_timed_fruit(wheel_event_t* ev)
+{
+	(void)add_a_fruit ();
+	fruit_usec += game_info.time_between_fruits * 1000000LL;
+	add_event (&events, ev, step_at (fruit_usec));
+}
+
+
+/*
+ * show_fruit_label
+ *   DESCRIPTION: Float the name of a fruit just eaten for LABEL_USEC of
+ *		  game time, replacing any name already floating
+ *   INPUTS: fruit -- the fruit number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void show_fruit_label(int fruit)
+{
+	fruit_label = fruit;
+	label_at = seconds;
+	add_event (&events, &label_event, sim_ticks + (LABEL_USEC +
+		   game_info.tick_usec - 1) / game_info.tick_usec);
+}
+
+
+/*
+ * hide_fruit_label
+ *   DESCRIPTION: Timed event: stop floating the name of a fruit
+ *   INPUTS: ev -- label_event
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hide_fruit_label(wheel_event_t* ev)
+{
+	fruit_label = 0;
+}
 
 
 /*
  * rtc_thread
- *   DESCRIPTION: Thread that handles updating the screen
+ *   DESCRIPTION: Thread that runs the game logic: advances the simulation
+ *		  by one fixed step (of the level's tick_usec) per step of
+ *		  game time, and publishes a snapshot of the game state for
+ *		  the render thread after each wakeup
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -499,39 +1242,59 @@ static int total = 0;
  */
 static void *rtc_thread(void *arg)
 {
-	unsigned long tux_display;
-	int ticks = 0;
+	int n = 0;
+	int steps;
 	int level;
-	int ret;
-	int i;
-	int draw_y, draw_x;
-	char str[50];
-	char str1[50];
-	int temp_timer;
-	unsigned char myBuffer[BLOCK_X_DIM*BLOCK_Y_DIM];
-	unsigned char shadow_buffer[128*16];
-	unsigned char temp_buffer[128*16];
-	char fruit_name[20];
-	//unsigned char* myFloor = (unsigned char*)blocks[BLOCK_EMPTY];
-	unsigned char savedFloor[BLOCK_X_DIM*BLOCK_Y_DIM];
+	int fruit;
 	int open[NUM_DIRS];
-	int need_redraw = 1;
 	int goto_next_level = 0;
-	int myTimer, minute, minute1, minute2, second, second1, second2;
+	snapshot_t snap;
+	unsigned long long tick_t0, t0;
+	long long gen_start;
+	maze_stats_t maze_stats;
+
+	trace_thread ("logic");
+
+	// Make the next level's maze while each level is played
+	start_pregen ();
+
+	// Squares changed by the simulation are drawn by the render thread
+	set_redraw_fn (mark_dirty);
+	init_wheel (&events, sim_ticks);
 
 	// Loop over levels until a level is lost or quit.
-	for (level = 1; (level <= MAX_LEVEL) && (quit_flag == 0); level++)
+	for (level = 1; (level <= last_level) && (quit_flag == 0); level++)
 	{
-		//fill the palette according to level the game is in
-		fill_my_palette(level);
-		int temp=level;
-		total=0;
-		temp_timer=-500;
+		// The render thread must be done with the old maze
+		t0 = trace_begin ();
+		wait_for_render ();
+		trace_end ("wait for render", t0);
+
 		// Prepare for the level.  If we fail, just let the player win.
+		gen_start = now_usec ();
 		if (prepare_maze_level (level) != 0)
 			break;
+		TELEMETRY_SET (level, level);
+		if (level < TELEMETRY_LEVELS)
+		{
+			TELEMETRY_SET (switch_usec[level],
+				       now_usec () - gen_start);
+			TELEMETRY_SET (gen_usec[level],
+				       level_slot[cur_slot].gen_usec);
+			get_maze_stats (&maze_stats);
+			TELEMETRY_SET (gen_regions[level], maze_stats.regions);
+		}
 		goto_next_level = 0;
 
+		// Make the next level while this one is played
+		pregen_next_level (level + 1);
+
+		// The render thread shows the image of the first view made
+		// with the maze, if any, and then the squares changed since
+		snap.view = (level_slot[cur_slot].view_ok ?
+			     level_slot[cur_slot].view : NULL);
+		snap.dirty_start = dirty_count;
+
 		// Start the player at (1,1)
 		play_x = BLOCK_X_DIM;
 		play_y = BLOCK_Y_DIM;
@@ -546,116 +1309,67 @@ static void *rtc_thread(void *arg)
 		// Initialize the current direction of motion to stopped
 		dir = DIR_STOP;
 		next_dir = DIR_STOP;
+		num_turns = 0;
 
 		// Show maze around the player's original position
 		(void)unveil_around_player (play_x, play_y);
 
-		//save the old floor value to the local buffer
-		save_old_floor(play_x, play_y, savedFloor);
-
-					//draw the character image according to the mask
-		   			for(i=0; i<BLOCK_X_DIM*BLOCK_Y_DIM; i++)
-		   			{
-		   				if(get_player_mask(last_dir)[i])
-		   					myBuffer[i]=get_player_block(last_dir)[i];
-		   				else myBuffer[i]=savedFloor[i];
-		   			}
-		   			//fill the buffer in the corresponding locations
-					draw_full_block (play_x, play_y, myBuffer);
-
-		//draw the actual image on the screen
-		show_screen();
-
-		//restore the saved floor from saved buffer
-		draw_full_block (play_x, play_y, savedFloor);
-		//show_screen();
-
-		//use mutex lock to protext critical section
-		(void)pthread_mutex_lock (&mtx);
-
-		//get the messages and inputs to pass write to the status bar
-		int fruitNum = get_fruit_num();
-
-		//check weather there should be fruit or fruits
-		if(fruitNum==1)
-		{
-			sprintf(str, "Level %d   %d fruit   00:00", temp, fruitNum);
-
-		}
-		else sprintf(str, "Level %d   %d fruits   00:00", temp, fruitNum);
-		//sprintf(str1, "level %d", typing);
-		//draw the status bar to the screen
-		show_status_bar(str, str, level);
-
-		//unlock to exit the critical section
-		(void)pthread_mutex_unlock (&mtx);
-
-		// get first Periodic Interrupt
-		ret = read(fd, &data, sizeof(unsigned long));
+		// Run the clock at the level's speed, from the first tick
+		start_level_clock ();
+		(void)wait_for_ticks ();
 
 		while ((quit_flag == 0) && (goto_next_level == 0))
 		{
-			// Wait for Periodic Interrupt
-			ret = read(fd, &data, sizeof(unsigned long));
-		
-			// Update tick to keep track of time.  If we missed some
-			// interrupts we want to update the player multiple times so
-			// that player velocity is smooth
-			ticks = data >> 8;	
-
-			total += ticks;
-
-			
-			//get the fruit number
-			fruitNum=get_fruit_num();
-
-			//get the time elapsed. 128 is the frequency of ticks
-			myTimer = total/128;
-
-			//get each digit in the timer
-			minute = myTimer/60;
-			minute1 = minute % 10;
-			minute2 = minute / 10;
-
-			second = myTimer % 60;
-			second1 = second % 10;
-			second2 = second / 10;
-			//printf("%d\n", level);
-
-			//check weather there should be fruit or fruits
-
-			tux_display = 0x040f0000 | second1 
-			| second2 << 4 | minute1 << 8 | minute2 << 12;
-			ioctl (fd_tux, TUX_SET_LED, tux_display);
-
-		if(fruitNum==1)
-		{
-			sprintf(str, "Level %d   %d fruit   %d%d:%d%d", temp, fruitNum, minute2, minute1, second2, second1);
-
-		}
-
-			else sprintf(str, "Level %d   %d fruits   %d%d:%d%d", temp, fruitNum, minute2, minute1, second2, second1);
-
-			pthread_mutex_lock(&mtx);
-			//draw the status bar to the screen
-			show_status_bar(str, str1, level);
-			pthread_mutex_unlock(&mtx);
-
-
-			// If the system is completely overwhelmed we better slow down:
-			if (ticks > 8) ticks = 8;
-
-			if (ticks > 1) {
+			// Publish the state for the render thread
+			snap.level = level;
+			snap.map_x = game_info.map_x;
+			snap.map_y = game_info.map_y;
+			snap.play_x = play_x;
+			snap.play_y = play_y;
+			snap.last_dir = last_dir;
+			snap.fruits = get_fruit_num ();
+			snap.seconds = seconds;
+			snap.fruit_eaten = fruit_label;
+			snap.eaten_at = label_at;
+			snap.dirty_end = dirty_count;
+			latency_marks (snap.inputs);
+			publish_snapshot (&snap);
+
+			// Wait for clock ticks, handling input meanwhile.  If we
+			// missed some ticks we want to update the player multiple
+			// times so that player velocity is smooth
+			t0 = trace_begin ();
+			n = wait_for_ticks ();
+			trace_end ("wait for ticks", t0);
+
+			TELEMETRY_ADD (ticks, n);
+			if (n > 1)
+				TELEMETRY_ADD (catchup_ticks, n - 1);
+
+			// get the steps now due
+			steps = advance_level_clock (n);
+
+			if (steps > 1) {
 				badcount++;
 			}
-			else {
+			else if (steps == 1) {
 				goodcount++;
 			}
 
-			while (ticks--) {
+			/*
+			 * Simulation: advance the game by one fixed step for
+			 * each tick_usec of game time.  Nothing is drawn here;
+			 * the render thread draws from the published snapshots.
+			 */
+			while (steps--) {
 
-				// Lock the mutex
-				pthread_mutex_lock(&mtx);
+				tick_t0 = trace_begin ();
+				sim_ticks++;
+				run_wheel (&events, sim_ticks);
+
+				// Forget buffered turns already taken
+				while (num_turns > 1 && turns[0] == dir)
+					drop_turn ();
 
 				// Check to see if a key has been pressed
 				if (next_dir != dir)
@@ -681,12 +1395,15 @@ static void *rtc_thread(void *arg)
 				{
 	  				// The player has reached a new maze square; unveil nearby maze
 	    				// squares and check whether the player has won the level.
+					t0 = trace_begin ();
 	  				if (unveil_around_player (play_x, play_y))
 					{
-						pthread_mutex_unlock(&mtx);
+						trace_end ("unveil", t0);
+						trace_end ("tick", tick_t0);
 	    					goto_next_level = 1;
 						break;
 					}
+					trace_end ("unveil", t0);
 	 	   	
 					// Record directions open to motion.
 					find_open_directions (play_x / BLOCK_X_DIM,
@@ -698,6 +1415,11 @@ static void *rtc_thread(void *arg)
 					{
 						dir = next_dir;
 		   			}
+					else
+					{
+						// A later turn gets the next square
+						drop_turn ();
+					}
 	
 					// The direction may not be open to motion...
 			    		//   1) ran into a wall
@@ -718,14 +1440,13 @@ static void *rtc_thread(void *arg)
 						}
     				}
 				}
-				// Unlock the mutex
-				pthread_mutex_unlock(&mtx);
 		
 				if (dir != DIR_STOP) 
 				{
 	    				// move in chosen direction
 	    				last_dir = dir;
 	    				move_cnt--;	
+					t0 = trace_begin ();
 	    			switch (dir) 
 					{
 						case DIR_UP:    
@@ -741,125 +1462,250 @@ static void *rtc_thread(void *arg)
 							move_left (&play_x);  
 							break;
 		   			}
+					trace_end ("move", t0);
 
 
-		   			//get fruit number 
-		   			int which_fruit = check_for_fruit(play_x / BLOCK_X_DIM, play_y/ BLOCK_Y_DIM);
-				   	//prepare string for each fruit name
-					if(which_fruit != 0)
+		   			//eat any fruit here; its name floats for 5 seconds
+		   			fruit = check_for_fruit(play_x / BLOCK_X_DIM, play_y/ BLOCK_Y_DIM);
+					if(fruit != 0)
 					{
-						temp_timer=myTimer;
-
-						//print out the corresponding fruit name
-						//according to fruit number we get.
-						if(which_fruit==1)
-						{
-							sprintf(fruit_name, "an apple!");
-						}
-						else if(which_fruit == 2)
-						{
-							sprintf(fruit_name, "grapes!");
-						}
-						else if(which_fruit == 3)
-						{
-							sprintf(fruit_name, "peaches!");
-						}
-						else if(which_fruit == 4)
-						{
-							sprintf(fruit_name, "a strawberry!");
-						}
-						else if(which_fruit == 5)
-						{
-							sprintf(fruit_name, "a banana!");
-						}
-						else if(which_fruit == 6)
-						{
-							sprintf(fruit_name, "a watermelon!");
-						}
-						else if(which_fruit == 7)
-						{
-							sprintf(fruit_name, "a dew!");
-						}
+						show_fruit_label (fruit);
 					}
-					//save old floor to the local buffer
-		   			save_old_floor(play_x, play_y, savedFloor);
-
-		   			//draw character buffer according to the mask
-		   			for(i=0; i<BLOCK_X_DIM*BLOCK_Y_DIM; i++)
-		   			{
-		   				if(get_player_mask(last_dir)[i])
-		   				{
-		   					if(get_player_block(last_dir)[i]==0x20) 
-		   					//the color of the core of character
-		   					{
-		   						myBuffer[i]=myTimer%5; //change the buffer over time to make it glow
-		   					}
-		   					else
-		   						myBuffer[i]=get_player_block(last_dir)[i];
-		   				}
-		   				else 
-		   					{
-		   						myBuffer[i]=savedFloor[i];
-		   					}
-		   			}	
-					need_redraw = 1;
 				}
+				trace_end ("tick", tick_t0);
+			}
+		}	
+	}
+	if (quit_flag == 0) winner = 1;
+	stop_pregen ();
+	__atomic_store_n (&logic_done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
 
-				else
+
+/*
+ * render_thread
+ *   DESCRIPTION: Thread that draws the game: at most once per display
+ *		  refresh, takes the newest snapshot published by the logic
+ *		  thread, brings the build buffer up to date with it, and
+ *		  shows the screen and status bar.  Frames in which nothing
+ *		  visible changed are skipped.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void *render_thread(void *arg)
+{
+	snapshot_t snap;
+	unsigned long seq;
+	unsigned long shown_seq = 0;
+	unsigned long dirty_done = 0;
+	unsigned long first;
+	unsigned long tux_display;
+	int level = 0;
+	int map_x = 0, map_y = 0;
+	int shown_x = -1, shown_y = -1, shown_dir = -1;
+	int glow, shown_glow = -1;
+	int float_timer, shown_float = -1;
+	int shown_seconds = -1, shown_fruits = -1;
+	int need_redraw, status_due;
+	int i;
+	int draw_y, draw_x;
+	int minute, minute1, minute2, second, second1, second2;
+	char str[50] = "";
+	const char* fruit_name;
+	unsigned char myBuffer[BLOCK_X_DIM*BLOCK_Y_DIM];
+	unsigned char shadow_buffer[128*16];
+	unsigned char temp_buffer[128*16];
+	unsigned char savedFloor[BLOCK_X_DIM*BLOCK_Y_DIM];
+	present_stats_t pst;
+	int render_usec;
+	long long now, next_render;
+	unsigned long long frame_t0, t0;
+
+	trace_thread ("render");
+	get_present_stats (&pst);
+	render_usec = (pst.refresh_usec != 0 ? pst.refresh_usec :
+		       RENDER_USEC_DEFAULT);
+	next_render = now_usec ();
+
+	while (__atomic_load_n (&logic_done, __ATOMIC_ACQUIRE) == 0)
+	{
+		// Run at most once per display refresh
+		sleep_until (next_render);
+		now = now_usec ();
+		next_render += render_usec;
+		if (next_render < now - render_usec)
+			next_render = now;
+		trace_poll ();
+
+		frame_t0 = trace_begin ();
+		seq = read_snapshot (&snap);
+		if (seq == shown_seq || snap.level == 0)
+		{
+			skipped_frames++;
+			continue;
+		}
+		need_redraw = 0;
+
+		// A new level: draw the whole view in the level's colors.  An
+		// image made with the maze shows the level's first view; the
+		// squares changed since, and any panning, are drawn below.
+		if (snap.level != level)
+		{
+			level = snap.level;
+			fill_my_palette (level);
+			t0 = trace_begin ();
+			if (snap.view != NULL)
+			{
+				map_x = map_y = SHOW_MIN;
+				set_view_window (map_x, map_y);
+				draw_view_image (snap.view);
+				dirty_done = snap.dirty_start;
+			}
+			else
+			{
+				map_x = snap.map_x;
+				map_y = snap.map_y;
+				draw_view (map_x, map_y);
+				dirty_done = snap.dirty_end;
+			}
+			trace_end ("draw view", t0);
+			shown_seconds = shown_fruits = -1;
+			need_redraw = 1;
+		}
+
+		// Follow the view window
+		if (snap.map_x != map_x || snap.map_y != map_y)
+		{
+			t0 = trace_begin ();
+			pan_view (map_x, map_y, snap.map_x, snap.map_y);
+			trace_end ("pan view", t0);
+			map_x = snap.map_x;
+			map_y = snap.map_y;
+			need_redraw = 1;
+		}
+
+		// Redraw changed maze squares; if the ring overflowed, redraw all
+		if (snap.dirty_end != dirty_done)
+		{
+			t0 = trace_begin ();
+			first = dirty_done;
+			if (snap.dirty_end - first > DIRTY_RING_SIZE)
+				draw_view (map_x, map_y);
+			else
+			{
+				for (; dirty_done != snap.dirty_end; dirty_done++)
 				{
-					//save the old floow to the local buffer
-					save_old_floor(play_x, play_y, savedFloor);
-
-		   			for(i=0; i<BLOCK_X_DIM*BLOCK_Y_DIM; i++)
-		   			{
-		   				//fill up the buffer according to player mask
-		   				if(get_player_mask(last_dir)[i])
-		   				{
-		   					if(get_player_block(last_dir)[i]==0x20)
-		   						//the color of the core of character
-		   					{
-		   						myBuffer[i]=myTimer%0x05;
-		   						//change the buffer over time to make it glow
-		   					}
-		   					else
-		   						myBuffer[i]=get_player_block(last_dir)[i];
-		   				}
-		   				else 
-		   					{
-		   						myBuffer[i]=savedFloor[i];
-		   					}
-		   			}	
-					need_redraw = 0;
+					i = dirty_done & (DIRTY_RING_SIZE - 1);
+					draw_space (dirty_ring[i].x, dirty_ring[i].y);
 				}
+				// entries may have been overwritten while read
+				if (__atomic_load_n (&dirty_count, __ATOMIC_ACQUIRE) -
+				    first > DIRTY_RING_SIZE)
+					draw_view (map_x, map_y);
 			}
+			dirty_done = snap.dirty_end;
+			need_redraw = 1;
+			trace_end ("draw squares", t0);
+		}
+
+		if (snap.play_x != shown_x || snap.play_y != shown_y ||
+		    snap.last_dir != shown_dir)
+			need_redraw = 1;
+
+		// The status bar changes only when the timer ticks over a
+		// second or the number of fruits changes
+		status_due = (snap.seconds != shown_seconds ||
+			      snap.fruits != shown_fruits);
+
+		glow = snap.seconds % 5;
+		float_timer = (snap.fruit_eaten != 0 ? snap.eaten_at : -1);
+		fruit_name = fruit_names[snap.fruit_eaten];
+
+		if (!need_redraw && !status_due && glow == shown_glow &&
+		    float_timer == shown_float)
+		{
+			skipped_frames++;
+		}
+		else
+		{
+			rendered_frames++;
+
+			if (status_due)
+			{
+				//get each digit in the timer
+				minute = snap.seconds/60;
+				minute1 = minute % 10;
+				minute2 = minute / 10;
+
+				second = snap.seconds % 60;
+				second1 = second % 10;
+				second2 = second / 10;
 
-			if (need_redraw) 
+				if (snap.seconds != shown_seconds)
 				{
-					//check for game margin on the top
-					if(play_y-20 <= 0)
-					{
-						draw_y = play_y+20;
-					}
-					else
-						draw_y = play_y-20;
+					// show the elapsed time on the tux controller
+					tux_display = 0x040f0000 | second1 
+					| second2 << 4 | minute1 << 8 | minute2 << 12;
+					t0 = trace_begin ();
+					ioctl (fd_tux, TUX_SET_LED, tux_display);
+					TELEMETRY_ADD (led_ioctls, 1);
+					trace_end ("tux LED", t0);
+				}
 
-					// check for the game margin on the left
-					if((signed int)(play_x - 8 * strlen(fruit_name)) <= 8)
-					{
-						draw_x = 8;
-					}
-					else
-					{
-						draw_x = play_x - 8 * strlen(fruit_name);
-					}
+				//check weather there should be fruit or fruits
+				if(snap.fruits==1)
+				{
+					sprintf(str, "Level %d   %d fruit   %d%d:%d%d", level, snap.fruits, minute2, minute1, second2, second1);
+				}
+				else sprintf(str, "Level %d   %d fruits   %d%d:%d%d", level, snap.fruits, minute2, minute1, second2, second1);
+
+				//draw the status bar to the screen
+				t0 = trace_begin ();
+				show_status_bar(str, str, level);
+				trace_end ("status bar", t0);
+				shown_seconds = snap.seconds;
+				shown_fruits = snap.fruits;
+			}
 
-					//put the player image on the buffer
-					draw_full_block (play_x, play_y, myBuffer);
-					
-					//timer for 5 seconds
-					if(myTimer-temp_timer < 5)
-					{
-						//save the old floor to my buffer
+			if (need_redraw || glow != shown_glow ||
+			    float_timer != shown_float)
+			{
+				//save old floor to the local buffer
+				t0 = trace_begin ();
+				save_old_floor(snap.play_x, snap.play_y, savedFloor);
+
+				//draw character buffer according to the mask,
+				//changing the core color over time to make it glow
+				compose_player(myBuffer, savedFloor, snap.last_dir, glow);
+
+				//check for game margin on the top
+				if(snap.play_y-20 <= 0)
+				{
+					draw_y = snap.play_y+20;
+				}
+				else
+					draw_y = snap.play_y-20;
+
+				// check for the game margin on the left
+				if((signed int)(snap.play_x - 8 * strlen(fruit_name)) <= 8)
+				{
+					draw_x = 8;
+				}
+				else
+				{
+					draw_x = snap.play_x - 8 * strlen(fruit_name);
+				}
+
+				//put the player image on the buffer
+				draw_full_block (snap.play_x, snap.play_y, myBuffer);
+
+				//timer for 5 seconds
+				if(float_timer != -1)
+				{
+					//save the old floor to my buffer
 					save_old_floating(draw_x, draw_y, shadow_buffer);
 					for( i=0; i<128*16 ; i++) //128*16 is the size of my floating block
 					{
@@ -867,29 +1713,47 @@ static void *rtc_thread(void *arg)
 						temp_buffer[i]=shadow_buffer[i];
 					}
 					//transform the text to image
-					fill_floating(fruit_name,shadow_buffer,0,str, temp_buffer);
-					
+					fill_floating((char*)fruit_name,shadow_buffer,0,str, temp_buffer);
+
 					//put the buffer of image on the screen
 					draw_full_floating (draw_x, draw_y, shadow_buffer);
-					
-					}
-					
-					//fill up the video memory according to build buffer
-					show_screen();
-					//restore saved floor
-					draw_full_block (play_x, play_y, savedFloor);
+				}
+				trace_end ("compose player", t0);
 
-					if(myTimer-temp_timer < 5)
-					{
-						//restore saved floating floor
+				//note the inputs the frame shows before it can be flipped to
+				latency_frame (next_screen_frame (), snap.inputs);
+
+				//fill up the video memory according to build buffer
+				t0 = trace_begin ();
+				(void)show_screen();
+				trace_end ("show screen", t0);
+				//restore saved floor
+				draw_full_block (snap.play_x, snap.play_y, savedFloor);
+
+				if(float_timer != -1)
+				{
+					//restore saved floating floor
 					draw_full_floating(draw_x, draw_y,temp_buffer);
-					}
-					//show_screen();
-				}	
-			//need_redraw = 0;
-		}	
+				}
+				shown_x = snap.play_x;
+				shown_y = snap.play_y;
+				shown_dir = snap.last_dir;
+				shown_glow = glow;
+				shown_float = float_timer;
+			}
+
+			// Publish the display counters
+			get_present_stats (&pst);
+			TELEMETRY_SET (frames, pst.frames);
+			TELEMETRY_SET (vram_bytes, pst.vram_bytes);
+			TELEMETRY_SET (contended, pst.contended);
+		}
+
+		// Let the logic thread know the snapshot has been drawn
+		shown_seq = seq;
+		__atomic_store_n (&snap_rendered, seq, __ATOMIC_RELEASE);
+		trace_end ("frame", frame_t0);
 	}
-	if (quit_flag == 0) winner = 1;
 	return 0;
 }
 
@@ -903,59 +1767,133 @@ static void *rtc_thread(void *arg)
  */
 int main()
 {
-	int ret;
    	struct termios tio_new;
-	unsigned long update_rate = 128; /* in Hz */
+	int update_rate = 128; /* in Hz */
 
 	pthread_t tid1;
 	pthread_t tid2;
-	pthread_t tid3;
-
-	//Initialize tux control
-	fd_tux=open("/dev/ttyS0", O_RDWR | O_NOCTTY);
-	int ldsic_num = N_MOUSE;
-	ioctl(fd_tux, TIOCSETD, &ldsic_num);
+	present_stats_t pst;
+	const char* budget;
+	const char* mode;
+	const char* script;
+	const char* trace;
+	const char* size;
+	const char* threads;
+	const char* pack;
+	int key_fd;
+
+	// Optionally play every level in a maze of WxH squares (an endurance
+	// run; any size make_maze accepts)
+	if ((size = getenv ("MAZEGAME_MAZE_SIZE")) != NULL &&
+	    (sscanf (size, "%dx%d", &endurance_x_dim, &endurance_y_dim) != 2 ||
+	     endurance_x_dim < MAZE_MIN_X_DIM ||
+	     endurance_x_dim > MAZE_LIMIT_DIM ||
+	     endurance_y_dim < MAZE_MIN_Y_DIM ||
+	     endurance_y_dim > MAZE_LIMIT_DIM))
+	{
+		fprintf (stderr, "MAZEGAME_MAZE_SIZE should be WxH, from "
+			 "%dx%d to %dx%d\n", MAZE_MIN_X_DIM, MAZE_MIN_Y_DIM,
+			 MAZE_LIMIT_DIM, MAZE_LIMIT_DIM);
+		return -1;
+	}
 
-	//initizlize corresponding variables
-	ioctl(fd_tux, TUX_INIT);
+	// Optionally play endless mazes, made as the player goes down
+	if (getenv ("MAZEGAME_ENDLESS") != NULL)
+		endless = 1;
 
+	// Optionally limit the threads that make large mazes (default: one
+	// per processor)
+	if ((threads = getenv ("MAZEGAME_MAZE_THREADS")) != NULL)
+		set_maze_threads (atoi (threads));
 
+	// Optionally write the levels, as just set, to a level pack and stop
+	if ((pack = getenv ("MAZEGAME_SAVE_PACK")) != NULL)
+		return (save_level_pack (pack) == 0 ? 0 : -1);
 
-	// Initialize RTC
-	fd = open("/dev/rtc", O_RDONLY, 0);
-	
-	// Enable RTC periodic interrupts at update_rate Hz
-	// Default max is 64...must change in /proc/sys/dev/rtc/max-user-freq
-	ret = ioctl(fd, RTC_IRQP_SET, update_rate);	
-	ret = ioctl(fd, RTC_PIE_ON, 0);
-
-	// Initialize Keyboard
-	// Turn on non-blocking mode
-    	if (fcntl (fileno (stdin), F_SETFL, O_NONBLOCK) != 0) 
+	// Optionally play the levels of a level pack instead
+	if ((pack = getenv ("MAZEGAME_LEVEL_PACK")) != NULL)
 	{
-        	perror ("fcntl to make stdin non-blocking");
-		return -1;
-    	}
-	
-	// Save current terminal attributes for stdin.
-    	if (tcgetattr (fileno (stdin), &tio_orig) != 0) 
+		if ((level_pack = open_level_pack (pack)) == NULL)
+			return -1;
+		last_level = level_pack->n_levels;
+		endless = 0;
+	}
+
+	// Scripted input (MAZEGAME_SCRIPT; see feeder.h) stands in for the
+	// RTC, the keyboard and the tux controller
+	if ((script = getenv ("MAZEGAME_SCRIPT")) != NULL)
 	{
-		perror ("tcgetattr to read stdin terminal settings");
-		return -1;
+		fd_tux = -1;
+		ticks.kind = TICK_RTC;
+		ticks.period_usec = 1000000 / update_rate;
+		if (start_input_script (script, update_rate, &ticks.fd,
+					&key_fd) != 0)
+			return -1;
 	}
-	
-	// Turn off canonical (line-buffered) mode and echoing of keystrokes
- 	// Set minimal character and timing parameters so as
-        tio_new = tio_orig;
-    	tio_new.c_lflag &= ~(ICANON | ECHO);
-    	tio_new.c_cc[VMIN] = 1;
-    	tio_new.c_cc[VTIME] = 0;
-    	if (tcsetattr (fileno (stdin), TCSANOW, &tio_new) != 0) 
+	else
 	{
-		perror ("tcsetattr to set stdin terminal settings");
-		return -1;
+		// Initialize the clock: MAZEGAME_TICKS picks rtc, timerfd or
+		// free; by default /dev/rtc, or a timerfd if the RTC is not
+		// available
+		if (open_tick_source (&ticks, getenv ("MAZEGAME_TICKS"),
+				      update_rate) != 0)
+			return -1;
+		fprintf (stderr, "ticks: %s at %d Hz\n",
+			 tick_kind_name (ticks.kind), update_rate);
+
+		//Initialize tux control
+		fd_tux=open("/dev/ttyS0", O_RDWR | O_NOCTTY);
+		int ldsic_num = N_MOUSE;
+		ioctl(fd_tux, TIOCSETD, &ldsic_num);
+
+		//initizlize corresponding variables
+		ioctl(fd_tux, TUX_INIT);
+
+		// Initialize Keyboard
+		// Reads block; the input reactor reads only when keys are ready.
+		// Save current terminal attributes for stdin.  If stdin is not
+		// a terminal (a headless run), keystrokes are read as they come.
+		if (tcgetattr (fileno (stdin), &tio_orig) != 0) 
+		{
+			if (errno != ENOTTY)
+			{
+				perror ("tcgetattr to read stdin terminal settings");
+				return -1;
+			}
+		}
+		else
+		{
+			// Turn off canonical (line-buffered) mode and echoing of keystrokes
+			// Set minimal character and timing parameters so as
+			tio_new = tio_orig;
+			tio_new.c_lflag &= ~(ICANON | ECHO);
+			tio_new.c_cc[VMIN] = 1;
+			tio_new.c_cc[VTIME] = 0;
+			if (tcsetattr (fileno (stdin), TCSANOW, &tio_new) != 0) 
+			{
+				perror ("tcsetattr to set stdin terminal settings");
+				return -1;
+			}
+			key_tty = 1;
+		}
+		key_fd = fileno (stdin);
 	}
 
+	// Optionally change how long a frame may wait for vertical retrace
+	if ((budget = getenv ("MAZEGAME_VSYNC_USEC")) != NULL)
+		set_present_budget (atoi (budget));
+
+	// Optionally start with triple buffering ('t' toggles it in game)
+	if ((mode = getenv ("MAZEGAME_PRESENT")) != NULL &&
+	    strcmp (mode, "triple") == 0)
+		set_present_mode (PRESENT_TRIPLE);
+
+	// Optionally trace the game's phases (written at exit and on SIGUSR1)
+	if ((trace = getenv ("MAZEGAME_TRACE")) != NULL)
+		(void)trace_start (trace);
+
+	// Measure input-to-photon latency as frames reach the monitor
+	set_flip_hook (latency_on_screen);
 
 	// Perform Sanity Checks and then initialize input and display
 	if ((sanity_check () != 0) || (set_mode_X (fill_horiz_buffer, fill_vert_buffer) != 0))
@@ -963,27 +1901,82 @@ int main()
 		return 3;
 	}
 
+	// Start delivering clock ticks, keystrokes and tux buttons
+	if (start_input_reactor (&ticks, key_fd, (script != NULL ?
+				 sample_script_tux : fd_tux != -1 ?
+				 sample_tux : NULL)) != 0)
+	{
+		clear_mode_X ();
+		if (script != NULL)
+			stop_input_script ();
+		else if (key_tty)
+			(void)tcsetattr (fileno (stdin), TCSANOW, &tio_orig);
+		return 3;
+	}
+
+	// Share live counters with mazestat (the game runs without them)
+	(void)open_telemetry ();
+
 	// Create the threads
 	pthread_create(&tid1, NULL, rtc_thread, NULL);
-	pthread_create(&tid2, NULL, keyboard_thread, NULL);
-	pthread_create(&tid3, NULL, tux_thread, NULL);
+	pthread_create(&tid2, NULL, render_thread, NULL);
 	
 	// Wait for all the threads to end
 	pthread_join(tid1, NULL);
 	pthread_join(tid2, NULL);
-	pthread_join(tid3, NULL);
+	stop_input_reactor ();
+	trace_dump ();
+	close_telemetry ();
+	if (level_pack != NULL)
+		close_level_pack (level_pack);
 
 	// Shutdown Display
 	clear_mode_X();
+
+	// Report how display flips lined up with vertical retrace
+	get_present_stats (&pst);
+	printf ("present: %lu frames, %lu flips on retrace, %lu missed, "
+		"%lu unobserved, %lu forced, %lu dropped; refresh %d us; "
+		"wait %lld us/frame; ready-to-flip mean %lld us, max %lld us\n",
+		pst.frames, pst.on_retrace, pst.missed, pst.unobserved,
+		pst.forced, pst.dropped, pst.refresh_usec, (pst.frames ?
+		pst.wait_usec / pst.frames : 0), (pst.on_retrace ? pst.latency_usec /
+		pst.on_retrace : 0), pst.max_latency_usec);
+	printf ("frames: %lu simulated ticks, %lu rendered, %lu skipped\n",
+		sim_ticks, rendered_frames, skipped_frames);
+	printf ("input wait before tick: rtc %lu, mean %lld us, max %lld us; "
+		"keyboard %lu, mean %lld us, max %lld us; "
+		"tux %lu, mean %lld us, max %lld us\n",
+		input_cmds[INPUT_FROM_RTC], (input_cmds[INPUT_FROM_RTC] ?
+		input_wait_usec[INPUT_FROM_RTC] / input_cmds[INPUT_FROM_RTC] :
+		0), input_max_usec[INPUT_FROM_RTC],
+		input_cmds[INPUT_FROM_KEYBOARD], (input_cmds[INPUT_FROM_KEYBOARD] ?
+		input_wait_usec[INPUT_FROM_KEYBOARD] /
+		input_cmds[INPUT_FROM_KEYBOARD] : 0),
+		input_max_usec[INPUT_FROM_KEYBOARD],
+		input_cmds[INPUT_FROM_TUX], (input_cmds[INPUT_FROM_TUX] ?
+		input_wait_usec[INPUT_FROM_TUX] / input_cmds[INPUT_FROM_TUX] :
+		0), input_max_usec[INPUT_FROM_TUX]);
+	latency_report (stdout);
+	report_locks (stdout);
 	
-	// Close Keyboard
-	(void)tcsetattr (fileno (stdin), TCSANOW, &tio_orig);
-		
-	// Close RTC
-	close(fd);
+	if (script != NULL)
+	{
+		// Stop the script and close its pipes
+		stop_input_script ();
+	}
+	else
+	{
+		// Close Keyboard
+		if (key_tty)
+			(void)tcsetattr (fileno (stdin), TCSANOW, &tio_orig);
+
+		// Close the clock
+		close_tick_source (&ticks);
 
-	// Close Tux Controller
-	close(fd_tux);
+		// Close Tux Controller
+		close(fd_tux);
+	}
 
 	// Print outcome of the game
 	if (winner == 1)
@@ -0,0 +1,158 @@
+/*									tab:8
+ *
+ * mazestat.c - show the live counters of a running maze game
+ *
+ * Filename:	    mazestat.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *
+ * Usage: mazestat [seconds]
+ *
+ * Prints the counters once, or, given an interval, prints them and their
+ * rates of change every interval until the game exits.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+
+/* local functions--see function headers for details */
+static void read_counters (const telemetry_t* shared, telemetry_t* t);
+static void print_counters (const telemetry_t* t, const telemetry_t* old,
+			    double secs);
+
+
+/*
+ * main
+ *   DESCRIPTION: Map the game's counters and print them.
+ *   INPUTS: argv[1] -- optional interval in seconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, 1 if no game is running, 2 on bad usage
+ *   SIDE EFFECTS: prints to stdout
+ */
+int
+main (int argc, char* argv[])
+{
+    const telemetry_t* shared;
+    telemetry_t now, old;
+    double secs = 0;
+    int fd;
+
+    if (argc > 2 || (argc == 2 && (secs = atof (argv[1])) <= 0)) {
+	fprintf (stderr, "usage: %s [seconds]\n", argv[0]);
+	return 2;
+    }
+    if ((fd = shm_open (TELEMETRY_NAME, O_RDONLY, 0)) == -1) {
+	fprintf (stderr, "%s: no game is running\n", argv[0]);
+	return 1;
+    }
+    shared = mmap (NULL, sizeof (telemetry_t), PROT_READ, MAP_SHARED, fd, 0);
+    (void)close (fd);
+    if (shared == MAP_FAILED) {
+	perror ("mmap " TELEMETRY_NAME);
+	return 1;
+    }
+    if (__atomic_load_n (&shared->magic, __ATOMIC_ACQUIRE) !=
+	TELEMETRY_MAGIC || shared->version != TELEMETRY_VERSION) {
+	fprintf (stderr, "%s: counters not ready or of another version\n",
+		 argv[0]);
+	return 1;
+    }
+
+    read_counters (shared, &old);
+    print_counters (&old, NULL, 0);
+    while (secs > 0) {
+	(void)usleep ((useconds_t)(secs * 1000000));
+	if (kill ((pid_t)shared->pid, 0) == -1 && errno == ESRCH) {
+	    printf ("game exited\n");
+	    break;
+	}
+	read_counters (shared, &now);
+	print_counters (&now, &old, secs);
+	old = now;
+    }
+    return 0;
+}
+
+
+/*
+ * read_counters
+ *   DESCRIPTION: Copy the game's counters, reading each whole with an
+ *                atomic load (a plain copy could tear a 64-bit counter on
+ *                a 32-bit host).  Every field is a 64-bit counter.
+ *   INPUTS: shared -- the game's counters
+ *   OUTPUTS: t -- the copy
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+read_counters (const telemetry_t* shared, telemetry_t* t)
+{
+    const uint64_t* from = (const uint64_t*)shared;
+    uint64_t* to = (uint64_t*)t;
+    size_t i;
+
+    for (i = 0; i < sizeof (telemetry_t) / sizeof (uint64_t); i++)
+	to[i] = __atomic_load_n (&from[i], __ATOMIC_RELAXED);
+}
+
+
+/*
+ * print_counters
+ *   DESCRIPTION: Print a copy of the counters, with rates of change since
+ *                an older copy if one is given.
+ *   INPUTS: t -- the counters
+ *           old -- older counters, or NULL
+ *           secs -- time between the copies
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stdout
+ */
+static void
+print_counters (const telemetry_t* t, const telemetry_t* old, double secs)
+{
+    int i;
+
+#define RATE(field) \
+    (old != NULL ? (double)(t->field - old->field) / secs : 0.0)
+
+    printf ("pid %llu, level %llu\n", (unsigned long long)t->pid,
+	    (unsigned long long)t->level);
+    printf ("  ticks      %12llu  %8.1f/s\n", (unsigned long long)t->ticks,
+	    RATE (ticks));
+    printf ("  catch-up   %12llu  %8.1f/s\n",
+	    (unsigned long long)t->catchup_ticks, RATE (catchup_ticks));
+    printf ("  clamped    %12llu  %8.1f/s\n",
+	    (unsigned long long)t->clamped_ticks, RATE (clamped_ticks));
+    printf ("  frames     %12llu  %8.1f/s\n", (unsigned long long)t->frames,
+	    RATE (frames));
+    printf ("  VRAM bytes %12llu  %8.0f/s\n",
+	    (unsigned long long)t->vram_bytes, RATE (vram_bytes));
+    printf ("  contended  %12llu  %8.1f/s\n",
+	    (unsigned long long)t->contended, RATE (contended));
+    printf ("  LED ioctls %12llu  %8.1f/s\n",
+	    (unsigned long long)t->led_ioctls, RATE (led_ioctls));
+    printf ("  maze generation (us):");
+    for (i = 1; i < TELEMETRY_LEVELS && i <= t->level; i++)
+	printf (" %llu", (unsigned long long)t->gen_usec[i]);
+    printf ("\n");
+    printf ("  maze regions joined:");
+    for (i = 1; i < TELEMETRY_LEVELS && i <= t->level; i++)
+	printf (" %llu", (unsigned long long)t->gen_regions[i]);
+    printf ("\n");
+    printf ("  level switch (us):");
+    for (i = 1; i < TELEMETRY_LEVELS && i <= t->level; i++)
+	printf (" %llu", (unsigned long long)t->switch_usec[i]);
+    printf ("\n");
+    (void)fflush (stdout);
+
+#undef RATE
+}
@@ -0,0 +1,512 @@
+/*									tab:8
+ *
+ * mazetune.c - measure the mazes made with given worm turn weights
+ *
+ * Filename:	    mazetune.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *
+ * Usage: mazetune [-a | -g] [-m threads] [-n mazes] [-s WxH] [-t threads]
+ *                 [-w weights]...
+ *
+ * Makes a batch of mazes with each table of turn weights given (by
+ * default, the game's own table), measuring the mazes on several threads,
+ * and prints one CSV line per maze, or with -a one line of means per
+ * table.  A table is eight weights, a,b,c,d,e,f,g,h: going straight into
+ * open space and into a wall, then turning right, going back, and turning
+ * left, each into open space and into a wall (see turn_wt in maze.c).
+ *
+ * The measures of a maze, whose squares are the (odd,odd) lattice points:
+ *   dead_ends     -- squares open on one side
+ *   junctions     -- squares open on three or four sides
+ *   mean_corridor -- mean length, in steps, of the paths between dead
+ *                    ends and junctions
+ *   branching     -- mean number of ways on from a square that is not a
+ *                    dead end (open sides less one)
+ *   solution      -- steps on the shortest path from (1,1) to the exit
+ *   regions       -- regions dug by the worms, and
+ *   repairs       -- walls knocked down to join them into one maze
+ *   gen_usec      -- processor time taken to make the maze (elapsed
+ *                    time if it is made on several threads, with -m)
+ *
+ * With -g, the mazes are only made, not measured, and one line per table
+ * gives the rate at which they were made: the time for the whole batch,
+ * mazes made per second, and the mean processor time per maze and per
+ * square.  Running the same -g batch with two builds of maze.c compares
+ * their generation throughput.
+ *
+ * The analyzer links maze-walls.o, maze.c built with its walls in place
+ * (GOD_MODE off).  Each maze is made on one thread, so that the threads
+ * of the analyzer are the only parallelism, unless -m gives the threads
+ * on which each maze is made in bands (see set_maze_threads).
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "maze.h"
+
+
+#define MAX_TABLES  16  /* tables of weights in one run        */
+#define MAX_THREADS 64  /* threads measuring mazes             */
+
+
+/* the measures of one maze */
+typedef struct {
+    uint64_t seed;          /* seed it was made from               */
+    int dead_ends;
+    int junctions;
+    double mean_corridor;
+    double branching;
+    int solution;           /* -1 if the exit cannot be reached    */
+    int regions;
+    int repairs;
+    long gen_usec;
+    int failed;             /* 1 if the maze could not be made     */
+} tune_result_t;
+
+/* a thread measuring mazes */
+typedef struct {
+    maze_ctx_t* ctx;        /* its maze context                    */
+    unsigned char* deg;     /* open sides of each square           */
+    int* dist;              /* steps from (1,1), or -1             */
+    int* queue;             /* squares to search from              */
+    pthread_t tid;
+} tune_thread_t;
+
+
+/* local functions--see function headers for details */
+static int parse_weights (const char* arg, int wt[4][2]);
+static void* tune_thread (void* arg);
+static void measure_maze (tune_thread_t* t, tune_result_t* r);
+static void print_weights (const int wt[4][2]);
+static void free_threads (tune_thread_t* thr, int n_threads);
+
+
+/* the batch being measured, shared by the threads */
+static int x_dim = 50, y_dim = 30;  /* size of the mazes   */
+static int n_mazes = 100;           /* mazes in each batch */
+static tune_result_t* results;      /* of each maze        */
+static int next_maze;               /* next to make        */
+static int gen_only;                /* 1 to only make them */
+
+/* the clock that times each maze made */
+static clockid_t gen_clock = CLOCK_THREAD_CPUTIME_ID;
+
+
+/*
+ * main
+ *   DESCRIPTION: Read the options, then make and measure a batch of mazes
+ *                for each table of turn weights in turn.
+ *   INPUTS: argv -- the options (see above)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, 1 if mazes could not be made, 2 on bad
+ *                 usage
+ *   SIDE EFFECTS: prints CSV to stdout; changes the turn weights
+ */
+int
+main (int argc, char* argv[])
+{
+    static int tables[MAX_TABLES][4][2];
+    static tune_thread_t thr[MAX_THREADS];
+    int n_tables = 0, n_threads, means = 0, failed = 0;
+    int maze_threads = 1, tab, i, c, made;
+    size_t squares;
+    tune_result_t sum, *r;
+    struct timespec t0, t1;
+    double sec;
+
+    n_threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+    while ((c = getopt (argc, argv, "agm:n:s:t:w:")) != -1) {
+	switch (c) {
+	    case 'a':
+		means = 1;
+		break;
+	    case 'g':
+		gen_only = 1;
+		break;
+	    case 'm':
+		if ((maze_threads = atoi (optarg)) < 1)
+		    goto usage;
+		break;
+	    case 'n':
+		if ((n_mazes = atoi (optarg)) < 1)
+		    goto usage;
+		break;
+	    case 's':
+		if (sscanf (optarg, "%dx%d", &x_dim, &y_dim) != 2 ||
+		    x_dim < MAZE_MIN_X_DIM || x_dim > MAZE_LIMIT_DIM ||
+		    y_dim < MAZE_MIN_Y_DIM || y_dim > MAZE_LIMIT_DIM) {
+		    fprintf (stderr, "%s: sizes run from %dx%d to %dx%d\n",
+			     argv[0], MAZE_MIN_X_DIM, MAZE_MIN_Y_DIM,
+			     MAZE_LIMIT_DIM, MAZE_LIMIT_DIM);
+		    return 2;
+		}
+		break;
+	    case 't':
+		if ((n_threads = atoi (optarg)) < 1)
+		    goto usage;
+		break;
+	    case 'w':
+		if (n_tables == MAX_TABLES) {
+		    fprintf (stderr, "%s: at most %d tables\n", argv[0],
+			     MAX_TABLES);
+		    return 2;
+		}
+		if (parse_weights (optarg, tables[n_tables]) != 0) {
+		    fprintf (stderr, "%s: weights are eight numbers, each "
+			     "from 1 to %d, as in -w 1,84,1,9,3,3,1,9\n",
+			     argv[0], 1 << 20);
+		    return 2;
+		}
+		n_tables++;
+		break;
+	    default:
+		goto usage;
+	}
+    }
+    if (optind != argc || (means && gen_only))
+	goto usage;
+    if (n_tables == 0)
+	get_turn_weights (tables[n_tables++]);
+    if (n_threads > MAX_THREADS)
+	n_threads = MAX_THREADS;
+    if (n_threads > n_mazes)
+	n_threads = n_mazes;
+
+    /* Set up each thread's maze context and search space. */
+    set_maze_threads (maze_threads);
+    if (maze_threads > 1)
+	gen_clock = CLOCK_MONOTONIC;
+    squares = (size_t)x_dim * y_dim;
+    if ((results = malloc (n_mazes * sizeof (results[0]))) == NULL)
+	goto no_memory;
+    for (i = 0; i < n_threads; i++) {
+	if ((thr[i].ctx = new_maze ()) == NULL ||
+	    (thr[i].deg = malloc (squares)) == NULL ||
+	    (thr[i].dist = malloc (squares * sizeof (int))) == NULL ||
+	    (thr[i].queue = malloc (squares * sizeof (int))) == NULL)
+	    goto no_memory;
+    }
+
+    if (gen_only)
+	printf ("weights,mazes,x_dim,y_dim,threads,maze_threads,sec,"
+		"mazes_per_sec,gen_usec,gen_nsec_per_square\n");
+    else if (means)
+	printf ("weights,mazes,x_dim,y_dim,dead_ends,junctions,mean_corridor,"
+		"branching,solution,regions,repairs,gen_usec\n");
+    else
+	printf ("weights,maze,seed,x_dim,y_dim,dead_ends,junctions,"
+		"mean_corridor,branching,solution,regions,repairs,gen_usec\n");
+
+    for (tab = 0; tab < n_tables; tab++) {
+	/* Make and measure the batch. */
+	(void)set_turn_weights ((const int (*)[2])tables[tab]);
+	next_maze = 0;
+	(void)clock_gettime (CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n_threads; i++)
+	    if (pthread_create (&thr[i].tid, NULL, tune_thread, &thr[i]) != 0)
+		return 3;
+	for (i = 0; i < n_threads; i++)
+	    (void)pthread_join (thr[i].tid, NULL);
+	(void)clock_gettime (CLOCK_MONOTONIC, &t1);
+	sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	/* Print it, in the order the mazes were numbered. */
+	memset (&sum, 0, sizeof (sum));
+	made = 0;
+	for (i = 0; i < n_mazes; i++) {
+	    r = &results[i];
+	    if (r->failed) {
+		failed = 1;
+		continue;
+	    }
+	    if (gen_only) {
+		sum.gen_usec += r->gen_usec;
+		made++;
+		continue;
+	    }
+	    if (means) {
+		sum.dead_ends += r->dead_ends;
+		sum.junctions += r->junctions;
+		sum.mean_corridor += r->mean_corridor;
+		sum.branching += r->branching;
+		sum.solution += r->solution;
+		sum.regions += r->regions;
+		sum.repairs += r->repairs;
+		sum.gen_usec += r->gen_usec;
+		made++;
+		continue;
+	    }
+	    print_weights ((const int (*)[2])tables[tab]);
+	    printf (",%d,%llu,%d,%d,%d,%d,%.3f,%.4f,%d,%d,%d,%ld\n", i,
+		    (unsigned long long)r->seed, x_dim, y_dim, r->dead_ends,
+		    r->junctions, r->mean_corridor, r->branching, r->solution,
+		    r->regions, r->repairs, r->gen_usec);
+	}
+	if (gen_only && made > 0) {
+	    print_weights ((const int (*)[2])tables[tab]);
+	    printf (",%d,%d,%d,%d,%d,%.3f,%.1f,%.0f,%.2f\n", made, x_dim,
+		    y_dim, n_threads, maze_threads, sec, made / sec,
+		    (double)sum.gen_usec / made,
+		    sum.gen_usec * 1000.0 / made / squares);
+	}
+	if (means && made > 0) {
+	    print_weights ((const int (*)[2])tables[tab]);
+	    printf (",%d,%d,%d,%.1f,%.1f,%.3f,%.4f,%.1f,%.1f,%.1f,%.0f\n",
+		    made, x_dim, y_dim, (double)sum.dead_ends / made,
+		    (double)sum.junctions / made, sum.mean_corridor / made,
+		    sum.branching / made, (double)sum.solution / made,
+		    (double)sum.regions / made, (double)sum.repairs / made,
+		    (double)sum.gen_usec / made);
+	}
+	(void)fflush (stdout);
+    }
+    free_threads (thr, n_threads);
+    free (results);
+    if (failed) {
+	fprintf (stderr, "%s: some mazes could not be made\n", argv[0]);
+	return 1;
+    }
+    return 0;
+
+usage:
+    fprintf (stderr, "usage: %s [-a | -g] [-m threads] [-n mazes] [-s WxH] "
+	     "[-t threads] [-w a,b,c,d,e,f,g,h]...\n", argv[0]);
+    return 2;
+
+no_memory:
+    fprintf (stderr, "%s: out of memory\n", argv[0]);
+    free_threads (thr, n_threads);
+    free (results);
+    return 1;
+}
+
+
+/*
+ * free_threads
+ *   DESCRIPTION: Free the maze context and search space of each thread.
+ *   INPUTS: thr -- the threads, zeroed where not yet set up
+ *           n_threads -- how many to free
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees memory
+ */
+static void
+free_threads (tune_thread_t* thr, int n_threads)
+{
+    int i;
+
+    for (i = 0; i < n_threads; i++) {
+	free_maze (thr[i].ctx);
+	free (thr[i].deg);
+	free (thr[i].dist);
+	free (thr[i].queue);
+    }
+}
+
+
+/*
+ * parse_weights
+ *   DESCRIPTION: Read a table of turn weights, eight numbers separated by
+ *                commas, in the order of turn_wt in maze.c.
+ *   INPUTS: arg -- the table
+ *   OUTPUTS: wt -- the weights
+ *   RETURN VALUE: 0 on success, -1 if the table is not eight numbers each
+ *                 from 1 to 2^20
+ *   SIDE EFFECTS: none
+ */
+static int
+parse_weights (const char* arg, int wt[4][2])
+{
+    char* end;
+    long v;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+	v = strtol (arg, &end, 10);
+	if (end == arg || v < 1 || v > (1 << 20) ||
+	    *end != (i == 7 ? '\0' : ','))
+	    return -1;
+	wt[i / 2][i % 2] = (int)v;
+	arg = end + 1;
+    }
+    return 0;
+}
+
+
+/*
+ * print_weights
+ *   DESCRIPTION: Print a table of turn weights as a quoted CSV field.
+ *   INPUTS: wt -- the weights
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stdout
+ */
+static void
+print_weights (const int wt[4][2])
+{
+    printf ("\"%d,%d,%d,%d,%d,%d,%d,%d\"", wt[0][0], wt[0][1], wt[1][0],
+	    wt[1][1], wt[2][0], wt[2][1], wt[3][0], wt[3][1]);
+}
+
+
+/*
+ * tune_thread
+ *   DESCRIPTION: Make and measure mazes of the batch until none are left,
+ *                taking the next number from the shared count each time.
+ *   INPUTS: arg -- the thread (tune_thread_t)
+ *   OUTPUTS: the results of the mazes made
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: remakes the maze of the thread's context
+ */
+static void*
+tune_thread (void* arg)
+{
+    tune_thread_t* t = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add (&next_maze, 1, __ATOMIC_RELAXED)) <
+	   n_mazes)
+	measure_maze (t, &results[i]);
+    return NULL;
+}
+
+
+/*
+ * measure_maze
+ *   DESCRIPTION: Make a maze in a thread's context and measure it from its
+ *                saved walls (see the measures above), or with -g only
+ *                time it.
+ *   INPUTS: t -- the thread
+ *   OUTPUTS: r -- the measures
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: remakes the maze of the thread's context
+ */
+static void
+measure_maze (tune_thread_t* t, tune_result_t* r)
+{
+    static const int dx[4] = {0, 1, 0, -1}, dy[4] = {-1, 0, 1, 0};
+    struct timespec t0, t1;
+    maze_stats_t ms;
+    maze_saved_t s;
+    size_t row_words;
+    long corridors = 0, corridor_steps = 0, onward = 0, onward_squares = 0;
+    int x, y, d, back, steps, sq, next, head, tail, goal;
+
+    memset (r, 0, sizeof (*r));
+    (void)clock_gettime (gen_clock, &t0);
+    if (build_maze (t->ctx, x_dim, y_dim, 0) != 0) {
+	r->failed = 1;
+	return;
+    }
+    (void)clock_gettime (gen_clock, &t1);
+    r->gen_usec = (t1.tv_sec - t0.tv_sec) * 1000000L +
+		  (t1.tv_nsec - t0.tv_nsec) / 1000;
+    if (gen_only)
+	return;
+    if (save_maze (t->ctx, &s) != 0) {
+	r->failed = 1;
+	return;
+    }
+    r->seed = s.seed;
+    read_maze_stats (t->ctx, &ms);
+    r->regions = ms.regions;
+    r->repairs = ms.walls_removed;
+
+    /*
+     * Square (x,y) is lattice point (2x+1,2y+1); it is open on a side if
+     * the lattice point between it and its neighbour is not a wall.  The
+     * border is all wall, so only sides between squares are looked at.
+     */
+    row_words = (2 * x_dim + 63) / 64;
+#define OPEN(x,y,d)                                                      \
+    ((d) == 0 ? (y) > 0 && !WALL (2 * (x) + 1, 2 * (y)) :                \
+     (d) == 1 ? (x) < x_dim - 1 && !WALL (2 * (x) + 2, 2 * (y) + 1) :    \
+     (d) == 2 ? (y) < y_dim - 1 && !WALL (2 * (x) + 1, 2 * (y) + 2) :    \
+		(x) > 0 && !WALL (2 * (x), 2 * (y) + 1))
+#define WALL(lx,ly)                                                      \
+    ((s.walls[(size_t)((ly) + 1) * row_words + ((lx) >> 6)] >>           \
+      ((lx) & 63)) & 1)
+
+    for (y = 0; y < y_dim; y++) {
+	for (x = 0; x < x_dim; x++) {
+	    sq = y * x_dim + x;
+	    t->deg[sq] = 0;
+	    for (d = 0; d < 4; d++)
+		t->deg[sq] += OPEN (x, y, d);
+	    if (t->deg[sq] == 1)
+		r->dead_ends++;
+	    else if (t->deg[sq] >= 3)
+		r->junctions++;
+	    if (t->deg[sq] >= 2) {
+		onward += t->deg[sq] - 1;
+		onward_squares++;
+	    }
+	}
+    }
+    r->branching = (onward_squares > 0 ? (double)onward / onward_squares : 0);
+
+    /*
+     * Follow each open side of each dead end and junction through the
+     * squares open on two sides until the next dead end or junction.
+     * Each corridor is followed once from each end.
+     */
+    for (sq = 0; sq < x_dim * y_dim; sq++) {
+	if (t->deg[sq] == 2)
+	    continue;
+	for (d = 0; d < 4; d++) {
+	    x = sq % x_dim;
+	    y = sq / x_dim;
+	    if (!OPEN (x, y, d))
+		continue;
+	    back = d;
+	    steps = 0;
+	    for (;;) {
+		x += dx[back];
+		y += dy[back];
+		steps++;
+		if (t->deg[y * x_dim + x] != 2)
+		    break;
+		for (next = 0; next < 4; next++)
+		    if (next != ((back + 2) & 3) && OPEN (x, y, next))
+			break;
+		back = next;
+	    }
+	    corridors++;
+	    corridor_steps += steps;
+	}
+    }
+    r->mean_corridor = (corridors > 0 ?
+			(double)corridor_steps / corridors : 0);
+
+    /* Search outward from (1,1) for the exit. */
+    goal = (s.exit_y / 2) * x_dim + s.exit_x / 2;
+    for (sq = 0; sq < x_dim * y_dim; sq++)
+	t->dist[sq] = -1;
+    t->dist[0] = 0;
+    t->queue[0] = 0;
+    for (head = 0, tail = 1; head < tail && t->dist[goal] < 0; head++) {
+	sq = t->queue[head];
+	x = sq % x_dim;
+	y = sq / x_dim;
+	for (d = 0; d < 4; d++) {
+	    next = (y + dy[d]) * x_dim + x + dx[d];
+	    if (OPEN (x, y, d) && t->dist[next] < 0) {
+		t->dist[next] = t->dist[sq] + 1;
+		t->queue[tail++] = next;
+	    }
+	}
+    }
+    r->solution = t->dist[goal];
+
+#undef OPEN
+#undef WALL
+    free ((void*)s.fruits);
+}
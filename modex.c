@@ -37,14 +37,22 @@
  */
 
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/io.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "blocks.h"
+#include "kernels.h"
+#include "lockprof.h"
 #include "modex.h"
+#include "monotime.h"
 #include "text.h"
 
 
@@ -79,6 +87,48 @@
 #define NUM_GRAPHICS_REGS       9
 #define NUM_ATTR_REGS          22
 
+/* 
+ * Display pages in video memory follow the status bar; the third is
+ * used only for triple buffering.
+ */
+#define NUM_PAGES              3
+#define PAGE_ADDR(page)    (320 * 18 + (page) * 0x4000)
+
+/* 
+ * video memory offset used to time the copy kernels; lies within the
+ * third display page, and is cleared along with the rest of video memory
+ */
+#define COPY_BENCH_ADDR    0xA000
+
+/* 
+ * SOFTWARE_DISPLAY builds replace the VGA with an emulation in ordinary
+ * memory: port writes are dropped (except for the display start address),
+ * each plane of video memory is a static array, and the input status
+ * register reports a vertical retrace SW_REFRESH_HZ times per second.
+ * Such builds need no special privileges, and are used to test and
+ * benchmark the present path.
+ */
+#if !defined(SOFTWARE_DISPLAY)
+#define SOFTWARE_DISPLAY 0
+#endif
+#define SW_REFRESH_HZ         70  /* simulated refresh rate               */
+#define SW_RETRACE_USEC       64  /* simulated vertical sync pulse length */
+
+/* 
+ * display flip pacing; with double buffering, the game's frames (every
+ * 7.8 ms) come faster than the display refreshes (every 14.3 ms on the
+ * emulated display), so a frame's flip is almost never latched within its
+ * own show_screen: presentbench counts every frame as missed, and with the
+ * default budget about seven frames in ten as forced (tearing).  Only a
+ * budget of a whole refresh period avoids that, at the cost of stalling
+ * the game; triple buffering avoids it without stalling.
+ */
+#define PRESENT_BUDGET_USEC 4000  /* default spin budget per show_screen  */
+#define PRESENT_IDLE_USEC   1000  /* present thread nap when retrace time */
+				  /*     cannot be predicted              */
+#define REFRESH_PROBE_USEC 100000 /* time allowed to measure refresh rate */
+#define STATUS_VRETRACE     0x08  /* input status 1 bit: vertical retrace */
+
 /* VGA register settings for mode X */
 static unsigned short mode_X_seq[NUM_SEQUENCER_REGS] = {
     0x0100, 0x2101, 0x0F02, 0x0003, 0x0604
@@ -139,6 +189,19 @@ static void write_font_data ();
 static void set_text_mode_3 (int clear_scr);
 static void copy_image (unsigned char* img, unsigned short scr_addr);
 static void copy_status_bar(unsigned char* img, unsigned short scr_addr);
+static unsigned char read_vga_status ();
+static int measure_refresh ();
+static int wait_for_flip (long long deadline);
+static void switch_present_mode (present_mode_t mode);
+static unsigned long show_screen_triple ();
+static void* present_thread (void* arg);
+static long long next_retrace ();
+static void lock_pages (lock_site_t* site);
+#if SOFTWARE_DISPLAY
+static void sw_set_write_mask (unsigned short mask_hi_bits);
+static void sw_outw (unsigned short port, unsigned short val);
+static unsigned char sw_status ();
+#endif
 
 
 /* 
@@ -148,7 +211,8 @@ static void copy_status_bar(unsigned char* img, unsigned short scr_addr);
  * and translates to a native loop.  It's also a pretty good technique
  * in normal machines (albeit not as elegant as some others for reducing
  * the number of video memory writes; unfortunately, these techniques
- * are slower in emulation...). 
+ * are slower in emulation...).  The copy kernel actually used is picked
+ * at startup by timing the candidates in kernels.c.
  *
  * The size allows the four plane images to move within an area of
  * about twice the size necessary (to reduce the need to deal with
@@ -182,6 +246,64 @@ static int show_x, show_y;          /* logical view coordinates     */
 static unsigned char* mem_image;    /* pointer to start of video memory */
 static unsigned short target_img;   /* offset of displayed screen image */
 
+/* emulated video memory and display start address */
+#if SOFTWARE_DISPLAY
+static unsigned char sw_vram[4][VID_MEM_SIZE];
+static unsigned short sw_start_addr;
+#endif
+
+/*
+ * The present statistics are counted by whichever thread shows or flips
+ * a frame, with or without page_lock held, so every update is a relaxed
+ * atomic add and get_present_stats loads each field atomically.
+ */
+#define PRESENT_ADD(field,n) \
+    (void)__atomic_fetch_add (&present_stats.field, (n), __ATOMIC_RELAXED)
+#define PRESENT_GET(field) \
+    __atomic_load_n (&present_stats.field, __ATOMIC_RELAXED)
+
+/* 
+ * display flip pacing: a flip is pending from the time the display start 
+ * address is written until a vertical retrace (which latches the address)
+ * is seen to begin; seeing the start requires seeing the display period
+ * before it
+ */
+static int present_budget = PRESENT_BUDGET_USEC; /* spin budget (usec) */
+static present_stats_t present_stats;  /* statistics for get_present_stats */
+static int flip_pending;               /* start address not yet latched    */
+static int flip_saw_display;           /* display period seen since write  */
+static long long flip_ready;           /* time the frame was ready         */
+static long long flip_written;         /* time of start address write      */
+static long long last_retrace;         /* time a retrace was last seen     */
+static unsigned long flip_frame;       /* number of the frame being shown  */
+static void (*flip_hook) (unsigned long, long long); /* see set_flip_hook */
+
+/* 
+ * Triple buffering ownership protocol.  Each page is in one of the states
+ * below, and changes state only with page_lock held.  show_screen takes a
+ * FREE page (or, if none, reclaims the READY one, whose frame is then
+ * dropped) as RENDER, fills it, and makes it READY, dropping any older
+ * READY page.  The present thread takes the READY page as FLIPPING,
+ * writes its address, and once the flip is latched makes it SCANOUT and
+ * frees the previous SCANOUT page.  At most one page is READY, one
+ * FLIPPING, and one SCANOUT, so show_screen always finds a page without
+ * waiting.  In double buffering mode, the present thread is idle and
+ * show_screen flips between PAGE_ADDR(0) and PAGE_ADDR(1) itself.
+ */
+typedef enum {
+    PAGE_FREE, PAGE_RENDER, PAGE_READY, PAGE_FLIPPING, PAGE_SCANOUT
+} page_state_t;
+static page_state_t page_state[NUM_PAGES];
+static long long page_ready[NUM_PAGES];    /* time each frame was ready  */
+static unsigned long page_frame[NUM_PAGES]; /* number of each frame      */
+static pthread_mutex_t page_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t page_cv = PTHREAD_COND_INITIALIZER;
+static present_mode_t present_mode = PRESENT_DOUBLE; /* mode in effect   */
+static volatile present_mode_t requested_mode = PRESENT_DOUBLE;
+static pthread_t present_tid;
+static int present_running;                /* present thread exists      */
+static int present_quit;                   /* present thread should exit */
+
 
 /* 
  * functions provided by the caller to set_mode_X() and used to obtain  
@@ -192,6 +314,21 @@ static void (*horiz_line_fn) (int, int, unsigned char[SCROLL_X_DIM]);
 static void (*vert_line_fn) (int, int, unsigned char[SCROLL_Y_DIM]);
 	
 
+#if SOFTWARE_DISPLAY
+
+/* 
+ * In the emulation, the write mask selects the plane image seen through
+ * mem_image (the lowest enabled plane, if several are enabled), and all
+ * port writes other than the CRTC display start address are dropped.
+ */
+#define SET_WRITE_MASK(mask_hi_bits) sw_set_write_mask (mask_hi_bits)
+#define OUTB(port,val)               do { (void)(val); } while (0)
+#define OUTW(port,val)               sw_outw ((port), (val))
+#define REP_OUTSW(port,source,count) do { (void)(source); } while (0)
+#define REP_OUTSB(port,source,count) do { (void)(source); } while (0)
+
+#else /* !SOFTWARE_DISPLAY */
+
 /* 
  * macro used to target a specific video plane or planes when writing
  * to video memory in mode X; bits 8-11 in the mask_hi_bits enable writes
@@ -258,6 +395,8 @@ do {                                                                    \
       : "eax", "memory", "cc");                                         \
 } while (0)
 
+#endif /* SOFTWARE_DISPLAY */
+
 
 /*
  * set_mode_X
@@ -303,7 +442,7 @@ set_mode_X (void (*horiz_fill_fn) (int, int, unsigned char[SCROLL_X_DIM]),
 
     /* One display page goes at the start of video memory. */
     //target_img = 0x0000;
-    target_img = 320 * 18; 
+    target_img = PAGE_ADDR (0); 
 
     /* Map video memory and obtain permission for VGA port access. */
     if (open_memory_and_ports () == -1)
@@ -327,9 +466,16 @@ set_mode_X (void (*horiz_fill_fn) (int, int, unsigned char[SCROLL_X_DIM]),
     set_attr_registers (mode_X_attr);            /* attribute registers   */
     set_graphics_registers (mode_X_graphics);    /* graphics registers    */
     fill_palette ();				 /* palette colors        */
+    SET_WRITE_MASK (0x0F00);			 /* pixel kernels        */
+    init_pixel_kernels (mem_image + COPY_BENCH_ADDR, img3, SCROLL_SIZE);
     clear_screens ();				 /* zero video memory     */
     VGA_blank (0);			         /* unblank the screen    */
 
+    /* Measure the refresh period used to pace display flips. */
+    flip_pending = 0;
+    present_mode = PRESENT_DOUBLE;
+    present_stats.refresh_usec = measure_refresh ();
+
     /* Return success. */
     return 0;
 }
@@ -347,13 +493,27 @@ set_mode_X (void (*horiz_fill_fn) (int, int, unsigned char[SCROLL_X_DIM]),
 void
 clear_mode_X ()
 {
+    LOCK_SITE (site, "clear_mode_X");
     int i;   /* loop index for checking memory fence */
+
+    /* Stop the present thread, which finishes any flip in progress. */
+    if (present_running) {
+	lock_pages (&site);
+	present_quit = 1;
+	(void)pthread_cond_broadcast (&page_cv);
+	site_unlock (&page_lock, &site);
+	(void)pthread_join (present_tid, NULL);
+	present_running = 0;
+	present_quit = 0;
+    }
     
     /* Put VGA into text mode, restore font data, and clear screens. */
     set_text_mode_3 (1);
 
     /* Unmap video memory. */
+#if !SOFTWARE_DISPLAY
     (void)munmap (mem_image, VID_MEM_SIZE);
+#endif
 
     /* Check validity of build buffer memory fence.  Report breakage. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -490,16 +650,37 @@ set_view_window (int scr_x, int scr_y)
  *   DESCRIPTION: Show the logical view window on the video display.
  *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: none
+ *   RETURN VALUE: the number of the frame, counting from 1
  *   SIDE EFFECTS: copies from the build buffer to video memory;
  *                 shifts the VGA display source to point to the new image
  */   
-void
+unsigned long
 show_screen ()
 {
     unsigned char* addr;  /* source address for copy             */
     int p_off;            /* plane offset of first display plane */
     int i;		  /* loop index over video planes        */
+    long long start;      /* time of the call                    */
+    long long deadline;   /* end of the spin budget              */
+
+    /* Apply any change of buffering mode. */
+    if (requested_mode != present_mode)
+	switch_present_mode (requested_mode);
+    if (present_mode == PRESENT_TRIPLE)
+	return show_screen_triple ();
+
+    start = now_usec ();
+    deadline = start + present_budget;
+
+    /* 
+     * The page about to be overwritten is the one shown before the last
+     * flip, and remains on the monitor until that flip is latched.  If
+     * the latch is not seen within the budget, overwrite it anyway.
+     */
+    if (flip_pending && !wait_for_flip (deadline)) {
+	PRESENT_ADD (forced, 1);
+	flip_pending = 0;
+    }
 
     /* 
      * Calculate offset of build buffer plane to be mapped into plane 0 
@@ -526,6 +707,388 @@ show_screen ()
      */
     OUTW (0x03D4, (target_img & 0xFF00) | 0x0C);
     OUTW (0x03D4, ((target_img & 0x00FF) << 8) | 0x0D);
+
+    /* 
+     * The frame is now ready.  The flip happens at the start of the next
+     * vertical retrace; wait for it with whatever budget remains.  If it
+     * is not seen in time, it stays pending until the next call.
+     */
+    flip_pending = 1;
+    flip_saw_display = 0;
+    flip_ready = flip_written = now_usec ();
+    flip_frame = __atomic_add_fetch (&present_stats.frames, 1,
+				     __ATOMIC_RELAXED);
+    if (!wait_for_flip (deadline))
+	PRESENT_ADD (missed, 1);
+    PRESENT_ADD (wait_usec, now_usec () - start);
+    return flip_frame;
+}
+
+
+/*
+ * next_screen_frame
+ *   DESCRIPTION: Get the number that the next call to show_screen will
+ *                give its frame, so that the caller can note what the
+ *                frame shows before the frame can reach the monitor (and
+ *                the flip hook be called for it).  Only the thread that
+ *                calls show_screen may call this.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of the next frame
+ *   SIDE EFFECTS: none
+ */   
+unsigned long
+next_screen_frame ()
+{
+    LOCK_SITE (site, "next_screen_frame");
+    unsigned long frame;  /* number of the next frame */
+
+    lock_pages (&site);
+    frame = PRESENT_GET (frames) + 1;
+    site_unlock (&page_lock, &site);
+    return frame;
+}
+
+
+/*
+ * show_screen_triple
+ *   DESCRIPTION: Show the logical view window with triple buffering:
+ *                copy it to a page that is neither on the monitor nor
+ *                about to be, and hand the page to the present thread.
+ *                See the description of the ownership protocol above.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of the frame, counting from 1
+ *   SIDE EFFECTS: copies from the build buffer to video memory; may drop
+ *                 a finished frame that has not yet been shown
+ */   
+static unsigned long
+show_screen_triple ()
+{
+    LOCK_SITE (site, "show_screen_triple");
+    unsigned char* addr;  /* source address for copy             */
+    int p_off;            /* plane offset of first display plane */
+    int page;             /* page to fill                        */
+    int i;		  /* loop index over pages or planes     */
+    long long start;      /* time of the call                    */
+    unsigned long frame;  /* number of the frame                 */
+
+    start = now_usec ();
+
+    /* Take a free page, or reclaim the frame waiting to be shown. */
+    lock_pages (&site);
+    for (page = 0; page < NUM_PAGES && page_state[page] != PAGE_FREE; page++);
+    if (page == NUM_PAGES) {
+	for (page = 0; page_state[page] != PAGE_READY; page++);
+	PRESENT_ADD (dropped, 1);
+    }
+    page_state[page] = PAGE_RENDER;
+    site_unlock (&page_lock, &site);
+    PRESENT_ADD (wait_usec, now_usec () - start);
+
+    /* Draw to each plane of the page, as in show_screen. */
+    p_off = (3 - (show_x & 3));
+    addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
+    for (i = 0; i < 4; i++) {
+	SET_WRITE_MASK (1 << (i + 8));
+	copy_image (addr + ((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i), 
+	            PAGE_ADDR (page));
+    }
+
+    /* Queue the page for the present thread, replacing any older frame. */
+    lock_pages (&site);
+    for (i = 0; i < NUM_PAGES; i++) {
+	if (page_state[i] == PAGE_READY) {
+	    page_state[i] = PAGE_FREE;
+	    PRESENT_ADD (dropped, 1);
+	}
+    }
+    page_state[page] = PAGE_READY;
+    page_ready[page] = now_usec ();
+    page_frame[page] = frame = __atomic_add_fetch (&present_stats.frames, 1,
+						   __ATOMIC_RELAXED);
+    (void)pthread_cond_broadcast (&page_cv);
+    site_unlock (&page_lock, &site);
+    return frame;
+}
+
+
+/*
+ * present_thread
+ *   DESCRIPTION: Flip the display to frames queued by show_screen_triple.
+ *                Once a frame is queued, the thread sleeps until shortly
+ *                before the predicted retrace, writes the start address
+ *                of the newest frame, and busy-waits (for at most the
+ *                spin budget at a time) for the flip to be latched.
+ *   INPUTS: arg -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: changes the displayed page; updates present_stats
+ */   
+static void*
+present_thread (void* arg)
+{
+    LOCK_SITE (site, "present_thread");
+    int page;         /* page being flipped to            */
+    int i;            /* loop index over pages            */
+    int period;       /* refresh period                   */
+
+    lock_pages (&site);
+    while (1) {
+	/* Wait for a frame. */
+	for (page = 0; page < NUM_PAGES; page++)
+	    if (page_state[page] == PAGE_READY)
+		break;
+	if (present_quit)
+	    break;
+	if (present_mode != PRESENT_TRIPLE || page == NUM_PAGES) {
+	    site_cond_wait (&page_cv, &page_lock, &site);
+	    continue;
+	}
+
+	/* 
+	 * Sleep until shortly before the next retrace, then flip to the
+	 * newest frame, which may have replaced the one found above.
+	 */
+	period = present_stats.refresh_usec;
+	site_unlock (&page_lock, &site);
+	sleep_until (next_retrace () - present_budget / 2);
+	lock_pages (&site);
+
+	/* 
+	 * While the lock was dropped, the game may have quit or gone back
+	 * to double buffering (which takes back the queued frame).
+	 */
+	for (page = 0; page < NUM_PAGES; page++)
+	    if (page_state[page] == PAGE_READY)
+		break;
+	if (present_quit || present_mode != PRESENT_TRIPLE ||
+	    page == NUM_PAGES)
+	    continue;
+	page_state[page] = PAGE_FLIPPING;
+	flip_ready = page_ready[page];
+	flip_frame = page_frame[page];
+	site_unlock (&page_lock, &site);
+
+	/* Ask for the flip, and wait for the latch. */
+	OUTW (0x03D4, (PAGE_ADDR (page) & 0xFF00) | 0x0C);
+	OUTW (0x03D4, ((PAGE_ADDR (page) & 0x00FF) << 8) | 0x0D);
+	flip_pending = 1;
+	flip_saw_display = 0;
+	flip_written = now_usec ();
+	while (!wait_for_flip (now_usec () + present_budget)) {
+	    PRESENT_ADD (missed, 1);
+	    if (period > 0)
+		sleep_until (next_retrace () - present_budget / 2);
+	    else
+		sleep_until (now_usec () + PRESENT_IDLE_USEC);
+	}
+
+	/* The flip is latched: the old page on the monitor is now free. */
+	lock_pages (&site);
+	for (i = 0; i < NUM_PAGES; i++)
+	    if (page_state[i] == PAGE_SCANOUT)
+		page_state[i] = PAGE_FREE;
+	page_state[page] = PAGE_SCANOUT;
+	(void)pthread_cond_broadcast (&page_cv);
+    }
+    site_unlock (&page_lock, &site);
+    return NULL;
+}
+
+
+/*
+ * next_retrace
+ *   DESCRIPTION: Predict the start of the next vertical retrace from the
+ *                last one seen and the refresh period.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the predicted time, or the current time if no retrace
+ *                 has been seen
+ *   SIDE EFFECTS: none
+ */   
+static long long
+next_retrace ()
+{
+    long long now = now_usec ();         /* current time    */
+    long long p = present_stats.refresh_usec; /* refresh period */
+
+    if (p <= 0 || last_retrace <= 0)
+	return now;
+    return last_retrace + ((now - last_retrace) / p + 1) * p;
+}
+
+
+/*
+ * switch_present_mode
+ *   DESCRIPTION: Change between double and triple buffering.  Entering
+ *                triple buffering waits for any pending flip (at most one
+ *                refresh period) and starts the present thread if needed;
+ *                leaving it drops any queued frame and waits for the
+ *                present thread to finish its flip.  Called only by
+ *                show_screen, so no frame is being drawn.
+ *   INPUTS: mode -- the new mode
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may start the present thread; on failure to do so,
+ *                 stays with double buffering and prints an error
+ */   
+static void
+switch_present_mode (present_mode_t mode)
+{
+    LOCK_SITE (site, "switch_present_mode");
+    int i; /* loop index over pages */
+
+    if (mode == PRESENT_TRIPLE) {
+	if (!present_running) {
+	    if (pthread_create (&present_tid, NULL, present_thread, NULL) != 0) {
+		perror ("create present thread");
+		requested_mode = PRESENT_DOUBLE;
+		return;
+	    }
+	    present_running = 1;
+	}
+	if (flip_pending)
+	    (void)wait_for_flip (LLONG_MAX);
+	lock_pages (&site);
+	for (i = 0; i < NUM_PAGES; i++)
+	    page_state[i] = (PAGE_ADDR (i) == target_img ? PAGE_SCANOUT : 
+	    		     PAGE_FREE);
+	present_mode = PRESENT_TRIPLE;
+	site_unlock (&page_lock, &site);
+	return;
+    }
+
+    lock_pages (&site);
+    for (i = 0; i < NUM_PAGES; i++) {
+	if (page_state[i] == PAGE_READY) {
+	    page_state[i] = PAGE_FREE;
+	    PRESENT_ADD (dropped, 1);
+	}
+    }
+    for (i = 0; i < NUM_PAGES; ) {
+	if (page_state[i] == PAGE_FLIPPING) {
+	    site_cond_wait (&page_cv, &page_lock, &site);
+	    i = 0;
+	} else {
+	    i++;
+	}
+    }
+    present_mode = PRESENT_DOUBLE;
+
+    /* 
+     * Double buffering draws next into target_img ^ 0x4000, which must
+     * not be the page on the monitor.
+     */
+    for (i = 0; i < NUM_PAGES && page_state[i] != PAGE_SCANOUT; i++);
+    target_img = (i == 1 ? PAGE_ADDR (1) : PAGE_ADDR (0));
+    site_unlock (&page_lock, &site);
+}
+
+
+/*
+ * set_present_mode
+ *   DESCRIPTION: Choose double or triple buffering.  May be called from
+ *                any thread; the change is made by the next show_screen.
+ *   INPUTS: mode -- the mode to use
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+set_present_mode (present_mode_t mode)
+{
+    requested_mode = mode;
+}
+
+
+/*
+ * get_present_mode
+ *   DESCRIPTION: Get the buffering mode most recently chosen.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the mode
+ *   SIDE EFFECTS: none
+ */   
+present_mode_t
+get_present_mode ()
+{
+    return requested_mode;
+}
+
+
+/*
+ * set_present_budget
+ *   DESCRIPTION: Set the longest time that one call to show_screen may
+ *                spend busy-waiting for vertical retraces.  A budget of
+ *                zero never waits; a budget of at least one refresh
+ *                period never lets the screen tear.
+ *   INPUTS: usec -- the budget in microseconds (negative means zero)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the budget used by show_screen
+ */   
+void
+set_present_budget (int usec)
+{
+    present_budget = (usec < 0 ? 0 : usec);
+}
+
+
+/*
+ * set_flip_hook
+ *   DESCRIPTION: Set a function to be called each time a frame is known
+ *                to be on the monitor: when the flip to it is seen, or
+ *                when a full refresh period has passed since it was
+ *                written.  The function is given the frame number
+ *                returned by show_screen and the time (from
+ *                CLOCK_MONOTONIC, in microseconds).  Frames dropped or
+ *                overwritten before being seen are not reported, so a
+ *                report also covers any earlier frame not yet reported.
+ *                The hook runs in the thread that flips: the caller of
+ *                show_screen with double buffering, or the present
+ *                thread with triple buffering.  Set it before set_mode_X.
+ *   INPUTS: fn -- the function, or NULL for none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+set_flip_hook (void (*fn) (unsigned long frame, long long usec))
+{
+    flip_hook = fn;
+}
+
+
+/*
+ * get_present_stats
+ *   DESCRIPTION: Get the display flip statistics gathered by show_screen
+ *                and the present thread.  With triple buffering, counts
+ *                may be slightly stale while frames are being shown.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- a copy of the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+void
+get_present_stats (present_stats_t* stats)
+{
+    LOCK_SITE (site, "get_present_stats");
+    lock_pages (&site);
+    stats->frames = PRESENT_GET (frames);
+    stats->on_retrace = PRESENT_GET (on_retrace);
+    stats->missed = PRESENT_GET (missed);
+    stats->unobserved = PRESENT_GET (unobserved);
+    stats->forced = PRESENT_GET (forced);
+    stats->dropped = PRESENT_GET (dropped);
+    stats->spin_usec = PRESENT_GET (spin_usec);
+    stats->wait_usec = PRESENT_GET (wait_usec);
+    stats->latency_usec = PRESENT_GET (latency_usec);
+    stats->max_latency_usec = PRESENT_GET (max_latency_usec);
+    stats->refresh_usec = PRESENT_GET (refresh_usec);
+    stats->vram_bytes = PRESENT_GET (vram_bytes);
+    stats->contended = PRESENT_GET (contended);
+    site_unlock (&page_lock, &site);
 }
 
 /*
@@ -566,11 +1129,16 @@ void show_status_bar(char * msg, const char* typing, int level){
 void 
 clear_screens ()
 {
+#if SOFTWARE_DISPLAY
+    /* The emulated write mask reaches only one plane, so clear them all. */
+    memset (sw_vram, 0, sizeof (sw_vram));
+#else
     /* Write to all four planes at once. */ 
     SET_WRITE_MASK (0x0F00);
 
     /* Set 64kB to zero (times four planes = 256kB). */
     memset (mem_image, 0, MODE_X_MEM_SIZE);
+#endif
 }
 
 
@@ -589,7 +1157,7 @@ clear_screens ()
 void
 draw_full_block (int pos_x, int pos_y, unsigned char* blk)
 {
-    int dx, dy;          /* loop indices for x and y traversal of block */
+    int dy;              /* loop index for y traversal of block         */
     int x_left, x_right; /* clipping limits in horizontal dimension     */
     int y_top, y_bottom; /* clipping limits in vertical dimension       */
 
@@ -633,11 +1201,10 @@ draw_full_block (int pos_x, int pos_y, unsigned char* blk)
 
     /* Draw the clipped image. */
     for (dy = 0; dy < y_bottom; dy++, pos_y++) {
-	for (dx = 0; dx < x_right; dx++, pos_x++, blk++)
-	    *(img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
-	      (3 - (pos_x & 3)) * SCROLL_SIZE) = *blk;
-	pos_x -= x_right;
-	blk += x_left;
+	(*kernels.split) (img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
+			  3 * SCROLL_SIZE, -SCROLL_SIZE, blk, x_right,
+			  pos_x & 3);
+	blk += x_right + x_left;
     }
 }
 
@@ -656,7 +1223,7 @@ draw_full_block (int pos_x, int pos_y, unsigned char* blk)
 void
 draw_full_floating (int pos_x, int pos_y, unsigned char* blk)
 {
-    int dx, dy;          /* loop indices for x and y traversal of block */
+    int dy;              /* loop index for y traversal of block         */
     int x_left, x_right; /* clipping limits in horizontal dimension     */
     int y_top, y_bottom; /* clipping limits in vertical dimension       */
 
@@ -700,11 +1267,9 @@ draw_full_floating (int pos_x, int pos_y, unsigned char* blk)
 
     /* Draw the clipped image. */
     for (dy = 0; dy < y_bottom; dy++, pos_y++) {
-  for (dx = 0; dx < x_right; dx++, pos_x++, blk++)
-      *(img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
-        (3 - (pos_x & 3)) * SCROLL_SIZE) = *blk;
-  pos_x -= x_right;
-  blk += x_left;
+  (*kernels.split) (img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
+                    3 * SCROLL_SIZE, -SCROLL_SIZE, blk, x_right, pos_x & 3);
+  blk += x_right + x_left;
     }
 }
 
@@ -722,7 +1287,7 @@ draw_full_floating (int pos_x, int pos_y, unsigned char* blk)
 void
 save_old_floor (int pos_x, int pos_y, unsigned char* blk)
 {
-    int dx, dy;          /* loop indices for x and y traversal of block */
+    int dy;              /* loop index for y traversal of block         */
     int x_left, x_right; /* clipping limits in horizontal dimension     */
     int y_top, y_bottom; /* clipping limits in vertical dimension       */
 
@@ -764,13 +1329,11 @@ save_old_floor (int pos_x, int pos_y, unsigned char* blk)
     /* Adjust y_bottom to hold the number of pixel rows to be drawn. */
     y_bottom -= y_top;
 
-    /* Draw the clipped image. */
+    /* Copy the clipped image. */
     for (dy = 0; dy < y_bottom; dy++, pos_y++) {
-  for (dx = 0; dx < x_right; dx++, pos_x++, blk++)
-      *blk = *(img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
-        (3 - (pos_x & 3)) * SCROLL_SIZE);
-  pos_x -= x_right;
-  blk += x_left;
+  (*kernels.merge) (blk, img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
+                    3 * SCROLL_SIZE, -SCROLL_SIZE, x_right, pos_x & 3);
+  blk += x_right + x_left;
     }
 }
 
@@ -787,7 +1350,7 @@ save_old_floor (int pos_x, int pos_y, unsigned char* blk)
 void
 save_old_floating (int pos_x, int pos_y, unsigned char* blk)
 {
-    int dx, dy;          /* loop indices for x and y traversal of block */
+    int dy;              /* loop index for y traversal of block         */
     int x_left, x_right; /* clipping limits in horizontal dimension     */
     int y_top, y_bottom; /* clipping limits in vertical dimension       */
 
@@ -829,13 +1392,11 @@ save_old_floating (int pos_x, int pos_y, unsigned char* blk)
     /* Adjust y_bottom to hold the number of pixel rows to be drawn. */
     y_bottom -= y_top;
 
-    /* Draw the clipped image. */
+    /* Copy the clipped image. */
     for (dy = 0; dy < y_bottom; dy++, pos_y++) {
-  for (dx = 0; dx < x_right; dx++, pos_x++, blk++)
-      *blk = *(img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
-        (3 - (pos_x & 3)) * SCROLL_SIZE);
-  pos_x -= x_right;
-  blk += x_left;
+  (*kernels.merge) (blk, img3 + (pos_x >> 2) + pos_y * SCROLL_X_WIDTH +
+                    3 * SCROLL_SIZE, -SCROLL_SIZE, x_right, pos_x & 3);
+  blk += x_right + x_left;
     }
 }
 
@@ -917,8 +1478,6 @@ draw_horiz_line (int y)
     unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line */
     unsigned char* addr;             /* address of first pixel in build    */
    				     /*     buffer (without plane offset)  */
-    int p_off;                       /* offset of plane of first pixel     */
-    int i;			     /* loop index over pixels             */
 
     /* Check whether requested line falls in the logical view window. */
     if (y < 0 || y >= SCROLL_Y_DIM)
@@ -933,22 +1492,43 @@ draw_horiz_line (int y)
     /* Calculate starting address in build buffer. */
     addr = img3 + (show_x >> 2) + y * SCROLL_X_WIDTH;
 
-    /* Calculate plane offset of first pixel. */
-    p_off = (3 - (show_x & 3));
-
-    /* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_X_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
-	if (--p_off < 0) {
-	    p_off = 3;
-	    addr++;
-	}
-    }
+    /* 
+     * Copy image data into appropriate planes in build buffer.  Plane 0
+     * lies at the highest address, and the first pixel is in plane
+     * (show_x & 3).
+     */
+    (*kernels.split) (addr + 3 * SCROLL_SIZE, -SCROLL_SIZE, buf,
+		      SCROLL_X_DIM, show_x & 3);
 
     /* Return success. */
     return 0;
 }
 
+
+/*
+ * draw_view_image
+ *   DESCRIPTION: Draw an image of the whole logical view window, made
+ *                beforehand (e.g., by render_maze_view), into the build
+ *                buffer, as draw_horiz_line would draw each of its lines.
+ *   INPUTS: img -- SCROLL_Y_DIM lines of SCROLL_X_DIM pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */   
+void
+draw_view_image (const unsigned char* img)
+{
+    unsigned char* addr; /* address of first pixel in build buffer */
+    int i;
+
+    addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
+    for (i = 0; i < SCROLL_Y_DIM; i++) {
+	(*kernels.split) (addr + 3 * SCROLL_SIZE, -SCROLL_SIZE,
+			  img + i * SCROLL_X_DIM, SCROLL_X_DIM, show_x & 3);
+	addr += SCROLL_X_WIDTH;
+    }
+}
+
 #endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 
@@ -964,6 +1544,11 @@ draw_horiz_line (int y)
 static int
 open_memory_and_ports ()
 {
+#if SOFTWARE_DISPLAY
+    /* The emulation needs neither ports nor physical memory. */
+    mem_image = sw_vram[0];
+    return 0;
+#else
     int mem_fd;  /* file descriptor for physical memory image */
 
     /* Obtain permission to access ports 0x03C0 through 0x03DA. */
@@ -988,6 +1573,7 @@ open_memory_and_ports ()
     /* Close /dev/mem file descriptor and return success. */
     (void)close (mem_fd);
     return 0;
+#endif
 }
 
 
@@ -1008,6 +1594,7 @@ VGA_blank (int blank_bit)
      */
     blank_bit = ((blank_bit & 1) << 5);
 
+#if !SOFTWARE_DISPLAY
     asm volatile (
 	"movb $0x01,%%al         /* Set sequencer index to 1. */       ;"
 	"movw $0x03C4,%%dx                                             ;"
@@ -1023,6 +1610,7 @@ VGA_blank (int blank_bit)
 	"movb $0x20,%%al                                               ;"
 	"outb %%al,(%%dx)                                               "
       : : "g" (blank_bit) : "eax", "edx", "memory");
+#endif
 }
 
 
@@ -1090,9 +1678,7 @@ static void
 set_attr_registers (unsigned char table[NUM_ATTR_REGS * 2])
 {
     /* Reset attribute register to write index next rather than data. */
-    asm volatile (
-	"inb (%%dx),%%al"
-      : : "d" (0x03DA) : "eax", "memory");
+    (void)read_vga_status ();
     REP_OUTSB (0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
@@ -1380,7 +1966,7 @@ write_font_data ()
 static void
 set_text_mode_3 (int clear_scr)
 {
-    unsigned long* txt_scr; /* pointer to text screens in video memory */
+    uint32_t* txt_scr;      /* pointer to text screens in video memory */
     int i;                  /* loop over text screen words             */
 
     VGA_blank (1);                               /* blank the screen        */
@@ -1395,7 +1981,7 @@ set_text_mode_3 (int clear_scr)
     set_graphics_registers (text_graphics);      /* graphics registers      */
     fill_palette ();				 /* palette colors          */
     if (clear_scr) {				 /* clear screens if needed */
-	txt_scr = (unsigned long*)(mem_image + 0x18000); 
+	txt_scr = (uint32_t*)(mem_image + 0x18000); 
 	for (i = 0; i < 8192; i++)
 	    *txt_scr++ = 0x07200720;
     }
@@ -1418,19 +2004,11 @@ static void
 copy_image (unsigned char* img, unsigned short scr_addr)
 {
     /* 
-     * memcpy is actually probably good enough here, and is usually
-     * implemented using ISA-specific features like those below,
-     * but the code here provides an example of x86 string moves
+     * The copy kernel is chosen by set_mode_X from REP MOVSB, REP MOVSL,
+     * and vector streaming stores, whichever is fastest on this machine.
      */
-    asm volatile (
-        "cld                                                 ;"
-       	"movl $14560,%%ecx                                   ;"
-        // 14560 = 320 * 182 /4 which is the size of game screen
-       	"rep movsb    # copy ECX bytes from M[ESI] to M[EDI]  "
-      : /* no outputs */
-      : "S" (img), "D" (mem_image + scr_addr) 
-      : "eax", "ecx", "memory"
-    );
+    (*kernels.copy) (mem_image + scr_addr, img, SCROLL_SIZE);
+    PRESENT_ADD (vram_bytes, SCROLL_SIZE);
 }
 
 /*
@@ -1446,23 +2024,212 @@ copy_image (unsigned char* img, unsigned short scr_addr)
 static void
 copy_status_bar(unsigned char* img, unsigned short scr_addr)
 {
-    /* 
-     * memcpy is actually probably good enough here, and is usually
-     * implemented using ISA-specific features like those below,
-     * but the code here provides an example of x86 string moves
-     */
+    (*kernels.copy) (mem_image + scr_addr, img, STATUS_BAR_PLANE_SIZE);
+    PRESENT_ADD (vram_bytes, STATUS_BAR_PLANE_SIZE);
+}
+
+
+
+
+/*
+ * read_vga_status
+ *   DESCRIPTION: Read VGA input status register 1 (port 0x3DA).  Bit 3
+ *                is set during vertical retrace.  Reading the register
+ *                also resets the attribute controller to expect an index.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the register value
+ *   SIDE EFFECTS: resets the attribute controller flip-flop
+ */   
+static unsigned char
+read_vga_status ()
+{
+#if SOFTWARE_DISPLAY
+    return sw_status ();
+#else
+    unsigned char val; /* value read from the port */
+
     asm volatile (
-        "cld                                                 ;"
-        "movl $1440, %%ecx                                   ;"
-        // 1440 = 18 * 320 / 4 which is the size of status bar
-        "rep movsb    # copy ECX bytes from M[ESI] to M[EDI]  "
-      : /* no outputs */
-      : "S" (img), "D" (mem_image + scr_addr) 
-      : "eax", "ecx", "memory"
-    );
+	"inb (%w1),%b0"
+      : "=a" (val) : "d" (0x03DA) : "memory");
+    return val;
+#endif
 }
 
 
+/*
+ * measure_refresh
+ *   DESCRIPTION: Measure the display refresh period as the time between
+ *                the starts of two vertical retraces.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the period in microseconds, or 0 if no retrace was seen
+ *                 within REFRESH_PROBE_USEC (flips are then not paced)
+ *   SIDE EFFECTS: busy-waits for up to REFRESH_PROBE_USEC
+ */   
+static int
+measure_refresh ()
+{
+    long long start, edge[2]; /* probe start and retrace start times */
+    int saw_display;          /* display period seen since last edge */
+    int n;                    /* number of retrace starts seen       */
+
+    start = now_usec ();
+    saw_display = 0;
+    for (n = 0; n < 2; ) {
+	if ((edge[n] = now_usec ()) - start >= REFRESH_PROBE_USEC)
+	    return 0;
+	if ((read_vga_status () & STATUS_VRETRACE) == 0)
+	    saw_display = 1;
+	else if (saw_display) {
+	    saw_display = 0;
+	    n++;
+	}
+    }
+    last_retrace = edge[1];
+    return (int)(edge[1] - edge[0]);
+}
+
+
+/*
+ * lock_pages
+ *   DESCRIPTION: Take page_lock, counting the times it was held by
+ *                another thread.
+ *   INPUTS: site -- the call site, for lock profiling
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates present_stats
+ */
+static void
+lock_pages (lock_site_t* site)
+{
+    if (site_lock (&page_lock, site))
+	PRESENT_ADD (contended, 1);
+}
+
+
+/*
+ * wait_for_flip
+ *   DESCRIPTION: Busy-wait until the pending flip is latched, i.e., until
+ *                a vertical retrace begins after the display start address
+ *                was written, or until a deadline passes.  Called only by
+ *                the thread that wrote the address.  A flip counts
+ *                as done without being seen once a full refresh period has
+ *                passed since the write (a retrace must have begun in that
+ *                time), or immediately if no retrace signal was found.
+ *   INPUTS: deadline -- time (from now_usec) at which to give up
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the flip is done, 0 if still pending
+ *   SIDE EFFECTS: updates flip state and present_stats
+ */   
+static int
+wait_for_flip (long long deadline)
+{
+    long long start, t; /* start of the wait and current time */
+    long long max;      /* longest ready-to-flip time so far  */
+
+    start = t = now_usec ();
+    while (1) {
+	if (present_stats.refresh_usec == 0 ||
+	    t - flip_written >= present_stats.refresh_usec) {
+	    PRESENT_ADD (unobserved, 1);
+	    flip_pending = 0;
+	    if (flip_hook != NULL)
+		(*flip_hook) (flip_frame, t);
+	    break;
+	}
+	if ((read_vga_status () & STATUS_VRETRACE) == 0) {
+	    flip_saw_display = 1;
+	} else if (flip_saw_display) {
+	    last_retrace = t;
+	    PRESENT_ADD (on_retrace, 1);
+	    PRESENT_ADD (latency_usec, t - flip_ready);
+	    max = PRESENT_GET (max_latency_usec);
+	    while (t - flip_ready > max &&
+		   !__atomic_compare_exchange_n
+		   (&present_stats.max_latency_usec, &max, t - flip_ready, 1,
+		    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	    flip_pending = 0;
+	    if (flip_hook != NULL)
+		(*flip_hook) (flip_frame, t);
+	    break;
+	}
+	if (t >= deadline)
+	    break;
+	t = now_usec ();
+    }
+    PRESENT_ADD (spin_usec, t - start);
+    return !flip_pending;
+}
+
+
+#if SOFTWARE_DISPLAY
+
+/*
+ * sw_set_write_mask
+ *   DESCRIPTION: Emulate the sequencer map mask by pointing mem_image at
+ *                the image of the lowest plane enabled.
+ *   INPUTS: mask_hi_bits -- bits 8-11 enable planes 0-3
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes mem_image
+ */   
+static void
+sw_set_write_mask (unsigned short mask_hi_bits)
+{
+    int p; /* loop index over planes */
+
+    for (p = 0; p < 4; p++) {
+	if (mask_hi_bits & (0x100 << p)) {
+	    mem_image = sw_vram[p];
+	    return;
+	}
+    }
+}
+
+
+/*
+ * sw_outw
+ *   DESCRIPTION: Emulate a two-byte port write.  Only the CRTC display
+ *                start address registers (0x0C and 0x0D) are recorded.
+ *   INPUTS: port -- the port written
+ *           val -- register index (low byte) and value (high byte)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may change sw_start_addr
+ */   
+static void
+sw_outw (unsigned short port, unsigned short val)
+{
+    if (port != 0x03D4)
+	return;
+    if ((val & 0xFF) == 0x0C)
+	sw_start_addr = (sw_start_addr & 0x00FF) | (val & 0xFF00);
+    else if ((val & 0xFF) == 0x0D)
+	sw_start_addr = (sw_start_addr & 0xFF00) | (val >> 8);
+}
+
+
+/*
+ * sw_status
+ *   DESCRIPTION: Emulate input status register 1.  The vertical retrace
+ *                (and display disable) bits are set for the first
+ *                SW_RETRACE_USEC of every 1 / SW_REFRESH_HZ seconds.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the emulated register value
+ *   SIDE EFFECTS: none
+ */   
+static unsigned char
+sw_status ()
+{
+    if (now_usec () % (1000000 / SW_REFRESH_HZ) < SW_RETRACE_USEC)
+	return STATUS_VRETRACE | 0x01;
+    return 0x00;
+}
+
+#endif /* SOFTWARE_DISPLAY */
+
 
 #if defined(TEXT_RESTORE_PROGRAM)
 
@@ -1494,3 +2261,101 @@ main ()
 }
 
 #endif
+
+
+#if defined(PRESENT_BENCH_PROGRAM)
+
+#if !SOFTWARE_DISPLAY
+#error "the present benchmark requires SOFTWARE_DISPLAY"
+#endif
+
+#define BENCH_FRAMES   512   /* frames presented per budget          */
+#define BENCH_RATE_HZ  128   /* frame rate of the game (the RTC rate) */
+
+/*
+ * bench_horiz_line, bench_vert_line
+ *   DESCRIPTION: Line image callbacks for the present benchmark; fill
+ *                the line with a single color.
+ *   INPUTS: (x,y) -- logical position of the line (ignored)
+ *   OUTPUTS: buf -- the line image
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */   
+static void
+bench_horiz_line (int x, int y, unsigned char buf[SCROLL_X_DIM])
+{
+    memset (buf, 0x30, SCROLL_X_DIM);
+}
+static void
+bench_vert_line (int x, int y, unsigned char buf[SCROLL_Y_DIM])
+{
+    memset (buf, 0x30, SCROLL_Y_DIM);
+}
+
+
+/*
+ * main -- for the "presentbench" program
+ *   DESCRIPTION: Present frames to the emulated display at the game's
+ *                frame rate with double and triple buffering and a range
+ *                of spin budgets, and report the flip statistics for each
+ *                combination.
+ *   INPUTS: none (command line arguments are ignored)
+ *   OUTPUTS: one line of statistics per combination on stdout
+ *   RETURN VALUE: 0 on success, 3 in panic scenarios
+ */   
+int
+main ()
+{
+    LOCK_SITE (site, "present bench");
+    static const int budgets[] = {0, 1000, 4000, 8000, 15000};
+    static const char* const mode_names[] = {"double", "triple"};
+    struct timespec next;  /* time of the next frame                 */
+    present_stats_t st;    /* statistics for one run                 */
+    int m, b, f;           /* loop indices over modes, budgets, frames */
+
+    if (set_mode_X (bench_horiz_line, bench_vert_line) != 0)
+        return 3;
+    printf ("refresh period %d usec, frame period %d usec\n",
+	    present_stats.refresh_usec, 1000000 / BENCH_RATE_HZ);
+
+    for (m = PRESENT_DOUBLE; m <= PRESENT_TRIPLE; m++) {
+	set_present_mode (m);
+	for (b = 0; b < (int)(sizeof (budgets) / sizeof (budgets[0])); b++) {
+	    set_present_budget (budgets[b]);
+
+	    /* Let the last flip finish, then start counting afresh. */
+	    sleep_until (now_usec () + 2 * present_stats.refresh_usec);
+	    lock_pages (&site);
+	    f = present_stats.refresh_usec;
+	    memset (&present_stats, 0, sizeof (present_stats));
+	    present_stats.refresh_usec = f;
+	    site_unlock (&page_lock, &site);
+
+	    (void)clock_gettime (CLOCK_MONOTONIC, &next);
+	    for (f = 0; f < BENCH_FRAMES; f++) {
+		show_screen ();
+		if ((next.tv_nsec += 1000000000 / BENCH_RATE_HZ) >= 
+		    1000000000) {
+		    next.tv_nsec -= 1000000000;
+		    next.tv_sec++;
+		}
+		(void)clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				       NULL);
+	    }
+	    get_present_stats (&st);
+	    printf ("%s, budget %5d: %lu frames, %lu on retrace, "
+		    "%lu missed, %lu unobserved, %lu forced, %lu dropped; "
+		    "wait %lld spin %lld usec/frame; ready-to-flip mean %lld "
+		    "max %lld usec\n", mode_names[m], budgets[b], st.frames,
+		    st.on_retrace, st.missed, st.unobserved, st.forced,
+		    st.dropped, st.wait_usec / st.frames, 
+		    st.spin_usec / st.frames, (st.on_retrace ? 
+		    st.latency_usec / st.on_retrace : 0), st.max_latency_usec);
+	}
+    }
+
+    clear_mode_X ();
+    return 0;
+}
+
+#endif /* PRESENT_BENCH_PROGRAM */
@@ -110,6 +110,39 @@
  * is drawn.  Other data are left untouched in most cases.
  */
 
+/* 
+ * statistics kept by show_screen on the pacing of display flips; a flip
+ * is the change of the displayed page, which the VGA latches at the start
+ * of a vertical retrace
+ */
+typedef struct {
+    unsigned long frames;     /* frames presented                          */
+    unsigned long on_retrace; /* flips seen happening at a retrace         */
+    unsigned long missed;     /* presents that ran out of spin budget      */
+    			      /*     before their flip was seen            */
+    unsigned long unobserved; /* flips inferred from elapsed time only     */
+    unsigned long forced;     /* pages reused before their flip was seen   */
+    			      /*     (the screen may tear)                 */
+    unsigned long dropped;    /* frames replaced by newer ones before      */
+    			      /*     being shown (triple buffering only)   */
+    long long spin_usec;      /* total time spent polling for retrace      */
+    long long wait_usec;      /* total time show_screen callers waited     */
+    long long latency_usec;   /* total ready-to-flip time of seen flips    */
+    long long max_latency_usec; /* longest ready-to-flip time              */
+    int refresh_usec;         /* measured refresh period; 0 if no retrace  */
+    unsigned long long vram_bytes; /* bytes copied to video memory         */
+    unsigned long contended;  /* times the page lock was found held        */
+} present_stats_t;
+
+/* 
+ * Double buffering alternates between two video memory pages; a frame
+ * can be drawn only once the flip to the previous frame is latched.
+ * Triple buffering adds a third page, and a present thread that flips
+ * to the newest finished frame at each vertical retrace, so drawing never
+ * waits for a retrace.
+ */
+typedef enum {PRESENT_DOUBLE, PRESENT_TRIPLE} present_mode_t;
+
 /* configure VGA for mode X; initializes logical view to (0,0) */
 extern int set_mode_X (void (*horiz_fill_fn)
                             (int, int, unsigned char[SCROLL_X_DIM]),
@@ -122,8 +155,32 @@ extern void clear_mode_X ();
 /* set logical view window coordinates */
 extern void set_view_window (int scr_x, int scr_y);
 
-/* show the logical view window on the monitor */
-extern void show_screen ();
+/* 
+ * show the logical view window on the monitor; returns the number of
+ * the frame (counting from 1)
+ */
+extern unsigned long show_screen ();
+
+/* get the number show_screen will give the next frame */
+extern unsigned long next_screen_frame ();
+
+/* set the longest time show_screen may busy-wait for a retrace, in usec */
+extern void set_present_budget (int usec);
+
+/* 
+ * set a function called with a frame number and the time (usec) once
+ * the frame is known to be on the monitor; see modex.c for details
+ */
+extern void set_flip_hook (void (*fn) (unsigned long frame, long long usec));
+
+/* get the display flip statistics */
+extern void get_present_stats (present_stats_t* stats);
+
+/* choose double or triple buffering; takes effect at the next show_screen */
+extern void set_present_mode (present_mode_t mode);
+
+/* get the buffering mode most recently chosen */
+extern present_mode_t get_present_mode ();
 
 /*show the status bar on the monitor*/
 extern void show_status_bar(char * msg, const char* typing, int level);
@@ -161,4 +218,7 @@ extern int draw_horiz_line (int y);
 /* draw a vertical line at horizontal pixel x within the logical view window */
 extern int draw_vert_line (int x);
 
+/* draw a whole logical view window from an image made beforehand */
+extern void draw_view_image (const unsigned char* img);
+
 #endif /* MODEX_H */
@@ -0,0 +1,53 @@
+/*									tab:8
+ *
+ * monotime.c - reading the monotonic clock
+ *
+ * Filename:	    monotime.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <errno.h>
+#include <time.h>
+
+#include "monotime.h"
+
+
+/*
+ * now_usec
+ *   DESCRIPTION: Read the monotonic clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time in microseconds
+ *   SIDE EFFECTS: none
+ */
+long long
+now_usec ()
+{
+    struct timespec ts; /* current time */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+/*
+ * sleep_until
+ *   DESCRIPTION: Sleep until a time on the monotonic clock, resuming the
+ *                sleep if a signal interrupts it.
+ *   INPUTS: t -- time to wake up (from now_usec)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+sleep_until (long long t)
+{
+    struct timespec ts; /* wake-up time */
+
+    ts.tv_sec = t / 1000000;
+    ts.tv_nsec = (t % 1000000) * 1000;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	   EINTR);
+}
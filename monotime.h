@@ -0,0 +1,27 @@
+/*									tab:8
+ *
+ * monotime.h - reading the monotonic clock
+ *
+ * Filename:	    monotime.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef MONOTIME_H
+#define MONOTIME_H
+
+
+/*
+ * Times kept by the game (frame deadlines, input stamps, flip pacing,
+ * trace calibration) are microseconds of CLOCK_MONOTONIC, so that they
+ * can be compared across threads and modules.
+ */
+
+/* read the monotonic clock, in microseconds */
+extern long long now_usec ();
+
+/* sleep until a time from now_usec; returns at once if it has passed */
+extern void sleep_until (long long t);
+
+#endif /* MONOTIME_H */
@@ -0,0 +1,389 @@
+/*									tab:8
+ *
+ * reactor.c - event-driven input for the maze game
+ *
+ * Filename:	    reactor.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Replaced the locked command queue with a lock-free ring
+ *		per input source, carrying timestamped commands.
+ *	3	Sun Oct 18 2026
+ *		Ticks come from a tick source (RTC, timerfd, or free).
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "monotime.h"
+#include "reactor.h"
+
+
+/* commands that may wait in each ring; a power of two */
+#define RING_SIZE 256
+
+/* keystrokes */
+#define KEY_ESC       27  /* first byte of an arrow key sequence  */
+#define KEY_CSI       91  /* '[', second byte of the sequence     */
+#define KEY_UP        65  /* 'A' through 'D' end the sequence     */
+#define KEY_DOWN      66
+#define KEY_RIGHT     67
+#define KEY_LEFT      68
+#define KEY_BACKQUOTE 96  /* quit                                 */
+#define KEY_TOGGLE    't' /* switch between double/triple buffers */
+
+/* tags for the descriptors watched by epoll */
+typedef enum {SRC_TICKS, SRC_KEY, SRC_WAKE, NUM_SOURCES} source_t;
+
+/* state of the arrow key decoder */
+typedef enum {KEY_PLAIN, KEY_SAW_ESC, KEY_SAW_CSI} key_state_t;
+
+
+/* local functions--see function headers for details */
+static void post_command (input_source_t src, input_kind_t kind, int arg,
+			  long long usec);
+static void deliver_ticks (int n, long long usec);
+static void decode_key (unsigned char c, long long usec);
+static void* reactor_thread (void* arg);
+
+
+/* the sources watched, and the controller sampler */
+static tick_source_t ticks = {TICK_FREE, -1, 0};
+static int key_fd = -1;
+static int wake_fd = -1;  /* stops the reactor                 */
+static int bell_fd = -1;  /* wakes the reader of commands      */
+static int epoll_fd = -1;
+static dir_t (*sample_dir) () = NULL;
+
+static pthread_t reactor_tid;
+static key_state_t key_state = KEY_PLAIN;
+static dir_t last_sampled = DIR_STOP;
+
+/*
+ * One command ring per source.  Only the reactor writes tail, and only
+ * the reader of commands writes head; each publishes its index with a
+ * release store after touching the entries, and reads the other's index
+ * with an acquire load.  The indices run freely and wrap modulo 2^32.
+ */
+typedef struct {
+    input_cmd_t cmd[RING_SIZE];
+    unsigned int head;      /* next command to read      */
+    unsigned int tail;      /* next free entry           */
+    unsigned long dropped;  /* commands lost to overflow */
+} input_ring_t;
+
+static input_ring_t rings[NUM_INPUT_SOURCES];
+
+/* printable names of input sources (see reactor.h) */
+const char* const input_source_names[NUM_INPUT_SOURCES] = {
+    "rtc", "keyboard", "tux"
+};
+
+
+/*
+ * start_input_reactor
+ *   DESCRIPTION: Starts the input reactor thread; see reactor.h.
+ *   INPUTS: tick -- the tick source
+ *           key -- descriptor for the keyboard (in character mode), or -1
+ *           sample -- function returning the direction pressed on a game
+ *                     controller, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates a thread, an epoll instance, and an eventfd;
+ *                 prints an error message on failure
+ */
+int
+start_input_reactor (const tick_source_t* tick, int key, dir_t (*sample) ())
+{
+    struct epoll_event ev; /* registration of one descriptor */
+
+    ticks = *tick;
+    key_fd = key;
+    sample_dir = sample;
+    if ((epoll_fd = epoll_create (NUM_SOURCES)) == -1) {
+	perror ("epoll_create");
+	return -1;
+    }
+    if ((wake_fd = eventfd (0, 0)) == -1 || (bell_fd = eventfd (0, 0)) == -1) {
+	perror ("eventfd");
+	goto close_fds;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = SRC_WAKE;
+    if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) != 0)
+	goto fail;
+    ev.data.u32 = SRC_TICKS;
+    if (ticks.fd != -1 &&
+	epoll_ctl (epoll_fd, EPOLL_CTL_ADD, ticks.fd, &ev) != 0)
+	goto fail;
+    ev.data.u32 = SRC_KEY;
+    if (key_fd != -1 &&
+	epoll_ctl (epoll_fd, EPOLL_CTL_ADD, key_fd, &ev) != 0)
+	goto fail;
+
+    if ((errno = pthread_create (&reactor_tid, NULL, reactor_thread,
+				 NULL)) != 0)
+	goto fail;
+    return 0;
+
+fail:
+    perror ("start_input_reactor");
+close_fds:
+    if (wake_fd != -1)
+	(void)close (wake_fd);
+    if (bell_fd != -1)
+	(void)close (bell_fd);
+    (void)close (epoll_fd);
+    return -1;
+}
+
+
+/*
+ * next_input_command
+ *   DESCRIPTION: Takes the oldest command waiting in any ring.
+ *   INPUTS: none
+ *   OUTPUTS: cmd -- the command
+ *   RETURN VALUE: 1 if a command was taken, 0 if none was waiting
+ *   SIDE EFFECTS: removes the command from its ring
+ */
+int
+next_input_command (input_cmd_t* cmd)
+{
+    input_ring_t* oldest = NULL; /* ring holding the oldest command */
+    input_ring_t* r;             /* ring being examined             */
+    unsigned int head;           /* its next command                */
+    int i;
+
+    for (i = 0; i < NUM_INPUT_SOURCES; i++) {
+	r = &rings[i];
+	head = r->head;
+	if (head == __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE))
+	    continue;
+	if (oldest == NULL || r->cmd[head % RING_SIZE].usec <
+			      oldest->cmd[oldest->head % RING_SIZE].usec)
+	    oldest = r;
+    }
+    if (oldest == NULL)
+	return 0;
+    *cmd = oldest->cmd[oldest->head % RING_SIZE];
+    __atomic_store_n (&oldest->head, oldest->head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+/*
+ * wait_for_input
+ *   DESCRIPTION: Sleeps until the reactor posts a command, unless one was
+ *                posted since the last call.  With a free-running tick
+ *                source, posts a tick instead: the reactor then never
+ *                touches the tick and controller rings, so the caller
+ *                may produce into them.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+wait_for_input ()
+{
+    uint64_t posted; /* commands posted since the last call */
+
+    if (ticks.kind == TICK_FREE) {
+	deliver_ticks (1, now_usec ());
+	return;
+    }
+    while (read (bell_fd, &posted, sizeof (posted)) == -1 && errno == EINTR);
+}
+
+
+/*
+ * stop_input_reactor
+ *   DESCRIPTION: Stops the input reactor thread.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes and joins the thread; closes the epoll instance
+ *                 and eventfds (but not the descriptors watched); reports
+ *                 commands lost to overflow on stderr
+ */
+void
+stop_input_reactor ()
+{
+    uint64_t one = 1; /* eventfd increment      */
+    int i;            /* loop index over rings */
+
+    if (write (wake_fd, &one, sizeof (one)) != sizeof (one))
+	perror ("stop_input_reactor");
+    (void)pthread_join (reactor_tid, NULL);
+    (void)close (wake_fd);
+    (void)close (bell_fd);
+    (void)close (epoll_fd);
+    for (i = 0; i < NUM_INPUT_SOURCES; i++)
+	if (rings[i].dropped != 0)
+	    fprintf (stderr, "input: %lu %s commands dropped\n",
+		     rings[i].dropped, input_source_names[i]);
+}
+
+
+
+/*
+ * post_command
+ *   DESCRIPTION: Adds a command to the ring of its source.
+ *   INPUTS: src -- the input source
+ *           kind -- the kind of command
+ *           arg -- its argument
+ *           usec -- time the input was read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the reader; drops the command if the ring is full
+ */
+static void
+post_command (input_source_t src, input_kind_t kind, int arg, long long usec)
+{
+    input_ring_t* r = &rings[src]; /* the source's ring   */
+    unsigned int tail = r->tail;   /* next free entry     */
+    uint64_t one = 1;              /* eventfd increment   */
+
+    if (tail - __atomic_load_n (&r->head, __ATOMIC_ACQUIRE) == RING_SIZE) {
+	r->dropped++;
+	return;
+    }
+    r->cmd[tail % RING_SIZE].kind = kind;
+    r->cmd[tail % RING_SIZE].arg = arg;
+    r->cmd[tail % RING_SIZE].source = src;
+    r->cmd[tail % RING_SIZE].usec = usec;
+    __atomic_store_n (&r->tail, tail + 1, __ATOMIC_RELEASE);
+    (void)write (bell_fd, &one, sizeof (one));
+}
+
+
+/*
+ * deliver_ticks
+ *   DESCRIPTION: Posts ticks, and samples the game controller (which
+ *                cannot tell us when its buttons change) once per tick
+ *                delivery, posting a command if the direction changed.
+ *   INPUTS: n -- number of ticks
+ *           usec -- time the ticks were read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: posts commands
+ */
+static void
+deliver_ticks (int n, long long usec)
+{
+    dir_t d; /* controller direction */
+
+    post_command (INPUT_FROM_RTC, INPUT_TICKS, n, usec);
+    if (sample_dir != NULL && (d = (*sample_dir) ()) != last_sampled) {
+	last_sampled = d;
+	if (d != DIR_STOP)
+	    post_command (INPUT_FROM_TUX, INPUT_DIR, d, now_usec ());
+    }
+}
+
+
+/*
+ * decode_key
+ *   DESCRIPTION: Feeds one keystroke byte to the key decoder.  Arrow keys
+ *                arrive as ESC '[' followed by 'A' to 'D'.
+ *   INPUTS: c -- the byte
+ *           usec -- time the byte was read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may post a command
+ */
+static void
+decode_key (unsigned char c, long long usec)
+{
+    if (c == KEY_ESC) {
+	key_state = KEY_SAW_ESC;
+	return;
+    }
+    if (key_state == KEY_SAW_ESC && c == KEY_CSI) {
+	key_state = KEY_SAW_CSI;
+	return;
+    }
+    if (key_state == KEY_SAW_CSI) {
+	switch (c) {
+	    case KEY_UP:
+		post_command (INPUT_FROM_KEYBOARD, INPUT_DIR, DIR_UP, usec);
+		break;
+	    case KEY_DOWN:
+		post_command (INPUT_FROM_KEYBOARD, INPUT_DIR, DIR_DOWN, usec);
+		break;
+	    case KEY_RIGHT:
+		post_command (INPUT_FROM_KEYBOARD, INPUT_DIR, DIR_RIGHT, usec);
+		break;
+	    case KEY_LEFT:
+		post_command (INPUT_FROM_KEYBOARD, INPUT_DIR, DIR_LEFT, usec);
+		break;
+	}
+    } else if (c == KEY_BACKQUOTE)
+	post_command (INPUT_FROM_KEYBOARD, INPUT_QUIT, 0, usec);
+    else if (c == KEY_TOGGLE)
+	post_command (INPUT_FROM_KEYBOARD, INPUT_TOGGLE_PRESENT, 0, usec);
+    key_state = KEY_PLAIN;
+}
+
+
+/*
+ * reactor_thread
+ *   DESCRIPTION: Waits for input on all sources and turns it into
+ *                commands, until woken through the eventfd.
+ *   INPUTS: arg -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: reads the tick source and keyboard; posts commands
+ */
+static void*
+reactor_thread (void* arg)
+{
+    struct epoll_event ev[NUM_SOURCES]; /* ready descriptors          */
+    unsigned char keys[64];             /* keystrokes read at once    */
+    int ticks_read;                     /* ticks passed               */
+    ssize_t len;                        /* bytes read                 */
+    long long usec;                     /* time of the read           */
+    int n, i, j;
+
+    while (1) {
+	if ((n = epoll_wait (epoll_fd, ev, NUM_SOURCES, -1)) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    perror ("epoll_wait");
+	    break;
+	}
+	for (i = 0; i < n; i++) {
+	    switch (ev[i].data.u32) {
+		case SRC_WAKE:
+		    return NULL;
+
+		case SRC_TICKS:
+		    if ((ticks_read = read_tick_source (&ticks)) > 0)
+			deliver_ticks (ticks_read, now_usec ());
+		    break;
+
+		case SRC_KEY:
+		    /* One read per wakeup; epoll reports any remainder. */
+		    if ((len = read (key_fd, keys, sizeof (keys))) > 0) {
+			usec = now_usec ();
+			for (j = 0; j < len; j++)
+			    decode_key (keys[j], usec);
+		    } else if (len == 0 ||
+			       (errno != EAGAIN && errno != EINTR)) {
+			/* End of input: stop watching the keyboard. */
+			(void)epoll_ctl (epoll_fd, EPOLL_CTL_DEL, key_fd, NULL);
+		    }
+		    break;
+	    }
+	}
+    }
+    return NULL;
+}
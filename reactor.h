@@ -0,0 +1,84 @@
+/*									tab:8
+ *
+ * reactor.h - event-driven input for the maze game
+ *
+ * Filename:	    reactor.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Replaced the locked command queue with a lock-free ring
+ *		per input source, carrying timestamped commands.
+ *	3	Sun Oct 18 2026
+ *		Ticks come from a tick source (RTC, timerfd, or free).
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+
+#include "blocks.h"
+#include "ticksrc.h"
+
+
+/* kinds of commands delivered by the input reactor */
+typedef enum {
+    INPUT_TICKS,          /* clock ticks; arg is how many               */
+    INPUT_DIR,            /* move in a new direction; arg is a dir_t    */
+    INPUT_TOGGLE_PRESENT, /* switch between double and triple buffering */
+    INPUT_QUIT            /* leave the game                             */
+} input_kind_t;
+
+/* input sources; each has its own command ring */
+typedef enum {
+    INPUT_FROM_RTC, INPUT_FROM_KEYBOARD, INPUT_FROM_TUX,
+    NUM_INPUT_SOURCES
+} input_source_t;
+
+/* printable names of input sources */
+extern const char* const input_source_names[NUM_INPUT_SOURCES];
+
+typedef struct {
+    input_kind_t kind;
+    int arg;
+    input_source_t source;
+    long long usec;       /* CLOCK_MONOTONIC time the input was read    */
+} input_cmd_t;
+
+/*
+ * Start the input reactor: one thread that waits with epoll on the tick
+ * source, the keyboard, and a wakeup descriptor, and reads each only
+ * once it is ready.  Keystrokes (arrow keys, 't', and '`' to quit) are
+ * decoded incrementally, so an escape sequence may arrive in pieces.  A
+ * game controller without readiness notification (the Tux controller)
+ * is sampled each time ticks arrive by calling sample_dir, which returns
+ * the direction pressed or DIR_STOP; a command is sent only when the
+ * result changes.  A key descriptor of -1 or a NULL sample_dir is
+ * ignored.  A free-running tick source has no descriptor; its ticks are
+ * made by wait_for_input.  Returns 0 on success, -1 on failure.
+ *
+ * Commands from each source go into a single-producer, single-consumer
+ * ring, so the reactor and the one thread reading commands never share
+ * a lock.  A full ring drops new commands (counted and reported by
+ * stop_input_reactor).
+ */
+extern int start_input_reactor (const tick_source_t* ticks, int key_fd,
+				dir_t (*sample_dir) ());
+
+/*
+ * Take the oldest command from any source without waiting; returns 1
+ * if a command was taken, or 0 if all rings are empty.  Only one thread
+ * may take commands.
+ */
+extern int next_input_command (input_cmd_t* cmd);
+
+/*
+ * sleep until a command may have arrived since the last call; with a
+ * free-running tick source, post a tick and return at once
+ */
+extern void wait_for_input ();
+
+/* stop the reactor thread and release its resources */
+extern void stop_input_reactor ();
+
+#endif /* REACTOR_H */
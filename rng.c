@@ -0,0 +1,188 @@
+/*									tab:8
+ *
+ * rng.c - small, fast pseudo-random number generator
+ *
+ * Filename:	    rng.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <stdint.h>
+
+#include "rng.h"
+
+
+/*
+ * seed_rng
+ *   DESCRIPTION: Seed a generator, filling its state from the seed with
+ *                splitmix64, which never gives the all-zero state.
+ *   INPUTS: seed -- the seed
+ *   OUTPUTS: r -- the generator
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+seed_rng (rng_t* r, uint64_t seed)
+{
+    uint64_t z;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+	z = (seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	r->s[i] = z ^ (z >> 31);
+    }
+}
+
+
+/*
+ * jump_rng
+ *   DESCRIPTION: Advance a generator by 2^128 numbers, as that many calls
+ *                to rng_next would.
+ *   INPUTS: r -- the generator
+ *   OUTPUTS: r -- the generator, advanced
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+jump_rng (rng_t* r)
+{
+    static const uint64_t jump[4] = {
+	0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+	0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL
+    };
+    uint64_t s[4] = {0, 0, 0, 0};
+    int i, b, k;
+
+    for (i = 0; i < 4; i++) {
+	for (b = 0; b < 64; b++) {
+	    if ((jump[i] >> b) & 1)
+		for (k = 0; k < 4; k++)
+		    s[k] ^= r->s[k];
+	    (void)rng_next (r);
+	}
+    }
+    for (k = 0; k < 4; k++)
+	r->s[k] = s[k];
+}
+
+
+#if defined(RNG_BENCH_PROGRAM)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DRAWS   (1 << 24)  /* numbers drawn by each thread per run */
+#define BENCH_THREADS 64
+
+/* a thread of a benchmark run */
+typedef struct {
+    int kind;                  /* BENCH_* below                     */
+    rng_t rng;                 /* its generator, for BENCH_RNG      */
+    struct random_data rd;     /* its random_r state, for BENCH_R   */
+    char rd_state[64];
+    uint32_t sum;              /* of the numbers, so they are used  */
+    pthread_t tid;
+} bench_thread_t;
+
+enum {BENCH_RANDOM, BENCH_R, BENCH_RNG, NUM_BENCH};
+
+static const char* const bench_names[NUM_BENCH] = {
+    "random () % n", "random_r () % n", "rng_below"
+};
+
+/*
+ * bench_draw
+ *   DESCRIPTION: Draw BENCH_DRAWS numbers below bounds like those of
+ *                maze generation, one way.
+ *   INPUTS: arg -- the thread (bench_thread_t)
+ *   OUTPUTS: sum -- the sum of the numbers
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: advances the generator used
+ */
+static void*
+bench_draw (void* arg)
+{
+    bench_thread_t* t = arg;
+    uint32_t sum = 0, n;
+    int32_t r;
+    int i;
+
+    for (i = 0; i < BENCH_DRAWS; i++) {
+	n = 100 + (i & 1023);
+	switch (t->kind) {
+	    case BENCH_RANDOM:
+		sum += random () % n;
+		break;
+	    case BENCH_R:
+		(void)random_r (&t->rd, &r);
+		sum += r % n;
+		break;
+	    case BENCH_RNG:
+		sum += rng_below (&t->rng, n);
+		break;
+	}
+    }
+    t->sum = sum;
+    return NULL;
+}
+
+
+/*
+ * main -- for the "rngbench" program
+ *   DESCRIPTION: Draw bounded random numbers with random (), with a
+ *                random_r state per thread, and with a generator per
+ *                thread, on one thread and then on several at once, and
+ *                report the rate of each.
+ *   INPUTS: argv[1] -- threads for the second run (default: one per CPU)
+ *   OUTPUTS: one line per way and thread count on stdout
+ *   RETURN VALUE: 0 on success, 3 in panic scenarios
+ */
+int
+main (int argc, char* argv[])
+{
+    static bench_thread_t thr[BENCH_THREADS];
+    struct timespec t0, t1;
+    int counts[2], c, kind, i, n;
+    double sec;
+
+    counts[0] = 1;
+    counts[1] = (argc > 1 ? atoi (argv[1]) :
+		 (int)sysconf (_SC_NPROCESSORS_ONLN));
+    if (counts[1] < 1 || counts[1] > BENCH_THREADS)
+	counts[1] = (counts[1] < 1 ? 1 : BENCH_THREADS);
+    srandom (time (NULL));
+
+    for (c = 0; c < 2; c++) {
+	n = counts[c];
+	for (kind = 0; kind < NUM_BENCH; kind++) {
+	    for (i = 0; i < n; i++) {
+		thr[i].kind = kind;
+		seed_rng (&thr[i].rng, i);
+		thr[i].rd.state = NULL;
+		(void)initstate_r (i + 1, thr[i].rd_state,
+				   sizeof (thr[i].rd_state), &thr[i].rd);
+	    }
+	    (void)clock_gettime (CLOCK_MONOTONIC, &t0);
+	    for (i = 0; i < n; i++)
+		if (pthread_create (&thr[i].tid, NULL, bench_draw, &thr[i]))
+		    return 3;
+	    for (i = 0; i < n; i++)
+		(void)pthread_join (thr[i].tid, NULL);
+	    (void)clock_gettime (CLOCK_MONOTONIC, &t1);
+	    sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	    printf ("%-16s %2d thread%s: %7.1f M numbers/s (%.2f ns each)\n",
+		    bench_names[kind], n, (n == 1 ? " " : "s"),
+		    (double)n * BENCH_DRAWS / sec * 1e-6,
+		    sec * 1e9 / BENCH_DRAWS);
+	}
+    }
+    return 0;
+}
+
+#endif /* RNG_BENCH_PROGRAM */
@@ -0,0 +1,78 @@
+/*									tab:8
+ *
+ * rng.h - small, fast pseudo-random number generator
+ *
+ * Filename:	    rng.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+
+#include <stdint.h>
+
+
+/*
+ * A generator is xoshiro256** (Blackman and Vigna): 256 bits of state,
+ * a period of 2^256 - 1, and a few shifts and multiplies per number.  It
+ * takes no lock, so each thread (or each maze) keeps a generator of its
+ * own.  jump_rng advances a generator by 2^128 numbers, so copies of one
+ * generator, jumped in turn, give streams that never overlap.
+ */
+typedef struct {
+    uint64_t s[4];
+} rng_t;
+
+/* seed a generator; any seed (even 0) gives a good state */
+extern void seed_rng (rng_t* r, uint64_t seed);
+
+/* advance a generator by 2^128 numbers */
+extern void jump_rng (rng_t* r);
+
+/* rotate a 64-bit word left */
+static inline uint64_t
+rng_rotl (uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* draw 64 random bits */
+static inline uint64_t
+rng_next (rng_t* r)
+{
+    uint64_t result = rng_rotl (r->s[1] * 5, 7) * 9;
+    uint64_t t = r->s[1] << 17;
+
+    r->s[2] ^= r->s[0];
+    r->s[3] ^= r->s[1];
+    r->s[1] ^= r->s[2];
+    r->s[0] ^= r->s[3];
+    r->s[2] ^= t;
+    r->s[3] = rng_rotl (r->s[3], 45);
+    return result;
+}
+
+/*
+ * draw a number from 0 to n - 1 (n > 0), each equally likely; the high
+ * half of a 32x32-bit product picks it (Lemire), and the few draws that
+ * would favour some numbers over others are redrawn, with a division
+ * only when a draw comes close
+ */
+static inline uint32_t
+rng_below (rng_t* r, uint32_t n)
+{
+    uint64_t prod = (rng_next (r) >> 32) * n;
+    uint32_t threshold;
+
+    if ((uint32_t)prod < n) {
+	threshold = -n % n;  /* 2^32 mod n */
+	while ((uint32_t)prod < threshold)
+	    prod = (rng_next (r) >> 32) * n;
+    }
+    return (uint32_t)(prod >> 32);
+}
+
+#endif /* RNG_H */
@@ -0,0 +1,85 @@
+/*									tab:8
+ *
+ * telemetry.c - live counters of a running maze game
+ *
+ * Filename:	    telemetry.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+
+static telemetry_t private_page;      /* used when there is no shared page */
+telemetry_t* telemetry = &private_page;
+
+
+/*
+ * open_telemetry
+ *   DESCRIPTION: Create the shared memory page (replacing any left by a
+ *                game that did not exit cleanly), copy in the counters
+ *                so far, and use it from now on.  Called before the game
+ *                threads start.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+int
+open_telemetry ()
+{
+    int fd;
+    telemetry_t* t;
+
+    (void)shm_unlink (TELEMETRY_NAME);
+    if ((fd = shm_open (TELEMETRY_NAME, O_RDWR | O_CREAT | O_EXCL, 0644)) ==
+	-1) {
+	perror ("shm_open " TELEMETRY_NAME);
+	return -1;
+    }
+    if (ftruncate (fd, sizeof (telemetry_t)) != 0 ||
+	(t = mmap (NULL, sizeof (telemetry_t), PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0)) == MAP_FAILED) {
+	perror ("map " TELEMETRY_NAME);
+	(void)close (fd);
+	(void)shm_unlink (TELEMETRY_NAME);
+	return -1;
+    }
+    (void)close (fd);
+
+    *t = *telemetry;
+    t->version = TELEMETRY_VERSION;
+    t->pid = getpid ();
+    /* Readers check the magic number last. */
+    __atomic_store_n (&t->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+    telemetry = t;
+    return 0;
+}
+
+
+/*
+ * close_telemetry
+ *   DESCRIPTION: Remove the shared memory page, and go back to the private
+ *                copy of the counters.  Called after the game threads end.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+close_telemetry ()
+{
+    if (telemetry == &private_page)
+	return;
+    private_page = *telemetry;
+    (void)munmap (telemetry, sizeof (telemetry_t));
+    (void)shm_unlink (TELEMETRY_NAME);
+    telemetry = &private_page;
+}
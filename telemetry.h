@@ -0,0 +1,66 @@
+/*									tab:8
+ *
+ * telemetry.h - live counters of a running maze game
+ *
+ * Filename:	    telemetry.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+
+#include <stdint.h>
+
+
+/*
+ * The game keeps its counters in a page of POSIX shared memory named
+ * TELEMETRY_NAME, which mazestat maps read-only to watch a running game.
+ * Counters are updated with relaxed atomic operations, so they cost the
+ * game almost nothing, and a reader sees each counter whole (though not
+ * all counters at the same instant).  Every field is 64 bits wide, so
+ * the layout is the same for 32- and 64-bit programs.
+ */
+#define TELEMETRY_NAME    "/mazegame-telemetry"
+#define TELEMETRY_MAGIC   0x4D5A4754454C4D31ULL  /* "MZGTELM1" */
+#define TELEMETRY_VERSION 3
+#define TELEMETRY_LEVELS  16  /* levels with generation times kept */
+
+typedef struct {
+    uint64_t magic;           /* TELEMETRY_MAGIC                         */
+    uint64_t version;         /* TELEMETRY_VERSION                       */
+    uint64_t pid;             /* process writing the counters            */
+    uint64_t level;           /* level being played; 0 before the game   */
+    uint64_t ticks;           /* RTC ticks processed by the simulation   */
+    uint64_t catchup_ticks;   /* ticks beyond the first in one wakeup    */
+    uint64_t clamped_ticks;   /* steps dropped by the eight-step limit   */
+    uint64_t frames;          /* frames presented                        */
+    uint64_t vram_bytes;      /* bytes copied to video memory            */
+    uint64_t contended;       /* lock acquisitions that had to wait      */
+    uint64_t led_ioctls;      /* Tux controller LED ioctls issued        */
+    uint64_t gen_usec[TELEMETRY_LEVELS]; /* maze generation time, by level */
+    uint64_t gen_regions[TELEMETRY_LEVELS]; /* regions the worms dug, by level */
+    uint64_t switch_usec[TELEMETRY_LEVELS]; /* level start delay, by level */
+} telemetry_t;
+
+/*
+ * the game's counters; before open_telemetry (or if it fails), a private
+ * copy that no reader sees
+ */
+extern telemetry_t* telemetry;
+
+/* update a counter of *telemetry */
+#define TELEMETRY_ADD(field,n) \
+    (void)__atomic_fetch_add (&telemetry->field, (n), __ATOMIC_RELAXED)
+#define TELEMETRY_SET(field,v) \
+    __atomic_store_n (&telemetry->field, (v), __ATOMIC_RELAXED)
+
+/* create and map the shared page; returns 0 on success, -1 on failure */
+extern int open_telemetry ();
+
+/* unmap and remove the shared page */
+extern void close_telemetry ();
+
+#endif /* TELEMETRY_H */
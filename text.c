@@ -35,6 +35,8 @@
 
 #include <string.h>
 
+#include "blocks.h"
+#include "kernels.h"
 #include "text.h"
 #include "modex.h"
 
@@ -42,8 +44,6 @@
 #define FONT_COLOR 35
 #define BACKGROUND_COLOR2 10
 #define BACKGROUND_COLOR3 20
-#define TEST_LAST_BIT 0x01
-#define PLANE_NUM 4
 
 
 /* 
@@ -573,7 +573,9 @@ unsigned char font_data[256][16] = {
 
 /*
  * fill_buffer
- *   DESCRIPTION: prepare buffer for video memory
+ *   DESCRIPTION: prepare buffer for video memory; each row of text is
+ *                drawn as a line of pixels with the glyph kernel and then
+ *                split into the four planes of the buffer
  *   INPUTS: status message, buffer, typing, room name
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -583,76 +585,57 @@ unsigned char font_data[256][16] = {
 
 
 void fill_buffer (char * str, unsigned char* buf, int level, const char*room){
-    int start_point = (IMAGE_X_DIM-(FONT_WIDTH*strlen(str)))/2;
-    int x_start;
-    int i,j;
-    int curr=0;
+    unsigned char fg[IMAGE_X_DIM];                  //font color for every pixel
+    unsigned char line[IMAGE_X_DIM];                //one row of the status bar
+    unsigned char bits[IMAGE_X_DIM/FONT_WIDTH];     //font row of each character
+    unsigned char background;
+    int start_point;
+    int len;
+    int i;
     int char_index;
-    int p_off;
-    int temp;
-    unsigned char cur_char;
 
 //fill different background colors for different levels
-    for( i=0; i<STATUS_BAR_SIZE; i++)
+    if (level%3==1)
     {
-        if (level%3==1)
-        {
-        buf[i] = BACKGROUND_COLOR;
-        }
-        else if (level % 3 ==2)
-        {
-            buf[i] = BACKGROUND_COLOR2;
-        }
-        else
-        {
-            buf[i] = BACKGROUND_COLOR3;
-        }
+        background = BACKGROUND_COLOR;
     }
+    else if (level % 3 ==2)
+    {
+        background = BACKGROUND_COLOR2;
+    }
+    else
+    {
+        background = BACKGROUND_COLOR3;
+    }
+    memset(buf, background, STATUS_BAR_SIZE);
 
     //draw fruits number left
     //first check if there's any input status message
-    if(str[0]!='\0')
-    {
-        curr=0;
-
-    //if there's message, get into the for loop to traverse the string
-    for( char_index =0; char_index<strlen(str); char_index++)
+    len = strlen(str);
+    if(len==0)
+        return;
+
+    //characters past the width of the bar are cut off
+    if(len > IMAGE_X_DIM/FONT_WIDTH)
+        len = IMAGE_X_DIM/FONT_WIDTH;
+    start_point = (IMAGE_X_DIM-FONT_WIDTH*len)/2;
+    memset(fg, FONT_COLOR, IMAGE_X_DIM);
+
+    //traverse the rows of the characters
+    for(i=0;i<FONT_HEIGHT;i++)
     {
-        //update the starting position of character
-        x_start = start_point + FONT_WIDTH*char_index;
-
-        //get the current character
-        temp=str[curr];
-
-        //traverse a character
-        for(i=0;i<FONT_HEIGHT;i++)
-        {
-            //get one row of ASCII character
-            cur_char=font_data[temp][i];
-            
-            for(j=7;j>=0;j--)
-            {
-                //bitwise checking of each bit in ASCII char
-                if((cur_char & TEST_LAST_BIT)==TEST_LAST_BIT)
-                {
-                    //to get the plane number to put in, here 3 is used to 
-                    //get the correct plane number
-                    p_off=j & 3;
-                    //calculate the offset in the buffer and then color that pixel with font color
-                    buf[STATUS_BAR_PLANE_SIZE*p_off+i*IMAGE_X_WIDTH+(x_start+j)/PLANE_NUM]=FONT_COLOR;
-                }
-                //right shift character 1 bit to prepare next comparison
-                cur_char=cur_char>>1;
-            }
+        //get one row of each ASCII character
+        for( char_index =0; char_index<len; char_index++)
+            bits[char_index]=font_data[(unsigned char)str[char_index]][i];
 
-        }
+        //color the pixels of the set bits with font color
+        memset(line, background, IMAGE_X_DIM);
+        (*kernels.glyph)(line+start_point, bits, len, fg, 0);
 
-        //update the character index
-            curr++;
+        //pixel x goes to plane x&3 of the buffer, at offset x/4 in the row
+        (*kernels.split)(buf+i*IMAGE_X_WIDTH, STATUS_BAR_PLANE_SIZE, line, IMAGE_X_DIM, 0);
     }
 
-}
-
     return;
 
 }
@@ -670,60 +653,33 @@ void fill_buffer (char * str, unsigned char* buf, int level, const char*room){
 
 
 void fill_floating (char * str, unsigned char* buf, int level, const char*room, unsigned char* floor_buf){
-    int start_point =0;
-    int x_start;
-    int i,j;
-    int curr=0;
+    unsigned char bits[FLOATING_X_DIM/FONT_WIDTH];  //font row of each character
+    int len;
+    int i;
     int char_index;
-    //int p_off;
-    //int counter=0;
-    int temp;
-    unsigned char cur_char;
-
-
 
     //draw fruits number left
     //first check if there's any input status message
-    if(str[0]!='\0')
-    {
-        curr=0;
-
-    //if there's message, get into the for loop to traverse the string
-    for( char_index =0; char_index<strlen(str); char_index++)
-    {
-        //update the starting position of character
-        x_start = start_point + FONT_WIDTH*char_index;
+    len = strlen(str);
+    if(len==0)
+        return;
 
-        //get the current character
-        temp=str[curr];
+    //characters past the width of the floating buffer are cut off
+    if(len > FLOATING_X_DIM/FONT_WIDTH)
+        len = FLOATING_X_DIM/FONT_WIDTH;
 
-        //traverse a character
-        for(i=0;i<FONT_HEIGHT;i++)
-        {
-            //get one row of ASCII character
-            cur_char=font_data[temp][i];
-            
-            for(j=7;j>=0;j--)
-            {
-                //bitwise checking of each bit in ASCII char
-                if((cur_char & TEST_LAST_BIT)==TEST_LAST_BIT)
-                {
-                    //calculate the offset in the buffer and then color that pixel with font color
-                    buf[128*i+j+FONT_WIDTH*curr]=floor_buf[128*i+j+FONT_WIDTH*curr]+64;  //128 is the width of the floating buffer
-                    //64 is the offset in my palette to get the transparent color.
-                }
-                //right shift character 1 bit to prepare next comparison
-                cur_char=cur_char>>1;
-            }
-
-        }
+    //traverse the rows of the characters
+    for(i=0;i<FONT_HEIGHT;i++)
+    {
+        //get one row of each ASCII character
+        for( char_index =0; char_index<len; char_index++)
+            bits[char_index]=font_data[(unsigned char)str[char_index]][i];
 
-        //update the character index
-            curr++;
+        //color the pixels of the set bits with the floor color plus 64,
+        //64 is the offset in my palette to get the transparent color.
+        (*kernels.glyph)(buf+FLOATING_X_DIM*i, bits, len, floor_buf+FLOATING_X_DIM*i, 64);
     }
 
-}
-
     return;
 
 }
@@ -0,0 +1,252 @@
+/*									tab:8
+ *
+ * ticksrc.c - sources of game clock ticks
+ *
+ * Filename:	    ticksrc.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Added set_tick_period.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/rtc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "ticksrc.h"
+
+
+/* fastest periodic interrupt rate of the RTC, in Hz */
+#define RTC_MAX_HZ 8192
+
+
+/* local functions--see function headers for details */
+static int open_rtc (int hz);
+static int open_timerfd (int hz);
+static int set_timerfd (int fd, long nsec);
+
+
+/* names of kinds of tick source, for open_tick_source */
+static const char* const kind_names[] = {"rtc", "timerfd", "free"};
+
+
+/*
+ * open_tick_source
+ *   DESCRIPTION: Open a tick source; see ticksrc.h.
+ *   INPUTS: name -- "rtc", "timerfd", "free", or NULL for the first of
+ *                   rtc and timerfd that works
+ *           hz -- ticks per second (ignored by a free-running source)
+ *   OUTPUTS: ts -- the source
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+int
+open_tick_source (tick_source_t* ts, const char* name, int hz)
+{
+    ts->fd = -1;
+    ts->period_usec = 1000000 / hz;
+    if (name == NULL) {
+	ts->kind = TICK_RTC;
+	if ((ts->fd = open_rtc (hz)) != -1)
+	    return 0;
+	ts->kind = TICK_TIMERFD;
+	ts->fd = open_timerfd (hz);
+    } else if (strcmp (name, kind_names[TICK_RTC]) == 0) {
+	ts->kind = TICK_RTC;
+	ts->fd = open_rtc (hz);
+    } else if (strcmp (name, kind_names[TICK_TIMERFD]) == 0) {
+	ts->kind = TICK_TIMERFD;
+	ts->fd = open_timerfd (hz);
+    } else if (strcmp (name, kind_names[TICK_FREE]) == 0) {
+	ts->kind = TICK_FREE;
+	return 0;
+    } else {
+	fprintf (stderr, "unknown tick source %s\n", name);
+	return -1;
+    }
+    if (ts->fd == -1) {
+	perror (kind_names[ts->kind]);
+	return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * open_rtc
+ *   DESCRIPTION: Open /dev/rtc and enable periodic interrupts.
+ *   INPUTS: hz -- interrupts per second; a power of two, at most 64
+ *                 unless /proc/sys/dev/rtc/max-user-freq is raised
+ *   OUTPUTS: none
+ *   RETURN VALUE: the descriptor, or -1 on failure (with errno set)
+ *   SIDE EFFECTS: none
+ */
+static int
+open_rtc (int hz)
+{
+    int fd, err;
+
+    if ((fd = open ("/dev/rtc", O_RDONLY, 0)) == -1)
+	return -1;
+    if (ioctl (fd, RTC_IRQP_SET, (unsigned long)hz) != 0 ||
+	ioctl (fd, RTC_PIE_ON, 0) != 0) {
+	err = errno;
+	(void)close (fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
+}
+
+
+/*
+ * open_timerfd
+ *   DESCRIPTION: Create a periodic CLOCK_MONOTONIC timer.
+ *   INPUTS: hz -- expirations per second
+ *   OUTPUTS: none
+ *   RETURN VALUE: the descriptor, or -1 on failure (with errno set)
+ *   SIDE EFFECTS: none
+ */
+static int
+open_timerfd (int hz)
+{
+    int fd, err;
+
+    if ((fd = timerfd_create (CLOCK_MONOTONIC, 0)) == -1)
+	return -1;
+    if (set_timerfd (fd, 1000000000L / hz) != 0) {
+	err = errno;
+	(void)close (fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
+}
+
+
+/*
+ * set_timerfd
+ *   DESCRIPTION: Start a timerfd expiring periodically, the first time one
+ *                period from now.
+ *   INPUTS: fd -- the timerfd
+ *           nsec -- the period; less than a second
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (with errno set)
+ *   SIDE EFFECTS: none
+ */
+static int
+set_timerfd (int fd, long nsec)
+{
+    struct itimerspec its;
+
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = nsec;
+    its.it_value = its.it_interval;
+    return timerfd_settime (fd, 0, &its, NULL);
+}
+
+
+/*
+ * set_tick_period
+ *   DESCRIPTION: Change the time between ticks; see ticksrc.h.  Ticks
+ *                already counted but not yet read keep coming, so the
+ *                next read may include some at the old period.
+ *   INPUTS: ts -- the source
+ *           usec -- the time wanted between ticks; under a second
+ *   OUTPUTS: ts -- period_usec changed on success
+ *   RETURN VALUE: 0 on success, -1 on failure (with errno set)
+ *   SIDE EFFECTS: none
+ */
+int
+set_tick_period (tick_source_t* ts, int usec)
+{
+    unsigned long hz;
+
+    switch (ts->kind) {
+	case TICK_RTC:
+	    for (hz = 2; hz < RTC_MAX_HZ && hz * usec < 1000000; hz <<= 1);
+	    if (ioctl (ts->fd, RTC_IRQP_SET, hz) != 0)
+		return -1;
+	    ts->period_usec = 1000000 / hz;
+	    return 0;
+	case TICK_TIMERFD:
+	    if (set_timerfd (ts->fd, usec * 1000L) != 0)
+		return -1;
+	    ts->period_usec = usec;
+	    return 0;
+	case TICK_FREE:
+	    ts->period_usec = usec;
+	    return 0;
+    }
+    return -1;
+}
+
+
+/*
+ * read_tick_source
+ *   DESCRIPTION: Read the ticks that have passed; see ticksrc.h.  Blocks
+ *                until a tick passes if the descriptor is not ready.
+ *   INPUTS: ts -- the source
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks, 0 if none, or -1 on error
+ *   SIDE EFFECTS: none
+ */
+int
+read_tick_source (const tick_source_t* ts)
+{
+    unsigned long data;  /* RTC record: interrupt count in the high bytes */
+    uint64_t expired;    /* timerfd expirations                           */
+
+    switch (ts->kind) {
+	case TICK_RTC:
+	    if (read (ts->fd, &data, sizeof (data)) != sizeof (data))
+		return (errno == EAGAIN ? 0 : -1);
+	    return (int)(data >> 8);
+	case TICK_TIMERFD:
+	    if (read (ts->fd, &expired, sizeof (expired)) != sizeof (expired))
+		return (errno == EAGAIN ? 0 : -1);
+	    return (int)expired;
+	case TICK_FREE:
+	    return 1;
+    }
+    return -1;
+}
+
+
+/*
+ * close_tick_source
+ *   DESCRIPTION: Close a tick source.
+ *   INPUTS: ts -- the source
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+close_tick_source (tick_source_t* ts)
+{
+    if (ts->fd != -1)
+	(void)close (ts->fd);
+    ts->fd = -1;
+}
+
+
+/*
+ * tick_kind_name
+ *   DESCRIPTION: Get the name of a kind of tick source.
+ *   INPUTS: kind -- the kind
+ *   OUTPUTS: none
+ *   RETURN VALUE: the name
+ *   SIDE EFFECTS: none
+ */
+const char*
+tick_kind_name (tick_kind_t kind)
+{
+    return kind_names[kind];
+}
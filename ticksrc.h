@@ -0,0 +1,68 @@
+/*									tab:8
+ *
+ * ticksrc.h - sources of game clock ticks
+ *
+ * Filename:	    ticksrc.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ *	2	Sun Oct 18 2026
+ *		Sources keep their period, which may be changed.
+ */
+
+#ifndef TICKSRC_H
+#define TICKSRC_H
+
+
+/*
+ * The game advances one step per tick.  Ticks come from
+ *     TICK_RTC     -- /dev/rtc periodic interrupts (needs privileges, and
+ *                     max-user-freq raised for rates above 64 Hz), or
+ *                     any descriptor that delivers records in the same
+ *                     format, such as the pipe of the input feeder
+ *     TICK_TIMERFD -- a CLOCK_MONOTONIC timerfd, which anyone may use
+ *     TICK_FREE    -- no clock: a tick is ready whenever the game asks,
+ *                     so the game runs as fast as it can (for benchmarks)
+ * RTC and timerfd sources have a descriptor that is readable once ticks
+ * have passed; a free-running source has none.
+ */
+typedef enum {TICK_RTC, TICK_TIMERFD, TICK_FREE} tick_kind_t;
+
+typedef struct {
+    tick_kind_t kind;
+    int fd;              /* readable when ticks have passed; -1 if free */
+    int period_usec;     /* time each tick stands for                   */
+} tick_source_t;
+
+/*
+ * Open a tick source at hz ticks per second.  The name is "rtc",
+ * "timerfd", or "free"; NULL tries /dev/rtc and falls back to a timerfd.
+ * Returns 0 on success, -1 on failure (with a message printed).
+ */
+extern int open_tick_source (tick_source_t* ts, const char* name, int hz);
+
+/*
+ * Read the ticks that have passed since the last read, including any the
+ * reader was too slow to see one at a time, as the RTC's interrupt count
+ * reports them.  A free-running source always returns one.  Returns 0 if
+ * no tick has passed, or -1 on error.
+ */
+extern int read_tick_source (const tick_source_t* ts);
+
+/*
+ * Change the time between ticks to usec, or as near as the source allows:
+ * the RTC runs only at powers of two per second, so it takes the slowest
+ * such rate at least as fast as asked.  A free-running source just takes
+ * period_usec as the time each tick stands for.  Returns 0 on success,
+ * or -1 (with errno set) if the source cannot be reprogrammed, in which
+ * case its period is unchanged.
+ */
+extern int set_tick_period (tick_source_t* ts, int usec);
+
+/* close a tick source */
+extern void close_tick_source (tick_source_t* ts);
+
+/* name of a kind of tick source */
+extern const char* tick_kind_name (tick_kind_t kind);
+
+#endif /* TICKSRC_H */
@@ -0,0 +1,290 @@
+/*									tab:8
+ *
+ * trace.c - timeline trace points for the maze game
+ *
+ * Filename:	    trace.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include "trace.h"
+
+#if TRACE_EVENTS
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "monotime.h"
+
+
+/* phases kept per thread (the newest); a power of two */
+#define TRACE_RING_SIZE   32768
+
+/* threads that may have rings */
+#define MAX_TRACE_THREADS 8
+
+/*
+ * phases just behind the newest are not written out, as the thread may
+ * be overwriting them while the trace is written
+ */
+#define TRACE_MARGIN      64
+
+
+/* one phase */
+typedef struct {
+    const char* name;
+    unsigned long long start, end;  /* time stamp counter values */
+} trace_event_t;
+
+/*
+ * A ring of phases.  Only its thread writes the entries and count, which
+ * runs freely; count is published with a release store.
+ */
+typedef struct {
+    const char* name;
+    trace_event_t* ev;
+    unsigned long count;
+} trace_ring_t;
+
+
+/* local functions--see function headers for details */
+static unsigned long long read_tsc ();
+static void request_dump (int sig);
+
+
+static const char* trace_path = NULL;  /* where to write; NULL if off */
+static trace_ring_t rings[MAX_TRACE_THREADS];
+static int num_rings = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread trace_ring_t* my_ring = NULL;
+
+/* counter and clock readings taken by trace_start, to scale the counter */
+static unsigned long long start_tsc;
+static long long start_usec;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+
+/*
+ * trace_start
+ *   DESCRIPTION: Enable tracing, and write the trace on SIGUSR1.
+ *   INPUTS: path -- file to which the trace is written
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: installs a SIGUSR1 handler; prints an error message
+ *                 on failure
+ */
+int
+trace_start (const char* path)
+{
+    struct sigaction sa;
+
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = request_dump;
+    sa.sa_flags = SA_RESTART;
+    if (sigaction (SIGUSR1, &sa, NULL) != 0) {
+	perror ("trace_start");
+	return -1;
+    }
+    start_usec = now_usec ();
+    start_tsc = read_tsc ();
+    trace_path = path;
+    return 0;
+}
+
+
+/*
+ * trace_thread
+ *   DESCRIPTION: Give the calling thread a ring, if tracing is enabled.
+ *   INPUTS: name -- name of the thread shown in the trace
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: allocates the ring
+ */
+void
+trace_thread (const char* name)
+{
+    trace_event_t* ev;
+
+    if (trace_path == NULL || my_ring != NULL)
+	return;
+    if ((ev = malloc (TRACE_RING_SIZE * sizeof (*ev))) == NULL)
+	return;
+    (void)pthread_mutex_lock (&trace_lock);
+    if (num_rings < MAX_TRACE_THREADS) {
+	my_ring = &rings[num_rings];
+	my_ring->name = name;
+	my_ring->ev = ev;
+	__atomic_store_n (&num_rings, num_rings + 1, __ATOMIC_RELEASE);
+    } else {
+	free (ev);
+    }
+    (void)pthread_mutex_unlock (&trace_lock);
+}
+
+
+/*
+ * trace_begin
+ *   DESCRIPTION: Get the time at the start of a phase.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the time stamp counter
+ *   SIDE EFFECTS: none
+ */
+unsigned long long
+trace_begin ()
+{
+    return read_tsc ();
+}
+
+
+/*
+ * trace_end
+ *   DESCRIPTION: Record a phase in the calling thread's ring, if it has
+ *                one.
+ *   INPUTS: name -- name of the phase (a string constant)
+ *           start -- value returned by trace_begin at its start
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may overwrite the oldest phase in the ring
+ */
+void
+trace_end (const char* name, unsigned long long start)
+{
+    trace_ring_t* r = my_ring;
+    trace_event_t* e;
+
+    if (r == NULL)
+	return;
+    e = &r->ev[r->count & (TRACE_RING_SIZE - 1)];
+    e->name = name;
+    e->start = start;
+    e->end = read_tsc ();
+    __atomic_store_n (&r->count, r->count + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * trace_poll
+ *   DESCRIPTION: Write the trace if SIGUSR1 has arrived since the last
+ *                call.  Called regularly by one of the game threads, as
+ *                the trace cannot be written by the signal handler.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may write the trace file
+ */
+void
+trace_poll ()
+{
+    if (dump_requested) {
+	dump_requested = 0;
+	trace_dump ();
+    }
+}
+
+
+/*
+ * trace_dump
+ *   DESCRIPTION: Write all rings to the trace file as complete ("X")
+ *                events, with times in microseconds since trace_start,
+ *                preceded by the names of the threads.  The time stamp
+ *                counter is scaled by comparing it with the monotonic
+ *                clock over the whole run.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces the trace file; prints an error message on
+ *                 failure
+ */
+void
+trace_dump ()
+{
+    FILE* f;
+    double usec_per_tick;
+    unsigned long n, i, first;
+    trace_event_t* e;
+    int t, nr, sep = 0;
+
+    if (trace_path == NULL)
+	return;
+    (void)pthread_mutex_lock (&trace_lock);
+    if ((f = fopen (trace_path, "w")) == NULL) {
+	perror (trace_path);
+	(void)pthread_mutex_unlock (&trace_lock);
+	return;
+    }
+    usec_per_tick = (double)(now_usec () - start_usec) /
+		    (double)(read_tsc () - start_tsc + 1);
+
+    fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    nr = __atomic_load_n (&num_rings, __ATOMIC_ACQUIRE);
+    for (t = 0; t < nr; t++) {
+	fprintf (f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		 "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", (sep++ ? ",\n" : ""),
+		 t + 1, rings[t].name);
+    }
+    for (t = 0; t < nr; t++) {
+	n = __atomic_load_n (&rings[t].count, __ATOMIC_ACQUIRE);
+	first = (n > TRACE_RING_SIZE - TRACE_MARGIN ?
+		 n - (TRACE_RING_SIZE - TRACE_MARGIN) : 0);
+	for (i = first; i < n; i++) {
+	    e = &rings[t].ev[i & (TRACE_RING_SIZE - 1)];
+	    fprintf (f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+		     "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e->name, t + 1,
+		     (double)(long long)(e->start - start_tsc) * usec_per_tick,
+		     (double)(e->end - e->start) * usec_per_tick);
+	}
+    }
+    fprintf (f, "\n]}\n");
+    (void)fclose (f);
+    (void)pthread_mutex_unlock (&trace_lock);
+}
+
+
+/*
+ * request_dump
+ *   DESCRIPTION: SIGUSR1 handler: ask trace_poll to write the trace.
+ *   INPUTS: sig -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+request_dump (int sig)
+{
+    dump_requested = 1;
+}
+
+
+/*
+ * read_tsc
+ *   DESCRIPTION: Read the CPU time stamp counter (or, on other CPUs, the
+ *                monotonic clock in nanoseconds).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the counter
+ *   SIDE EFFECTS: none
+ */
+static unsigned long long
+read_tsc ()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int lo, hi;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#endif /* TRACE_EVENTS */
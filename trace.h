@@ -0,0 +1,68 @@
+/*									tab:8
+ *
+ * trace.h - timeline trace points for the maze game
+ *
+ * Filename:	    trace.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+
+/*
+ * Trace points time phases of the game threads with the CPU time stamp
+ * counter, and record each phase in a ring buffer belonging to the
+ * thread, without locks.  The rings are written out in the trace event
+ * JSON format loaded by chrome://tracing and Perfetto, at exit or when
+ * the process gets SIGUSR1.  Nothing is recorded unless trace_start has
+ * been called; building with TRACE_EVENTS defined as 0 removes the trace
+ * points altogether.
+ *
+ * A phase is timed by
+ *     t0 = trace_begin ();
+ *     ... the phase ...
+ *     trace_end ("name", t0);
+ * where name is a string constant.
+ */
+#if !defined(TRACE_EVENTS)
+#define TRACE_EVENTS 1
+#endif
+
+#if TRACE_EVENTS
+
+/*
+ * enable tracing; the trace is written to path; returns 0 on success,
+ * -1 on failure
+ */
+extern int trace_start (const char* path);
+
+/* give the calling thread a ring, so that its trace points record */
+extern void trace_thread (const char* name);
+
+/* read the time stamp counter at the start of a phase */
+extern unsigned long long trace_begin ();
+
+/* record a phase that began at start */
+extern void trace_end (const char* name, unsigned long long start);
+
+/* write the trace if SIGUSR1 has arrived since the last call */
+extern void trace_poll ();
+
+/* write the trace, if enabled */
+extern void trace_dump ();
+
+#else /* !TRACE_EVENTS */
+
+#define trace_start(path)       (-1)
+#define trace_thread(name)      do { } while (0)
+#define trace_begin()           0ULL
+#define trace_end(name,start)   do { (void)(start); } while (0)
+#define trace_poll()            do { } while (0)
+#define trace_dump()            do { } while (0)
+
+#endif /* TRACE_EVENTS */
+
+#endif /* TRACE_H */
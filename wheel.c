@@ -0,0 +1,188 @@
+/*									tab:8
+ *
+ * wheel.c - hierarchical timing wheel for timed game events
+ *
+ * Filename:	    wheel.c
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#include <stddef.h>
+
+#include "wheel.h"
+
+
+/* steps spanned by the whole wheel */
+#define WHEEL_SPAN (1UL << (WHEEL_BITS * WHEEL_LEVELS))
+
+
+/* local functions--see function headers for details */
+static void place_event (wheel_t* w, wheel_event_t* ev);
+static void cascade (wheel_t* w, int level);
+
+
+/*
+ * init_wheel
+ *   DESCRIPTION: Empty a wheel and set its clock.  Events pending on the
+ *                wheel are forgotten, so should be cancelled first.
+ *   INPUTS: now -- the next step to run
+ *   OUTPUTS: w -- the wheel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+init_wheel (wheel_t* w, unsigned long now)
+{
+    int level, i;
+
+    w->now = now;
+    for (level = 0; level < WHEEL_LEVELS; level++)
+	for (i = 0; i < WHEEL_SIZE; i++)
+	    w->slot[level][i] = NULL;
+}
+
+
+/*
+ * add_event
+ *   DESCRIPTION: Make an event due at a step; see wheel.h.
+ *   INPUTS: w -- the wheel
+ *           ev -- the event
+ *           when -- the step
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+add_event (wheel_t* w, wheel_event_t* ev, unsigned long when)
+{
+    cancel_event (ev);
+    ev->when = when;
+    place_event (w, ev);
+}
+
+
+/*
+ * place_event
+ *   DESCRIPTION: Link an event into the slot of the finest level that
+ *                reaches its step, or the furthest slot if none does.
+ *   INPUTS: w -- the wheel
+ *           ev -- the event, not pending
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+place_event (wheel_t* w, wheel_event_t* ev)
+{
+    unsigned long delta; /* steps until the event is due */
+    unsigned long t;     /* step that picks the slot     */
+    wheel_event_t** head;
+    int level;
+
+    if ((long)(ev->when - w->now) < 0)
+	delta = 0;
+    else
+	delta = ev->when - w->now;
+    if (delta >= WHEEL_SPAN)
+	delta = WHEEL_SPAN - 1;
+    t = w->now + delta;
+    for (level = 0; level < WHEEL_LEVELS - 1 &&
+	 delta >= (1UL << (WHEEL_BITS * (level + 1))); level++);
+
+    head = &w->slot[level][(t >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)];
+    ev->next = *head;
+    if (ev->next != NULL)
+	ev->next->pprev = &ev->next;
+    ev->pprev = head;
+    *head = ev;
+}
+
+
+/*
+ * cancel_event
+ *   DESCRIPTION: Unlink an event from its slot, if it is pending.
+ *   INPUTS: ev -- the event
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+cancel_event (wheel_event_t* ev)
+{
+    if (ev->pprev == NULL)
+	return;
+    *ev->pprev = ev->next;
+    if (ev->next != NULL)
+	ev->next->pprev = ev->pprev;
+    ev->pprev = NULL;
+}
+
+
+/*
+ * cascade
+ *   DESCRIPTION: Move the events of the current slot of a level to finer
+ *                levels, now that the wheel has reached the start of the
+ *                steps that slot covers.
+ *   INPUTS: w -- the wheel
+ *           level -- the level, at least 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+cascade (wheel_t* w, int level)
+{
+    wheel_event_t** head;
+    wheel_event_t* ev;
+
+    head = &w->slot[level][(w->now >> (WHEEL_BITS * level)) &
+			   (WHEEL_SIZE - 1)];
+    while ((ev = *head) != NULL) {
+	cancel_event (ev);
+	place_event (w, ev);
+    }
+}
+
+
+/*
+ * run_wheel
+ *   DESCRIPTION: Advance the wheel through step now, running the events
+ *                due on the way; see wheel.h.
+ *   INPUTS: w -- the wheel
+ *           now -- the last step to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs the functions of the events
+ */
+void
+run_wheel (wheel_t* w, unsigned long now)
+{
+    wheel_event_t** head;
+    wheel_event_t* due;  /* events due at this step, not yet run */
+    wheel_event_t* ev;
+    int level;
+
+    while ((long)(now - w->now) >= 0) {
+	/* At the start of each coarser slot, bring its events down. */
+	for (level = 1; level < WHEEL_LEVELS &&
+	     (w->now & ((1UL << (WHEEL_BITS * level)) - 1)) == 0; level++)
+	    cascade (w, level);
+
+	/*
+	 * Take the slot's events off the wheel and move on before running
+	 * them, so that events they add land in later slots (those for
+	 * this step or earlier in the next step's), while they may still
+	 * cancel events due now.
+	 */
+	head = &w->slot[0][w->now & (WHEEL_SIZE - 1)];
+	if ((due = *head) != NULL)
+	    due->pprev = &due;
+	*head = NULL;
+	w->now++;
+	while ((ev = due) != NULL) {
+	    cancel_event (ev);
+	    ev->fn (ev);
+	}
+    }
+}
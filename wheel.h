@@ -0,0 +1,68 @@
+/*									tab:8
+ *
+ * wheel.h - hierarchical timing wheel for timed game events
+ *
+ * Filename:	    wheel.h
+ * History:
+ *	1	Sun Oct 18 2026
+ *		First written.
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+
+/*
+ * A timing wheel schedules events at whole steps of a clock that its
+ * owner advances with run_wheel.  Adding and cancelling an event take
+ * constant time, and advancing by one step does work only for the events
+ * due then (plus, once every WHEEL_SIZE steps, moving the events of one
+ * slot of a coarser level down towards the finest).
+ *
+ * Level 0 has a slot for each of the next WHEEL_SIZE steps; each slot of
+ * level L covers WHEEL_SIZE^L steps.  Events further away than the wheel
+ * spans wait in the last slot and move down when they get there.
+ *
+ * A wheel and its events belong to one thread.  An event is owned by its
+ * caller (usually a static variable); the wheel only links it in while it
+ * is pending.  An event's function runs once the event is due, with the
+ * event no longer pending, and may add it (or others) again.
+ */
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)  /* slots per level */
+#define WHEEL_LEVELS 4                  /* spans 2^24 steps */
+
+typedef struct wheel_event {
+    struct wheel_event* next;   /* events in the same slot               */
+    struct wheel_event** pprev; /* link to this event; NULL if not pending */
+    unsigned long when;         /* step at which the event is due        */
+    void (*fn) (struct wheel_event* ev);  /* what to do then             */
+} wheel_event_t;
+
+typedef struct {
+    unsigned long now;          /* next step to run                      */
+    wheel_event_t* slot[WHEEL_LEVELS][WHEEL_SIZE];
+} wheel_t;
+
+/* initializer for an event that calls fn */
+#define WHEEL_EVENT(fn) {NULL, NULL, 0, (fn)}
+
+/* empty a wheel, and start its clock at step now */
+extern void init_wheel (wheel_t* w, unsigned long now);
+
+/*
+ * Make an event due at a step, cancelling it first if it is pending.  An
+ * event due at a step already run is due at the next step run.
+ */
+extern void add_event (wheel_t* w, wheel_event_t* ev, unsigned long when);
+
+/* cancel an event if it is pending */
+extern void cancel_event (wheel_event_t* ev);
+
+/* run every event due at or before step now, in order of step */
+extern void run_wheel (wheel_t* w, unsigned long now);
+
+/* is an event pending? */
+#define event_pending(ev) ((ev)->pprev != NULL)
+
+#endif /* WHEEL_H */